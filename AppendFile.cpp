@@ -0,0 +1,163 @@
+/*
+ * AppendFile.cpp
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "AppendFile.h"
+#include "common.h"
+
+
+using namespace std;
+
+
+static const size_t APPEND_FILE_ALIGNMENT = 4096;
+
+
+AppendFile::AppendFile(size_t buffer_size):
+    fd_(-1),
+    buffer_(NULL),
+    capacity_(0),
+    used_(0),
+    has_data_(false) {
+    // a whole number of pages
+    const size_t size = (buffer_size + APPEND_FILE_ALIGNMENT - 1) / APPEND_FILE_ALIGNMENT * APPEND_FILE_ALIGNMENT;
+    void* mem = NULL;
+    if (size > 0 && 0 == posix_memalign(&mem, APPEND_FILE_ALIGNMENT, size)) {
+        buffer_ = static_cast<char*>(mem);
+        capacity_ = size;
+    }
+}
+
+AppendFile::~AppendFile() {
+    close();
+    free(buffer_);
+}
+
+bool AppendFile::open(const string& file_name) {
+    if (fd_ >= 0) {
+        Assert(false, "The file is already opened!");
+        return true;
+    }
+
+    fd_ = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        LOG_TO_STDERR("Failed to open <%s>: %s", file_name.c_str(), strerror(errno));
+        return false;
+    }
+
+    file_name_ = file_name;
+    used_ = 0;
+    has_data_ = false;
+    register_log_crash_file(this);
+    return true;
+}
+
+void AppendFile::close() {
+    if (fd_ >= 0) {
+        unregister_log_crash_file(this);
+        flush();
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool AppendFile::isOpen() const {
+    return fd_ >= 0;
+}
+
+bool AppendFile::append(const char* data, size_t len) {
+    if (fd_ < 0) {
+        return false;
+    }
+    has_data_ = true;
+
+    if (used_ + len <= capacity_) {
+        memcpy(buffer_ + used_, data, len);
+        used_ += len;
+        return true;
+    }
+
+    // the buffer and the new piece together
+    return writeAll(data, len);
+}
+
+bool AppendFile::flush() {
+    if (fd_ < 0) {
+        return false;
+    }
+    return writeAll(NULL, 0);
+}
+
+bool AppendFile::sync() {
+    if (!flush()) {
+        return false;
+    }
+
+    if (fdatasync(fd_) != 0) {
+        LOG_TO_STDERR("Failed to sync <%s>: %s", file_name_.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// in the signal handler: used_ is left as it is, the thread that owns the
+// file may be in the middle of an append()
+int AppendFile::flushOnCrash() {
+    const int fd = fd_;
+    if (fd < 0 || !has_data_) {
+        return -1;
+    }
+
+    log_write_fully(fd, buffer_, used_);
+    return fd;
+}
+
+// writes the buffer followed by 'extra' with as few calls as possible
+bool AppendFile::writeAll(const char* extra, size_t extra_len) {
+    struct iovec iov[2];
+    int iov_num = 0;
+    if (used_ > 0) {
+        iov[iov_num].iov_base = buffer_;
+        iov[iov_num].iov_len = used_;
+        iov_num++;
+    }
+    if (extra_len > 0) {
+        iov[iov_num].iov_base = const_cast<char*>(extra);
+        iov[iov_num].iov_len = extra_len;
+        iov_num++;
+    }
+    used_ = 0;
+
+    struct iovec* pending = iov;
+    while (iov_num > 0) {
+        const ssize_t n = (1 == iov_num) ?
+                ::write(fd_, pending->iov_base, pending->iov_len) :
+                ::writev(fd_, pending, iov_num);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            LOG_TO_STDERR("Failed to write <%s>: %s", file_name_.c_str(), strerror(errno));
+            return false;
+        }
+
+        // skip what has been written
+        size_t written = n;
+        while (iov_num > 0 && written >= pending->iov_len) {
+            written -= pending->iov_len;
+            pending++;
+            iov_num--;
+        }
+        if (iov_num > 0) {
+            pending->iov_base = static_cast<char*>(pending->iov_base) + written;
+            pending->iov_len -= written;
+        }
+    }
+
+    return true;
+}
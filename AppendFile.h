@@ -0,0 +1,59 @@
+/*
+ * AppendFile.h
+ *
+ *  Note:
+ *  A file opened with O_APPEND and written through a buffer of its own, the
+ *  "fd" backend of FileLogger (file_backend = 1). Nothing reaches the kernel
+ *  until the buffer is full or flush() is called, then everything pending
+ *  goes out with one write(); a piece that doesn't fit in the buffer is sent
+ *  together with it by one writev(). What's buffered is written out by the
+ *  crash handler too (crash_handler = 1).
+ *
+ *  Not thread safe: the owner locks it.
+ */
+
+#ifndef APPENDFILE_H_
+#define APPENDFILE_H_
+
+#include <string>
+
+#include "LogCrashHandler.h"
+
+
+class AppendFile: public LogCrashFile {
+public:
+    explicit AppendFile(size_t buffer_size);
+    virtual ~AppendFile();
+
+    bool open(const std::string& file_name);
+    void close();
+    bool isOpen() const;
+
+    bool append(const char* data, size_t len);
+    bool flush();
+
+    // flush() and fdatasync()
+    bool sync();
+
+    // see LogCrashHandler.h
+    virtual int flushOnCrash();
+
+private:
+    // disabled methods
+    AppendFile(const AppendFile& rhs);
+    const AppendFile& operator=(const AppendFile& rhs);
+
+private:
+    bool writeAll(const char* extra, size_t extra_len);
+
+private:
+    std::string file_name_;
+    int fd_;
+
+    char* buffer_;      // aligned to the page
+    size_t capacity_;
+    size_t used_;
+    bool has_data_;     // appended to since opened, for the crash marker
+};
+
+#endif /* APPENDFILE_H_ */
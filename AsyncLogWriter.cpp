@@ -0,0 +1,255 @@
+/*
+ * AsyncLogWriter.cpp
+ */
+
+#include <string.h>
+#include <boost/bind/bind.hpp>
+#include "AsyncLogWriter.h"
+#include "LogRcu.h"
+
+
+using namespace std;
+
+
+AsyncLogWriter::AsyncLogWriter(boost::shared_ptr<LogSinks> sinks, unsigned long max_queue_size,
+        unsigned long long max_queue_bytes, ENUM_LOG_OVERFLOW_POLICY policy, unsigned long block_timeout_ms):
+    sinks_(sinks),
+    max_queue_size_(max_queue_size),
+    max_queue_bytes_(max_queue_bytes),
+    policy_(policy),
+    block_timeout_ms_(block_timeout_ms),
+    running_(false),
+    bytes_(0),
+    writing_(0),
+    pushed_(0),
+    done_(0),
+    max_bytes_(0),
+    blocked_(0),
+    dropped_newest_(0),
+    dropped_lowest_level_(0),
+    dropped_timeout_(0) {
+
+    if (max_queue_size_ < 1) {
+        max_queue_size_ = 1;
+        Assert(false, "async_queue_size > 0");
+    }
+    memset(level_counts_, 0, sizeof(level_counts_));
+}
+
+AsyncLogWriter::~AsyncLogWriter() {
+    stop();
+}
+
+bool AsyncLogWriter::start() {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (running_) {
+        Assert(false, "The async log writer is already started!");
+        return true;
+    }
+
+    try {
+        thread_ = boost::thread(boost::bind(&AsyncLogWriter::run, this));
+    }
+    catch (const std::exception& e) {
+        LOG_TO_STDERR("Failed to start the async log writer thread: %s", e.what());
+        return false;
+    }
+
+    running_ = true;
+    return true;
+}
+
+void AsyncLogWriter::stop() {
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+
+    // wake up the writer to drain what's left, and the producers blocked
+    // on a full queue and waitWritten() so that they can give up
+    not_empty_.notify_all();
+    not_full_.notify_all();
+    written_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool AsyncLogWriter::push(const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level, LogSinks* sinks,
+        bool check_level) {
+    Record rec;
+    gettimeofday(&rec.when, NULL);
+    rec.text_len = text_len;
+    rec.level = level;
+    rec.sinks = sinks != NULL ? sinks : sinks_.get();
+    rec.check_level = check_level;
+    rec.tid = rec.sinks->needThreadId() ? get_log_thread_id() : 0;
+    const size_t bytes = sizeof(Record) + len;
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    if (running_ && isFull(bytes)) {
+        if (OVERFLOW_DROP_NEWEST == policy_) {
+            dropped_newest_++;
+            return false;
+        }
+
+        if (OVERFLOW_DROP_LOWEST_LEVEL == policy_) {
+            while (isFull(bytes) && evictLowestLevel(level)) {
+            }
+            // nothing lower to give way; an ERROR waits for room instead
+            if (isFull(bytes) && level < LOG_LEVEL_ERROR) {
+                dropped_lowest_level_++;
+                return false;
+            }
+        }
+
+        if (isFull(bytes)) {
+            blocked_++;
+        }
+
+        if (OVERFLOW_BLOCK_WITH_TIMEOUT == policy_) {
+            const boost::system_time deadline = boost::get_system_time()
+                    + boost::posix_time::milliseconds(block_timeout_ms_);
+            while (running_ && isFull(bytes)) {
+                if (!not_full_.timed_wait(lock, deadline) && running_ && isFull(bytes)) {
+                    dropped_timeout_++;
+                    return false;
+                }
+            }
+        }
+        else {
+            while (running_ && isFull(bytes)) {
+                not_full_.wait(lock);
+            }
+        }
+    }
+
+    if (!running_) {
+        return false;
+    }
+
+    queue_.push_back(rec);
+    queue_.back().msg.assign(msg, len);
+    level_counts_[level]++;
+    pushed_++;
+    bytes_ += bytes;
+    if (bytes_ > max_bytes_) {
+        max_bytes_ = bytes_;
+    }
+
+    if (queue_.size() == 1) {
+        not_empty_.notify_one();
+    }
+
+    return true;
+}
+
+void AsyncLogWriter::waitWritten() {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    const unsigned long long target = pushed_;
+    while (done_ < target && running_) {
+        written_.wait(lock);
+    }
+}
+
+void AsyncLogWriter::getStats(LogQueueStats& stats) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    stats.queued = queue_.size() + writing_;
+    stats.queued_bytes = bytes_;
+    stats.max_queued_bytes = max_bytes_;
+    stats.blocked = blocked_;
+    stats.dropped_newest = dropped_newest_;
+    stats.dropped_lowest_level = dropped_lowest_level_;
+    stats.dropped_timeout = dropped_timeout_;
+}
+
+// with the lock held; a log larger than async_queue_bytes still gets in when
+// nothing else is queued, or it would never do
+bool AsyncLogWriter::isFull(size_t bytes) const {
+    if (queue_.size() >= max_queue_size_) {
+        return true;
+    }
+    return max_queue_bytes_ > 0 && bytes_ > 0 && bytes_ + bytes > max_queue_bytes_;
+}
+
+// with the lock held; drops the oldest of the queued logs of the lowest level
+// if it's lower than 'level' and than ERROR, false if there's none
+bool AsyncLogWriter::evictLowestLevel(ENUM_LOG_LEVEL level) {
+    int lowest = LOG_LEVEL_DEBUG;
+    while (lowest < level && lowest < LOG_LEVEL_ERROR && 0 == level_counts_[lowest]) {
+        ++lowest;
+    }
+    if (lowest >= level || lowest >= LOG_LEVEL_ERROR) {
+        return false;
+    }
+
+    for (std::deque<Record>::iterator it = queue_.begin(); it != queue_.end(); ++it) {
+        if (it->level == lowest) {
+            bytes_ -= sizeof(Record) + it->msg.size();
+            level_counts_[lowest]--;
+            queue_.erase(it);
+            done_++;
+            dropped_lowest_level_++;
+            return true;
+        }
+    }
+
+    Assert(false, "The level counts of the queue are wrong!");
+    return false;
+}
+
+void AsyncLogWriter::run() {
+    std::deque<Record> batch;
+
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+
+            while (running_ && queue_.empty()) {
+                not_empty_.wait(lock);
+            }
+
+            if (queue_.empty()) {
+                // stopped and drained
+                break;
+            }
+
+            batch.swap(queue_);
+            writing_ = batch.size();
+            memset(level_counts_, 0, sizeof(level_counts_));
+        }
+
+        not_full_.notify_all();
+
+        // the settings of the loggers read while formatting may be replaced
+        // by a config reload meanwhile, see LogRcu.h
+        unsigned long long bytes = 0;
+        log_rcu_read_lock();
+        for (std::deque<Record>::const_iterator it = batch.begin(); it != batch.end(); ++it) {
+            it->sinks->log(it->msg.data(), it->msg.size(), it->text_len, it->level, it->when, it->check_level, it->tid);
+            bytes += sizeof(Record) + it->msg.size();
+        }
+        log_rcu_read_unlock();
+
+        // the bytes written give room only now
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            bytes_ -= bytes;
+            writing_ = 0;
+            done_ += batch.size();
+        }
+        batch.clear();
+        written_.notify_all();
+        if (max_queue_bytes_ > 0) {
+            not_full_.notify_all();
+        }
+    }
+}
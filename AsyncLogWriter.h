@@ -0,0 +1,113 @@
+/*
+ * AsyncLogWriter.h
+ *
+ *  Note:
+ *  A bounded queue in front of the sinks. Any thread may push records into it,
+ *  and one dedicated thread drains the queue into the sinks, so the disk I/O
+ *  never happens on the caller's thread.
+ *
+ *  The queue is bounded by the number of logs (async_queue_size) and, if
+ *  async_queue_bytes is set, by their bytes, counting the ones the writer
+ *  thread is still writing; a log takes its length plus the size of a
+ *  Record. What happens to a log that doesn't fit is async_overflow, see
+ *  ENUM_LOG_OVERFLOW_POLICY. A log larger than the whole budget is only let
+ *  in when nothing else is queued.
+ */
+
+#ifndef ASYNCLOGWRITER_H_
+#define ASYNCLOGWRITER_H_
+
+#include <sys/time.h>
+#include <deque>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "LogSinks.h"
+
+
+class AsyncLogWriter {
+public:
+    AsyncLogWriter(boost::shared_ptr<LogSinks> sinks, unsigned long max_queue_size,
+            unsigned long long max_queue_bytes = LOG_DEFAULT_ASYNC_QUEUE_BYTES,
+            ENUM_LOG_OVERFLOW_POLICY policy = LOG_DEFAULT_ASYNC_OVERFLOW,
+            unsigned long block_timeout_ms = LOG_DEFAULT_ASYNC_BLOCK_TIMEOUT_MS);
+    virtual ~AsyncLogWriter();
+
+    bool start();
+
+    // stop accepting new records, write all the queued ones and wait for
+    // the writer thread to exit
+    void stop();
+
+    // what happens when the queue is full is up to the overflow policy; false
+    // if the log is dropped. 'sinks' NULL for the ones given to the
+    // constructor, see LogSinks::log() for 'text_len' and 'check_level'
+    bool push(const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level, LogSinks* sinks = NULL,
+            bool check_level = true);
+
+    void getStats(LogQueueStats& stats);
+
+    // waits until every record pushed before the call is written (or
+    // dropped), or the writer is stopped; a config reload frees the old
+    // sinks only after it
+    void waitWritten();
+
+private:
+    // disabled methods
+    AsyncLogWriter(const AsyncLogWriter& rhs);
+    const AsyncLogWriter& operator=(const AsyncLogWriter& rhs);
+
+private:
+    struct Record {
+        std::string msg;
+        size_t text_len;    // of msg, before its fields
+        ENUM_LOG_LEVEL level;
+        struct timeval when;
+        LogSinks* sinks;
+        bool check_level;
+        pid_t tid;          // of the caller, if the sinks need it
+    };
+
+    bool isFull(size_t bytes) const;
+    bool evictLowestLevel(ENUM_LOG_LEVEL level);
+    void run();
+
+private:
+    boost::shared_ptr<LogSinks> sinks_;
+    unsigned long max_queue_size_;
+    unsigned long long max_queue_bytes_;    // 0 for no limit
+    ENUM_LOG_OVERFLOW_POLICY policy_;
+    unsigned long block_timeout_ms_;
+
+    std::deque<Record> queue_;
+    bool running_;
+
+    // of queue_ and of the batch being written
+    unsigned long long bytes_;
+    unsigned long writing_;     // the logs of the batch
+    // the logs of queue_ by their level, for OVERFLOW_DROP_LOWEST_LEVEL
+    unsigned long level_counts_[LOG_LEVEL_MAX];
+
+    // the records queued, and the ones written or dropped since, for
+    // waitWritten()
+    unsigned long long pushed_;
+    unsigned long long done_;
+
+    // stats
+    unsigned long long max_bytes_;
+    unsigned long long blocked_;
+    unsigned long long dropped_newest_;
+    unsigned long long dropped_lowest_level_;
+    unsigned long long dropped_timeout_;
+
+    boost::mutex mutex_;
+    boost::condition_variable not_empty_;
+    boost::condition_variable not_full_;
+    boost::condition_variable written_;
+    boost::thread thread_;
+};
+
+#endif /* ASYNCLOGWRITER_H_ */
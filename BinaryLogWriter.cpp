@@ -0,0 +1,218 @@
+/*
+ * BinaryLogWriter.cpp
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <boost/filesystem.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include "BinaryLogWriter.h"
+
+
+using namespace std;
+
+
+//
+// helper functions:
+//
+
+static const size_t BINARY_BUFFER_SIZE = 64 * 1024;
+
+// all the formats ever registered, the index is the id
+static boost::mutex s_FormatsMutex;
+static vector<string> s_Formats(1, "%s");    // LOG_BINARY_TEXT_FORMAT_ID
+
+// helper end.
+
+
+unsigned int BinaryLogWriter::registerFormat(const char* format) {
+    boost::lock_guard<boost::mutex> lock(s_FormatsMutex);
+    s_Formats.push_back(format);    // a copy, the caller's text may not outlive it
+    return s_Formats.size() - 1;
+}
+
+BinaryLogWriter::BinaryLogWriter(const string& file_name, unsigned long flush_num, ENUM_LOG_TIME_PRECISION time_precision):
+    file_name_(file_name),
+    max_flush_num_(flush_num),
+    not_flushed_num_(0),
+    time_precision_(time_precision),
+    fd_(-1),
+    buffer_(BINARY_BUFFER_SIZE),
+    used_(0) {
+}
+
+BinaryLogWriter::~BinaryLogWriter() {
+    close();
+}
+
+bool BinaryLogWriter::open() {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (fd_ >= 0) {
+        Assert(false, "The binary log file is already opened!");
+        return true;
+    }
+
+    try {
+        const boost::filesystem::path dir = boost::filesystem::path(file_name_).parent_path();
+        if (!dir.empty() && !boost::filesystem::exists(dir)) {
+            boost::filesystem::create_directories(dir);
+            LOG_TO_STDERR("Created log directory <%s>", dir.string().c_str());
+        }
+    }
+    catch (const std::exception& e) {
+        LOG_TO_STDERR("Exception: %s", e.what());
+        return false;
+    }
+
+    fd_ = ::open(file_name_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        LOG_TO_STDERR("Failed to open binary log file <%s>: %s", file_name_.c_str(), strerror(errno));
+        return false;
+    }
+    LOG_TO_STDERR("Opened binary log file <%s> to APPEND to", file_name_.c_str());
+    register_log_crash_file(this);
+
+    // a new session: the header, then every format known so far
+    const char type = LOG_BINARY_ENTRY_HEADER;
+    const uint8_t version = LOG_BINARY_VERSION;
+    const uint8_t precision = time_precision_;
+    append(&type, sizeof(type));
+    append(LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_LEN);
+    append(&version, sizeof(version));
+    append(&precision, sizeof(precision));
+
+    boost::lock_guard<boost::mutex> formats_lock(s_FormatsMutex);
+    for (size_t id = 0; id < s_Formats.size(); ++id) {
+        const char type = LOG_BINARY_ENTRY_FORMAT;
+        const uint32_t format_id = id;
+        const uint32_t len = s_Formats[id].size();
+        append(&type, sizeof(type));
+        append(&format_id, sizeof(format_id));
+        append(&len, sizeof(len));
+        append(s_Formats[id].data(), len);
+    }
+    flushBuffer();
+
+    return true;
+}
+
+void BinaryLogWriter::close() {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (fd_ >= 0) {
+        unregister_log_crash_file(this);
+        flushBuffer();
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void BinaryLogWriter::write(const char* record, size_t len) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (fd_ < 0) {
+        return;
+    }
+
+    append(record, len);
+    recordWritten();
+}
+
+void BinaryLogWriter::writeText(const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level) {
+    char record[LOG_BINARY_MAX_RECORD_LEN];
+    LogBinaryBuf buf = { record, record + sizeof(record), false };
+
+    // cut the text, then the fields, to fit in one record
+    const size_t max_len = LOG_BINARY_MAX_RECORD_LEN - 64;
+    const uint32_t cut_text_len = text_len < max_len ? text_len : max_len;
+    const size_t fields_len = len - text_len;
+    const uint32_t cut_fields_len = fields_len < max_len - cut_text_len ? fields_len : max_len - cut_text_len;
+
+    log_binary_begin(buf, LOG_BINARY_TEXT_FORMAT_ID, level, fields_len > 0 ? 2 : 1);
+    log_binary_put_typed(buf, LOG_BINARY_ARG_STRING, &cut_text_len, sizeof(cut_text_len));
+    log_binary_put(buf, msg, cut_text_len);
+    if (fields_len > 0) {
+        log_binary_put_typed(buf, LOG_BINARY_ARG_STRING, &cut_fields_len, sizeof(cut_fields_len));
+        log_binary_put(buf, msg + text_len, cut_fields_len);
+    }
+
+    // the length field right after the entry type
+    const uint32_t record_len = buf.pos - record - 1 - sizeof(uint32_t);
+    memcpy(record + 1, &record_len, sizeof(record_len));
+
+    write(record, buf.pos - record);
+}
+
+void BinaryLogWriter::writeFormat(unsigned int id, const char* format) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (fd_ < 0) {
+        return;
+    }
+
+    const char type = LOG_BINARY_ENTRY_FORMAT;
+    const uint32_t format_id = id;
+    const uint32_t len = strlen(format);
+    append(&type, sizeof(type));
+    append(&format_id, sizeof(format_id));
+    append(&len, sizeof(len));
+    append(format, len);
+}
+
+void BinaryLogWriter::flush(bool sync) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (fd_ < 0) {
+        return;
+    }
+
+    flushBuffer();
+    not_flushed_num_ = 0;
+
+    if (sync && fdatasync(fd_) != 0) {
+        LOG_TO_STDERR("Failed to sync binary log file <%s>: %s", file_name_.c_str(), strerror(errno));
+    }
+}
+
+void BinaryLogWriter::append(const void* data, size_t len) {
+    if (used_ + len > buffer_.size()) {
+        flushBuffer();
+    }
+
+    if (len > buffer_.size()) {
+        log_write_fully(fd_, static_cast<const char*>(data), len);
+        return;
+    }
+
+    memcpy(&buffer_[used_], data, len);
+    used_ += len;
+}
+
+// in the signal handler, without the lock
+int BinaryLogWriter::flushOnCrash() {
+    if (fd_ >= 0 && used_ > 0) {
+        log_write_fully(fd_, &buffer_[0], used_);
+    }
+    return -1;
+}
+
+void BinaryLogWriter::flushBuffer() {
+    if (used_ > 0 && fd_ >= 0) {
+        if (!log_write_fully(fd_, &buffer_[0], used_)) {
+            LOG_TO_STDERR("Failed to write binary log file <%s>: %s", file_name_.c_str(), strerror(errno));
+        }
+    }
+    used_ = 0;
+}
+
+void BinaryLogWriter::recordWritten() {
+    not_flushed_num_++;
+    if (not_flushed_num_ >= max_flush_num_) {
+        flushBuffer();
+        not_flushed_num_ = 0;
+    }
+}
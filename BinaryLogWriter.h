@@ -0,0 +1,96 @@
+/*
+ * BinaryLogWriter.h
+ *
+ *  Note:
+ *  Writes the logs of the binary mode (log_binary = 1), which are not
+ *  formatted by the caller. Use allyes-log-decode to turn the file into text.
+ *
+ *  The file is a sequence of entries, in the byte order of the host:
+ *
+ *  'H' "ALYSLOGB" u8:version u8:time_precision
+ *      Starts every session, i.e. every time the file is opened. The format
+ *      ids are only valid until the next 'H'.
+ *
+ *  'F' u32:id u32:len char[len]
+ *      Defines the format string with the id. Written before its first use.
+ *
+ *  'L' u32:len u32:format_id i64:sec i32:usec u8:level u8:arg_num args...
+ *      A log; 'len' is the size of what follows it. Every argument is a
+ *      ENUM_LOG_BINARY_ARG_TYPE byte followed by the value.
+ *
+ *  Format id 0 is "%s": the logs already formatted as text (e.g. LOG_XXX_CTX).
+ *  A log with fields (LOG_XXX_KV) has them as a second string argument.
+ */
+
+#ifndef BINARYLOGWRITER_H_
+#define BINARYLOGWRITER_H_
+
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#include "common.h"
+#include "LogCrashHandler.h"
+
+
+#define LOG_BINARY_MAGIC            "ALYSLOGB"
+#define LOG_BINARY_MAGIC_LEN        (8)
+#define LOG_BINARY_VERSION          (1)
+
+#define LOG_BINARY_ENTRY_HEADER     'H'
+#define LOG_BINARY_ENTRY_FORMAT     'F'
+#define LOG_BINARY_ENTRY_LOG        'L'
+
+const unsigned int LOG_BINARY_TEXT_FORMAT_ID = 0;
+
+
+class BinaryLogWriter: public LogCrashFile {
+public:
+    BinaryLogWriter(const std::string& file_name, unsigned long flush_num, ENUM_LOG_TIME_PRECISION time_precision);
+    virtual ~BinaryLogWriter();
+
+    // gives the format an id, which stays the same in every file
+    static unsigned int registerFormat(const char* format);
+
+    bool open();
+    void close();
+
+    // the 'L' entry built by log_binary_begin() and log_binary_end()
+    void write(const char* record, size_t len);
+
+    // a text log, written as a log with the format "%s"; the fields after
+    // 'text_len', if any, as a second argument
+    void writeText(const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level);
+
+    void writeFormat(unsigned int id, const char* format);
+
+    // writes out what's buffered, and fdatasync()s if 'sync'
+    void flush(bool sync);
+
+    // see LogCrashHandler.h; no marker in the binary file
+    virtual int flushOnCrash();
+
+private:
+    // disabled methods
+    BinaryLogWriter(const BinaryLogWriter& rhs);
+    const BinaryLogWriter& operator=(const BinaryLogWriter& rhs);
+
+private:
+    void append(const void* data, size_t len);
+    void flushBuffer();
+    void recordWritten();
+
+private:
+    std::string file_name_;
+    unsigned long max_flush_num_;
+    unsigned long not_flushed_num_;
+    ENUM_LOG_TIME_PRECISION time_precision_;
+
+    int fd_;
+    std::vector<char> buffer_;
+    size_t used_;
+
+    boost::mutex mutex_;
+};
+
+#endif /* BINARYLOGWRITER_H_ */
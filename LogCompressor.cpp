@@ -0,0 +1,306 @@
+/*
+ * LogCompressor.cpp
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <zlib.h>
+#include <vector>
+#include <boost/bind/bind.hpp>
+#include <boost/filesystem.hpp>
+#include "LogCompressor.h"
+#include "common.h"
+
+
+using namespace std;
+
+
+//
+// helper functions:
+//
+
+static const size_t COMPRESS_CHUNK_SIZE = 256 * 1024;
+static const char* const COMPRESSED_SUFFIX = ".gz";
+static const char* const COMPRESSING_SUFFIX = ".gz.tmp";
+
+static double get_seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// "2012-08-23", then any number of "-<digits>"
+static bool is_rotation_desc(const string& desc) {
+    if (desc.size() < 10) {
+        return false;
+    }
+    for (size_t i = 0; i < 10; ++i) {
+        const bool dash = (4 == i || 7 == i);
+        if (dash ? desc[i] != '-' : !isdigit(static_cast<unsigned char>(desc[i]))) {
+            return false;
+        }
+    }
+
+    size_t i = 10;
+    while (i < desc.size()) {
+        if (desc[i] != '-' || i + 1 == desc.size()) {
+            return false;
+        }
+        ++i;
+        if (!isdigit(static_cast<unsigned char>(desc[i]))) {
+            return false;
+        }
+        while (i < desc.size() && isdigit(static_cast<unsigned char>(desc[i]))) {
+            ++i;
+        }
+    }
+    return true;
+}
+
+// links 'tmp_name' to '<file_name>.gz', or to '<file_name>-1.gz' ... if taken,
+// as link() never replaces a file; returns the name, or "" on failure
+static string link_compressed(const string& tmp_name, const string& file_name) {
+    for (int i = 0; ; ++i) {
+        string name = file_name;
+        if (i > 0) {
+            char suffix[16];
+            snprintf(suffix, sizeof(suffix), "-%d", i);
+            name += suffix;
+
+            // left to the rotated file of that name, compressed later
+            if (0 == access(name.c_str(), F_OK)) {
+                continue;
+            }
+        }
+
+        const string gz_name = name + COMPRESSED_SUFFIX;
+        if (0 == link(tmp_name.c_str(), gz_name.c_str())) {
+            return gz_name;
+        }
+        if (errno != EEXIST) {
+            LOG_TO_STDERR("Failed to link <%s> to <%s>: %s", tmp_name.c_str(), gz_name.c_str(),
+                    strerror(errno));
+            return "";
+        }
+    }
+}
+
+// helper end.
+
+
+bool LogCompressor::isRotatedFile(const string& file_name, const string& cur_file_name) {
+    const string prefix = cur_file_name + ".";
+    return file_name.size() > prefix.size() &&
+           0 == file_name.compare(0, prefix.size(), prefix) &&
+           is_rotation_desc(file_name.substr(prefix.size()));
+}
+
+bool LogCompressor::isNameTaken(const string& file_name) {
+    return 0 == access(file_name.c_str(), F_OK) ||
+           0 == access((file_name + COMPRESSED_SUFFIX).c_str(), F_OK) ||
+           0 == access((file_name + COMPRESSING_SUFFIX).c_str(), F_OK);
+}
+
+LogCompressor::LogCompressor(int level, unsigned long cpu_percent):
+    level_(level),
+    cpu_percent_(cpu_percent),
+    running_(false) {
+
+    if (level_ < Z_BEST_SPEED || level_ > Z_BEST_COMPRESSION) {
+        level_ = Z_DEFAULT_COMPRESSION;
+        Assert(false, "compress_level must be 1 ~ 9");
+    }
+    if (cpu_percent_ < 1 || cpu_percent_ > 100) {
+        cpu_percent_ = 100;
+        Assert(false, "compress_cpu_percent must be 1 ~ 100");
+    }
+}
+
+LogCompressor::~LogCompressor() {
+    stop();
+}
+
+bool LogCompressor::start() {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (running_) {
+        Assert(false, "The log compressor is already started!");
+        return true;
+    }
+
+    try {
+        thread_ = boost::thread(boost::bind(&LogCompressor::run, this));
+    }
+    catch (const std::exception& e) {
+        LOG_TO_STDERR("Failed to start the log compressor thread: %s", e.what());
+        return false;
+    }
+
+    running_ = true;
+    return true;
+}
+
+void LogCompressor::stop() {
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    cond_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void LogCompressor::push(const string& file_name) {
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        queue_.push_back(file_name);
+    }
+    cond_.notify_all();
+}
+
+void LogCompressor::pushLeftovers(const string& cur_file_name) {
+    const boost::filesystem::path cur_path(cur_file_name);
+    const string cur_name = cur_path.filename().string();
+    boost::filesystem::path dir = cur_path.parent_path();
+    if (dir.empty()) {
+        dir = ".";
+    }
+
+    vector<string> files;
+    try {
+        boost::filesystem::directory_iterator end;
+        for (boost::filesystem::directory_iterator it(dir); it != end; ++it) {
+            const string name = it->path().filename().string();
+            if (isRotatedFile(name, cur_name) && boost::filesystem::is_regular_file(it->status())) {
+                files.push_back(it->path().string());
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        LOG_TO_STDERR("Exception: %s", e.what());
+        return;
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        push(files[i]);
+    }
+}
+
+void LogCompressor::run() {
+    // the lowest priority, for this thread only
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    for (;;) {
+        while (running_ && queue_.empty()) {
+            cond_.wait(lock);
+        }
+        if (!running_) {
+            break;
+        }
+
+        const string file_name = queue_.front();
+        queue_.pop_front();
+
+        lock.unlock();
+        compress(file_name);
+        lock.lock();
+    }
+}
+
+bool LogCompressor::compress(const string& file_name) {
+    const string tmp_name = file_name + COMPRESSING_SUFFIX;
+
+    const int in_fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        LOG_TO_STDERR("Failed to open <%s> to compress: %s", file_name.c_str(), strerror(errno));
+        return false;
+    }
+
+    const int out_fd = ::open(tmp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out_fd < 0) {
+        LOG_TO_STDERR("Failed to open <%s>: %s", tmp_name.c_str(), strerror(errno));
+        ::close(in_fd);
+        return false;
+    }
+
+    // gzclose() closes the fd given to it, the other one is kept for fsync()
+    char mode[8];
+    snprintf(mode, sizeof(mode), "wb%d", level_);
+    gzFile gz = gzdopen(dup(out_fd), mode);
+
+    bool ok = (gz != NULL);
+    vector<char> buf(COMPRESS_CHUNK_SIZE);
+    const double cpu_begin = get_seconds(CLOCK_THREAD_CPUTIME_ID);
+    const double wall_begin = get_seconds(CLOCK_MONOTONIC);
+
+    while (ok) {
+        const ssize_t n = ::read(in_fd, &buf[0], buf.size());
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = (0 == n);
+            break;
+        }
+        if (gzwrite(gz, &buf[0], n) != n) {
+            ok = false;
+            break;
+        }
+
+        if (!throttle(get_seconds(CLOCK_THREAD_CPUTIME_ID) - cpu_begin,
+                get_seconds(CLOCK_MONOTONIC) - wall_begin)) {
+            ok = false;     // stopped
+            break;
+        }
+    }
+
+    if (gz != NULL && gzclose(gz) != Z_OK) {
+        ok = false;
+    }
+    ok = ok && 0 == fsync(out_fd);
+    ::close(out_fd);
+    ::close(in_fd);
+
+    if (!ok) {
+        LOG_TO_STDERR("Failed to compress <%s>", file_name.c_str());
+        unlink(tmp_name.c_str());
+        return false;
+    }
+
+    // not renamed: a rotation on the same day, or before a restart, may have
+    // used the name of a file already compressed
+    const string gz_name = link_compressed(tmp_name, file_name);
+    unlink(tmp_name.c_str());
+    if (gz_name.empty()) {
+        return false;
+    }
+    unlink(file_name.c_str());
+
+    LOG_TO_STDERR("Compressed <%s> to <%s>", file_name.c_str(), gz_name.c_str());
+    return true;
+}
+
+// sleeps until the CPU used is within cpu_percent_ of the time passed;
+// returns false if stopped meanwhile
+bool LogCompressor::throttle(double cpu_seconds, double wall_seconds) {
+    const double wall_needed = cpu_seconds * 100 / cpu_percent_;
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    if (running_ && wall_needed > wall_seconds) {
+        const long ms = static_cast<long>((wall_needed - wall_seconds) * 1000) + 1;
+        cond_.timed_wait(lock, boost::posix_time::milliseconds(ms));
+    }
+    return running_;
+}
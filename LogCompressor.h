@@ -0,0 +1,69 @@
+/*
+ * LogCompressor.h
+ *
+ *  Note:
+ *  Gzips the files rotated by RollingFileLogger (compress_rotated = 1) on a
+ *  thread of its own, at the lowest CPU priority and within
+ *  compress_cpu_percent of one core. "test.log.2012-08-23" becomes
+ *  "test.log.2012-08-23.gz": written as ".gz.tmp", synced and linked, and
+ *  only then is the original deleted. An existing ".gz" is never replaced:
+ *  "test.log.2012-08-23-1.gz" ... is taken instead. A file stopped half way
+ *  is compressed again from the start next time.
+ */
+
+#ifndef LOGCOMPRESSOR_H_
+#define LOGCOMPRESSOR_H_
+
+#include <deque>
+#include <string>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+
+class LogCompressor {
+public:
+    LogCompressor(int level, unsigned long cpu_percent);
+    virtual ~LogCompressor();
+
+    bool start();
+
+    // gives up the file being compressed, the queued ones are left as they are
+    void stop();
+
+    void push(const std::string& file_name);
+
+    // queues the rotated files of 'cur_file_name' not compressed yet, e.g.
+    // those renamed when the logger was closed
+    void pushLeftovers(const std::string& cur_file_name);
+
+    // "test.log.2012-08-23", "test.log.2012-08-23-10", "test.log.2012-08-23-1" ...
+    static bool isRotatedFile(const std::string& file_name, const std::string& cur_file_name);
+
+    // whether 'file_name' can't be given to a rotated file: it's there, or
+    // compressed, or being compressed
+    static bool isNameTaken(const std::string& file_name);
+
+private:
+    // disabled methods
+    LogCompressor(const LogCompressor& rhs);
+    const LogCompressor& operator=(const LogCompressor& rhs);
+
+private:
+    void run();
+    bool compress(const std::string& file_name);
+    bool throttle(double cpu_seconds, double wall_seconds);
+
+private:
+    int level_;
+    unsigned long cpu_percent_;
+
+    std::deque<std::string> queue_;
+    bool running_;
+
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    boost::thread thread_;
+};
+
+#endif /* LOGCOMPRESSOR_H_ */
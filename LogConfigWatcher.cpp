@@ -0,0 +1,209 @@
+/*
+ * LogConfigWatcher.cpp
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <boost/bind/bind.hpp>
+#include "LogConfigWatcher.h"
+#include "common.h"
+
+
+using namespace std;
+
+
+// the directory of 'file_name', absolute, so that a chdir() of the process
+// doesn't matter
+static string get_absolute_dir(const string& file_name) {
+    const string::size_type slash = file_name.rfind('/');
+    string dir = string::npos == slash ? string(".") : file_name.substr(0, slash + 1);
+
+    char cwd[PATH_MAX];
+    if (dir[0] != '/' && getcwd(cwd, sizeof(cwd)) != NULL) {
+        dir = string(cwd) + "/" + dir;
+    }
+    return dir;
+}
+
+static string get_base_name(const string& file_name) {
+    const string::size_type slash = file_name.rfind('/');
+    return string::npos == slash ? file_name : file_name.substr(slash + 1);
+}
+
+
+LogConfigWatcher::LogConfigWatcher(const std::string& file_name, const Callback& on_change):
+    file_name_(get_absolute_dir(file_name) + "/" + get_base_name(file_name)),
+    on_change_(on_change),
+    inotify_fd_(-1),
+    running_(false) {
+
+    wake_fds_[0] = -1;
+    wake_fds_[1] = -1;
+    memset(&last_stat_, 0, sizeof(last_stat_));
+}
+
+LogConfigWatcher::~LogConfigWatcher() {
+    stop();
+}
+
+bool LogConfigWatcher::start() {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (running_) {
+        Assert(false, "The log config watcher is already started!");
+        return true;
+    }
+
+    if (stat(file_name_.c_str(), &last_stat_) != 0) {
+        LOG_TO_STDERR("Failed to stat <%s>: %s", file_name_.c_str(), strerror(errno));
+        return false;
+    }
+
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        LOG_TO_STDERR("Failed to init inotify: %s", strerror(errno));
+        return false;
+    }
+
+    // the directory, as the file itself may be replaced by a rename
+    const string dir = get_absolute_dir(file_name_);
+    if (inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0
+            || pipe2(wake_fds_, O_CLOEXEC) != 0) {
+        LOG_TO_STDERR("Failed to watch <%s>: %s", dir.c_str(), strerror(errno));
+        ::close(inotify_fd_);
+        inotify_fd_ = -1;
+        return false;
+    }
+
+    try {
+        thread_ = boost::thread(boost::bind(&LogConfigWatcher::run, this));
+    }
+    catch (const std::exception& e) {
+        LOG_TO_STDERR("Failed to start the log config watcher thread: %s", e.what());
+        ::close(inotify_fd_);
+        ::close(wake_fds_[0]);
+        ::close(wake_fds_[1]);
+        inotify_fd_ = wake_fds_[0] = wake_fds_[1] = -1;
+        return false;
+    }
+
+    running_ = true;
+    LOG_TO_STDERR("Watching <%s> for changes", file_name_.c_str());
+    return true;
+}
+
+void LogConfigWatcher::stop() {
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+
+    const char byte = 0;
+    if (write(wake_fds_[1], &byte, 1) != 1) {
+        LOG_TO_STDERR("Failed to wake up the log config watcher: %s", strerror(errno));
+    }
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    ::close(inotify_fd_);
+    ::close(wake_fds_[0]);
+    ::close(wake_fds_[1]);
+    inotify_fd_ = wake_fds_[0] = wake_fds_[1] = -1;
+}
+
+void LogConfigWatcher::run() {
+    for (;;) {
+        struct pollfd fds[2] = {
+            { inotify_fd_, POLLIN, 0 },
+            { wake_fds_[0], POLLIN, 0 },
+        };
+
+        if (poll(fds, 2, -1) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            LOG_TO_STDERR("Failed to poll the log config watcher: %s", strerror(errno));
+            return;
+        }
+
+        if (fds[1].revents != 0) {
+            return;     // stopped
+        }
+
+        if (!drainEvents() || !waitQuiet()) {
+            return;
+        }
+
+        if (fileChanged()) {
+            on_change_();
+        }
+    }
+}
+
+// false if stopped
+bool LogConfigWatcher::waitQuiet() {
+    for (;;) {
+        struct pollfd fds[2] = {
+            { inotify_fd_, POLLIN, 0 },
+            { wake_fds_[0], POLLIN, 0 },
+        };
+
+        const int n = poll(fds, 2, LOG_CONFIG_RELOAD_DELAY_MS);
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0 == n;
+        }
+
+        if (fds[1].revents != 0 || !drainEvents()) {
+            return false;
+        }
+    }
+}
+
+// reads what inotify has; only the fact that something happened is used
+bool LogConfigWatcher::drainEvents() {
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        const ssize_t n = read(inotify_fd_, buf, sizeof(buf));
+        if (n > 0) {
+            continue;
+        }
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+        if (n < 0 && EAGAIN == errno) {
+            return true;
+        }
+
+        LOG_TO_STDERR("Failed to read the inotify events: %s", strerror(errno));
+        return false;
+    }
+}
+
+// not while the file is missing, in the middle of a save
+bool LogConfigWatcher::fileChanged() {
+    struct stat st;
+    if (stat(file_name_.c_str(), &st) != 0) {
+        return false;
+    }
+
+    const bool changed = st.st_ino != last_stat_.st_ino || st.st_dev != last_stat_.st_dev
+            || st.st_size != last_stat_.st_size
+            || st.st_mtim.tv_sec != last_stat_.st_mtim.tv_sec
+            || st.st_mtim.tv_nsec != last_stat_.st_mtim.tv_nsec;
+    last_stat_ = st;
+    return changed;
+}
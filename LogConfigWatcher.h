@@ -0,0 +1,61 @@
+/*
+ * LogConfigWatcher.h
+ *
+ *  Note:
+ *  The thread of config_reload = 1: watches the directory of the config file
+ *  with inotify and calls back when the file has changed. The editors save a
+ *  file in more than one go (truncate and write, or write a copy and rename
+ *  it over), so the callback only comes once nothing has happened to the
+ *  directory for LOG_CONFIG_RELOAD_DELAY_MS. Whether the file has changed is
+ *  told by its inode, size and mtime, through any symlink, so a symlink
+ *  swapped to another file counts too.
+ */
+
+#ifndef LOGCONFIGWATCHER_H_
+#define LOGCONFIGWATCHER_H_
+
+#include <sys/stat.h>
+#include <string>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+
+class LogConfigWatcher {
+public:
+    typedef boost::function<void ()> Callback;
+
+    // 'on_change' is called on the thread of the watcher
+    LogConfigWatcher(const std::string& file_name, const Callback& on_change);
+    virtual ~LogConfigWatcher();
+
+    bool start();
+
+    // waits for the thread to exit, and for the callback if it's running
+    void stop();
+
+private:
+    // disabled methods
+    LogConfigWatcher(const LogConfigWatcher& rhs);
+    const LogConfigWatcher& operator=(const LogConfigWatcher& rhs);
+
+private:
+    void run();
+    bool waitQuiet();
+    bool drainEvents();
+    bool fileChanged();
+
+private:
+    std::string file_name_;
+    Callback on_change_;
+
+    int inotify_fd_;
+    int wake_fds_[2];       // a pipe, written by stop()
+    struct stat last_stat_; // of the file at the last callback
+
+    bool running_;
+    boost::mutex mutex_;
+    boost::thread thread_;
+};
+
+#endif /* LOGCONFIGWATCHER_H_ */
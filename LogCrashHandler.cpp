@@ -0,0 +1,264 @@
+/*
+ * LogCrashHandler.cpp
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include "LogCrashHandler.h"
+#include "common.h"
+
+
+using namespace std;
+
+
+namespace {
+
+const size_t MAX_CRASH_FILES = 256;
+const int MAX_BACKTRACE_DEPTH = 64;
+const size_t ALT_STACK_SIZE = 64 * 1024;
+
+const int s_Signals[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+const size_t SIGNAL_NUM = sizeof(s_Signals) / sizeof(s_Signals[0]);
+
+std::atomic<LogCrashFile*> s_Files[MAX_CRASH_FILES];
+std::atomic<bool> s_Installed(false);
+std::atomic<bool> s_Crashing(false);
+struct sigaction s_OldActions[SIGNAL_NUM];
+char s_AltStack[ALT_STACK_SIZE];
+void* s_Frames[MAX_BACKTRACE_DEPTH];
+
+
+//
+// async-signal-safe helpers: no stdio, no allocation
+//
+
+const char* get_signal_name(int sig) {
+    switch (sig) {
+    case SIGSEGV:   return "SIGSEGV";
+    case SIGABRT:   return "SIGABRT";
+    case SIGBUS:    return "SIGBUS";
+    case SIGFPE:    return "SIGFPE";
+    case SIGILL:    return "SIGILL";
+    default:        return "?";
+    }
+}
+
+char* append_text(char* p, char* end, const char* text) {
+    while (p < end && *text != '\0') {
+        *p++ = *text++;
+    }
+    return p;
+}
+
+// 'width' digits at least, padded with '0'
+char* append_number(char* p, char* end, unsigned long long value, int width = 1) {
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0 && n < static_cast<int>(sizeof(digits)));
+    while (n < width && n < static_cast<int>(sizeof(digits))) {
+        digits[n++] = '0';
+    }
+
+    while (p < end && n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+// "[LOG CRASH] signal 11 (SIGSEGV) in thread 1234 at 1350000000.123456, backtrace:\n"
+size_t format_crash_marker(char* buf, size_t size, int sig) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    char* p = buf;
+    char* const end = buf + size;
+    p = append_text(p, end, "[LOG CRASH] signal ");
+    p = append_number(p, end, sig);
+    p = append_text(p, end, " (");
+    p = append_text(p, end, get_signal_name(sig));
+    p = append_text(p, end, ") in thread ");
+    p = append_number(p, end, syscall(SYS_gettid));
+    p = append_text(p, end, " at ");
+    p = append_number(p, end, now.tv_sec);
+    p = append_text(p, end, ".");
+    p = append_number(p, end, now.tv_nsec / 1000, 6);
+    p = append_text(p, end, ", backtrace:\n");
+    return p - buf;
+}
+
+void write_crash_marker(int fd, const char* marker, size_t len, int frame_num) {
+    static const char END_LINE[] = "[LOG CRASH] end of backtrace\n";
+
+    log_write_fully(fd, marker, len);
+    backtrace_symbols_fd(s_Frames, frame_num, fd);
+    log_write_fully(fd, END_LINE, sizeof(END_LINE) - 1);
+}
+
+void handle_crash(int sig, siginfo_t* info, void* context) {
+    const int saved_errno = errno;
+
+    // another thread is at it, and raises its signal again when done
+    if (s_Crashing.exchange(true)) {
+        for (;;) {
+            pause();
+        }
+    }
+
+    // the logs first, they are what's needed
+    int fds[MAX_CRASH_FILES];
+    size_t fd_num = 0;
+    for (size_t i = 0; i < MAX_CRASH_FILES; ++i) {
+        LogCrashFile* file = s_Files[i].load(std::memory_order_acquire);
+        if (file != NULL) {
+            const int fd = file->flushOnCrash();
+            if (fd >= 0) {
+                fds[fd_num++] = fd;
+            }
+        }
+    }
+
+    char marker[256];
+    const size_t marker_len = format_crash_marker(marker, sizeof(marker), sig);
+    const int frame_num = backtrace(s_Frames, MAX_BACKTRACE_DEPTH);
+    for (size_t i = 0; i < fd_num; ++i) {
+        write_crash_marker(fds[i], marker, marker_len, frame_num);
+    }
+    write_crash_marker(STDERR_FILENO, marker, marker_len, frame_num);
+
+    // to the handler there before, or the default action once this one
+    // returns
+    for (size_t i = 0; i < SIGNAL_NUM; ++i) {
+        if (s_Signals[i] == sig) {
+            sigaction(sig, &s_OldActions[i], NULL);
+        }
+    }
+    errno = saved_errno;
+    raise(sig);
+}
+
+} // namespace
+
+
+void register_log_crash_file(LogCrashFile* file) {
+    for (size_t i = 0; i < MAX_CRASH_FILES; ++i) {
+        LogCrashFile* empty = NULL;
+        if (s_Files[i].compare_exchange_strong(empty, file, std::memory_order_release)) {
+            return;
+        }
+    }
+
+    static std::atomic<bool> s_Warned(false);
+    if (!s_Warned.exchange(true)) {
+        LOG_TO_STDERR("Too many log files for the crash handler, the new ones aren't covered");
+    }
+}
+
+void unregister_log_crash_file(LogCrashFile* file) {
+    for (size_t i = 0; i < MAX_CRASH_FILES; ++i) {
+        LogCrashFile* expected = file;
+        if (s_Files[i].compare_exchange_strong(expected, NULL)) {
+            return;
+        }
+    }
+}
+
+bool install_log_crash_handler() {
+    if (s_Installed.exchange(true)) {
+        return true;
+    }
+
+    // backtrace() may load libgcc, and allocate, the first time
+    void* frame = NULL;
+    backtrace(&frame, 1);
+
+    // a stack overflow leaves no room to run the handler on; not if the
+    // thread has an alternate stack already
+    stack_t old_stack;
+    if (0 == sigaltstack(NULL, &old_stack) && (old_stack.ss_flags & SS_DISABLE)) {
+        stack_t stack;
+        memset(&stack, 0, sizeof(stack));
+        stack.ss_sp = s_AltStack;
+        stack.ss_size = sizeof(s_AltStack);
+        if (sigaltstack(&stack, NULL) != 0) {
+            LOG_TO_STDERR("Failed to set the alternate signal stack: %s", strerror(errno));
+        }
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handle_crash;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+
+    for (size_t i = 0; i < SIGNAL_NUM; ++i) {
+        if (sigaction(s_Signals[i], &action, &s_OldActions[i]) != 0) {
+            LOG_TO_STDERR("Failed to handle %s: %s", get_signal_name(s_Signals[i]), strerror(errno));
+            while (i-- > 0) {
+                sigaction(s_Signals[i], &s_OldActions[i], NULL);
+            }
+            s_Installed.store(false);
+            return false;
+        }
+    }
+
+    LOG_TO_STDERR("Crash handler installed");
+    return true;
+}
+
+void uninstall_log_crash_handler() {
+    if (!s_Installed.exchange(false)) {
+        return;
+    }
+
+    for (size_t i = 0; i < SIGNAL_NUM; ++i) {
+        sigaction(s_Signals[i], &s_OldActions[i], NULL);
+    }
+}
+
+bool log_write_fully(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        const ssize_t n = ::write(fd, data, len);
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+        if (0 == n) {
+            errno = EIO;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool log_pwrite_fully(int fd, const char* data, size_t len, off_t offset) {
+    while (len > 0) {
+        const ssize_t n = ::pwrite(fd, data, len, offset);
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+        if (0 == n) {
+            errno = EIO;
+            return false;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
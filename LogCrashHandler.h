@@ -0,0 +1,53 @@
+/*
+ * LogCrashHandler.h
+ *
+ *  Note:
+ *  crash_handler = 1: on SIGSEGV, SIGABRT, SIGBUS, SIGFPE or SIGILL the logs
+ *  still buffered by the files (num_logs_to_flush > 1) are written out
+ *  before the process dies, then a marker line with the signal, followed by
+ *  a backtrace, is appended to every text log file and to stderr, and the
+ *  signal is raised again for the handler that was there before, or the
+ *  default action (the core dump).
+ *
+ *  Every file with a buffer of its own registers itself while it's opened;
+ *  the handler goes through them with async-signal-safe calls only: no lock
+ *  is taken, nothing is allocated. A log being appended by another thread
+ *  at that moment may be cut or written twice. The records still in the
+ *  async queue are not covered; the mmap backend (file_backend = 3) needs
+ *  nothing, its logs are in the page cache already.
+ */
+
+#ifndef LOGCRASHHANDLER_H_
+#define LOGCRASHHANDLER_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+
+// a file the crash handler writes out
+class LogCrashFile {
+public:
+    virtual ~LogCrashFile() {}
+
+    // writes what's buffered, with async-signal-safe calls only; the fd to
+    // append the crash marker to, -1 for none
+    virtual int flushOnCrash() = 0;
+};
+
+// while the file is opened; a few hundred files at most are covered
+void register_log_crash_file(LogCrashFile* file);
+void unregister_log_crash_file(LogCrashFile* file);
+
+// for the calling thread, also an alternate stack to run the handler on a
+// stack overflow
+bool install_log_crash_handler();
+// back to the handlers there before
+void uninstall_log_crash_handler();
+
+// all of 'data', again on EINTR; async-signal-safe, for the files to write
+// out their buffers with, in flushOnCrash() or not. false on an error, with
+// errno set
+bool log_write_fully(int fd, const char* data, size_t len);
+bool log_pwrite_fully(int fd, const char* data, size_t len, off_t offset);
+
+#endif /* LOGCRASHHANDLER_H_ */
@@ -0,0 +1,195 @@
+/*
+ * LogFile.cpp
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+#include "LogFile.h"
+
+
+using namespace std;
+
+
+LogStreamBuf::LogStreamBuf(int fd):
+    __gnu_cxx::stdio_filebuf<char>(fd, std::ios_base::out | std::ios_base::app),
+    has_data_(false) {
+    register_log_crash_file(this);
+}
+
+LogStreamBuf::~LogStreamBuf() {
+    // before the buffer is flushed and freed by std::filebuf
+    unregister_log_crash_file(this);
+}
+
+int LogStreamBuf::flushOnCrash() {
+    const int fd = this->fd();
+    if (fd < 0 || !has_data_) {
+        return -1;
+    }
+
+    // the put area, what std::filebuf hasn't written yet
+    const char* data = pbase();
+    if (data != NULL && pptr() > data) {
+        log_write_fully(fd, data, pptr() - data);
+    }
+    return fd;
+}
+
+std::streamsize LogStreamBuf::xsputn(const char* data, std::streamsize len) {
+    has_data_ = true;
+    return __gnu_cxx::stdio_filebuf<char>::xsputn(data, len);
+}
+
+
+LogFile::LogFile(ENUM_LOG_FILE_BACKEND backend, unsigned long buffer_size):
+    backend_(backend),
+    buffer_size_(buffer_size),
+    size_(0) {
+}
+
+LogFile::~LogFile() {
+    close();
+}
+
+bool LogFile::open(const string& file_name) {
+    if (isOpen()) {
+        Assert(false, "The file is already opened!");
+        return true;
+    }
+
+    // what mmap left after a crash is only logs again
+    MmapFile::trim(file_name);
+
+    boost::system::error_code ec;
+    size_ = boost::filesystem::file_size(file_name, ec);
+    if (ec) {
+        size_ = 0;
+    }
+
+    if (FILE_BACKEND_MMAP == backend_) {
+        mmap_file_ = boost::shared_ptr<MmapFile>(new MmapFile(buffer_size_));
+        if (!mmap_file_->open(file_name)) {
+            mmap_file_.reset();
+            return false;
+        }
+        LOG_TO_STDERR("Opened log file <%s> to APPEND to through mmap", file_name.c_str());
+        return true;
+    }
+
+    if (FILE_BACKEND_URING == backend_) {
+        if (UringFile::isAvailable()) {
+            uring_file_ = boost::shared_ptr<UringFile>(new UringFile(buffer_size_, LOG_URING_BUFFER_NUM));
+            if (uring_file_->open(file_name)) {
+                LOG_TO_STDERR("Opened log file <%s> to APPEND to through io_uring", file_name.c_str());
+                return true;
+            }
+            uring_file_.reset();
+        }
+        LOG_TO_STDERR("io_uring can't be used, falling back to file_backend = %d", FILE_BACKEND_FD);
+    }
+
+    if (FILE_BACKEND_FD == backend_ || FILE_BACKEND_URING == backend_) {
+        fd_file_ = boost::shared_ptr<AppendFile>(new AppendFile(buffer_size_));
+        if (!fd_file_->open(file_name)) {
+            fd_file_.reset();
+            return false;
+        }
+        LOG_TO_STDERR("Opened log file <%s> to APPEND to", file_name.c_str());
+        return true;
+    }
+
+    const int fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_TO_STDERR("Failed to open log file <%s>: %s", file_name.c_str(), strerror(errno));
+        return false;
+    }
+
+    stream_buf_ = boost::shared_ptr<LogStreamBuf>(new LogStreamBuf(fd));
+    LOG_TO_STDERR("Opened log file <%s> to APPEND to", file_name.c_str());
+    return true;
+}
+
+void LogFile::close() {
+    if (mmap_file_) {
+        mmap_file_->close();
+        mmap_file_.reset();
+    }
+
+    if (uring_file_) {
+        uring_file_->close();
+        uring_file_.reset();
+    }
+
+    if (fd_file_) {
+        fd_file_->close();
+        fd_file_.reset();
+    }
+
+    // flushed and closed by std::filebuf
+    stream_buf_.reset();
+}
+
+bool LogFile::isOpen() const {
+    return mmap_file_ || uring_file_ || fd_file_ || stream_buf_;
+}
+
+bool LogFile::append(const char* data, size_t len) {
+    if (!isOpen()) {
+        return false;
+    }
+
+    size_ += len;
+
+    if (mmap_file_) {
+        return mmap_file_->append(data, len);
+    }
+
+    if (uring_file_) {
+        return uring_file_->append(data, len);
+    }
+
+    if (fd_file_) {
+        return fd_file_->append(data, len);
+    }
+
+    return stream_buf_->sputn(data, len) == static_cast<std::streamsize>(len);
+}
+
+void LogFile::flush() {
+    // nothing for mmap: the pages belong to the kernel as soon as the logs
+    // are copied
+
+    if (uring_file_) {
+        uring_file_->flush();
+    }
+
+    if (fd_file_) {
+        fd_file_->flush();
+    }
+
+    if (stream_buf_) {
+        stream_buf_->pubsync();
+    }
+}
+
+void LogFile::sync() {
+    // the io_uring backend fsyncs on every flush() already
+    if (stream_buf_ && fdatasync(stream_buf_->fd()) != 0) {
+        LOG_TO_STDERR("Failed to sync the log file: %s", strerror(errno));
+    }
+
+    if (fd_file_) {
+        fd_file_->sync();
+    }
+
+    if (mmap_file_) {
+        mmap_file_->sync();
+    }
+}
+
+unsigned long long LogFile::getSize() const {
+    return size_;
+}
@@ -0,0 +1,87 @@
+/*
+ * LogFile.h
+ *
+ *  Note:
+ *  A log file opened to append to through one of the file backends
+ *  (file_backend): a LogStreamBuf, an AppendFile, a UringFile, which falls
+ *  back to an AppendFile where io_uring can't be used, or an MmapFile. What
+ *  FileLogger and RollingFileLogger write with.
+ *
+ *  Not thread safe: the owner locks it.
+ */
+
+#ifndef LOGFILE_H_
+#define LOGFILE_H_
+
+#include <string>
+#include <ext/stdio_filebuf.h>
+#include <boost/shared_ptr.hpp>
+
+#include "common.h"
+#include "AppendFile.h"
+#include "UringFile.h"
+#include "MmapFile.h"
+#include "LogCrashHandler.h"
+
+
+// the buffer of FILE_BACKEND_FSTREAM: the std::filebuf of std::fstream, on an
+// fd opened by LogFile, so that the crash handler can write out what's still
+// in it
+class LogStreamBuf: public __gnu_cxx::stdio_filebuf<char>, public LogCrashFile {
+public:
+    // takes 'fd' over
+    explicit LogStreamBuf(int fd);
+    virtual ~LogStreamBuf();
+
+    // see LogCrashHandler.h
+    virtual int flushOnCrash();
+
+protected:
+    virtual std::streamsize xsputn(const char* data, std::streamsize len);
+
+private:
+    // disabled methods
+    LogStreamBuf(const LogStreamBuf& rhs);
+    const LogStreamBuf& operator=(const LogStreamBuf& rhs);
+
+private:
+    bool has_data_;     // appended to since opened, for the crash marker
+};
+
+
+class LogFile {
+public:
+    // 'buffer_size' is the chunk size of FILE_BACKEND_MMAP
+    LogFile(ENUM_LOG_FILE_BACKEND backend, unsigned long buffer_size);
+    virtual ~LogFile();
+
+    bool open(const std::string& file_name);
+    void close();
+    bool isOpen() const;
+
+    bool append(const char* data, size_t len);
+    void flush();
+    // makes what flush() wrote durable
+    void sync();
+
+    // the size of the file, including what's still buffered
+    unsigned long long getSize() const;
+
+private:
+    // disabled methods
+    LogFile(const LogFile& rhs);
+    const LogFile& operator=(const LogFile& rhs);
+
+private:
+    ENUM_LOG_FILE_BACKEND backend_;
+    unsigned long buffer_size_;
+
+    boost::shared_ptr<LogStreamBuf> stream_buf_;    // FILE_BACKEND_FSTREAM
+    boost::shared_ptr<AppendFile> fd_file_;         // FILE_BACKEND_FD
+    boost::shared_ptr<UringFile> uring_file_;       // FILE_BACKEND_URING
+    boost::shared_ptr<MmapFile> mmap_file_;         // FILE_BACKEND_MMAP
+
+    unsigned long long size_;
+};
+
+#endif /* LOGFILE_H_ */
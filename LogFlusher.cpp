@@ -0,0 +1,45 @@
+/*
+ * LogFlusher.cpp
+ */
+
+#include <boost/bind/bind.hpp>
+#include "LogFlusher.h"
+
+
+using namespace std;
+
+
+LogFlusher::LogFlusher(const vector<boost::shared_ptr<LogSinks> >& sinks, boost::shared_ptr<BinaryLogWriter> binary_writer,
+        unsigned long interval_ms, bool sync):
+    sinks_(sinks),
+    binary_writer_(binary_writer),
+    interval_ms_(interval_ms),
+    sync_(sync),
+    thread_("log flusher", boost::bind(&LogFlusher::flushAll, this), true) {
+
+    if (interval_ms_ < 1) {
+        interval_ms_ = 1;
+        Assert(false, "flush_interval_ms > 0");
+    }
+}
+
+LogFlusher::~LogFlusher() {
+    stop();
+}
+
+bool LogFlusher::start() {
+    return thread_.start(interval_ms_);
+}
+
+void LogFlusher::stop() {
+    thread_.stop();
+}
+
+void LogFlusher::flushAll() {
+    for (size_t i = 0; i < sinks_.size(); ++i) {
+        sinks_[i]->flushPending(sync_);
+    }
+    if (binary_writer_) {
+        binary_writer_->flush(sync_);
+    }
+}
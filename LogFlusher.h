@@ -0,0 +1,51 @@
+/*
+ * LogFlusher.h
+ *
+ *  Note:
+ *  The timer of flush_interval_ms: every interval, whatever was logged since
+ *  the last flush, by any thread, is flushed at once, so a quiet process
+ *  doesn't keep its last logs in the buffer. With flush_fsync = 1 the file
+ *  is also fsynced, once per interval (group commit).
+ */
+
+#ifndef LOGFLUSHER_H_
+#define LOGFLUSHER_H_
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "LogSinks.h"
+#include "BinaryLogWriter.h"
+#include "LogPeriodicThread.h"
+
+
+class LogFlusher {
+public:
+    // 'binary_writer' may be NULL
+    LogFlusher(const std::vector<boost::shared_ptr<LogSinks> >& sinks, boost::shared_ptr<BinaryLogWriter> binary_writer,
+            unsigned long interval_ms, bool sync);
+    virtual ~LogFlusher();
+
+    bool start();
+
+    // flushes one last time and waits for the thread to exit
+    void stop();
+
+private:
+    // disabled methods
+    LogFlusher(const LogFlusher& rhs);
+    const LogFlusher& operator=(const LogFlusher& rhs);
+
+private:
+    void flushAll();
+
+private:
+    std::vector<boost::shared_ptr<LogSinks> > sinks_;
+    boost::shared_ptr<BinaryLogWriter> binary_writer_;
+    unsigned long interval_ms_;
+    bool sync_;
+
+    LogPeriodicThread thread_;
+};
+
+#endif /* LOGFLUSHER_H_ */
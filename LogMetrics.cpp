@@ -0,0 +1,192 @@
+/*
+ * LogMetrics.cpp
+ */
+
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <boost/bind/bind.hpp>
+#include "LogMetrics.h"
+#include "LogThreadRegistry.h"
+#include "LogSys.h"
+
+
+using namespace std;
+
+
+static std::atomic<bool> s_latency_on(false);
+
+ThreadLogMetrics::ThreadLogMetrics() {
+    for (int i = 0; i < LOG_LEVEL_MAX; ++i) {
+        records[i].store(0);
+    }
+    filtered.store(0);
+    bytes.store(0);
+    writes.store(0);
+    flushes.store(0);
+    rotations.store(0);
+    rotation_ns.store(0);
+    lock_waits.store(0);
+    lock_wait_ns.store(0);
+    for (int i = 0; i < LOG_METRICS_HIST_BUCKETS; ++i) {
+        write_hist[i].store(0);
+        flush_hist[i].store(0);
+    }
+}
+
+// adds the counters of 'thread' to 'metrics'
+static void add_thread_metrics(LogMetrics& metrics, const ThreadLogMetrics& thread) {
+    for (int i = 0; i < LOG_LEVEL_MAX; ++i) {
+        metrics.records[i] += thread.records[i].load(std::memory_order_relaxed);
+    }
+    metrics.filtered += thread.filtered.load(std::memory_order_relaxed);
+    metrics.writes += thread.writes.load(std::memory_order_relaxed);
+    metrics.bytes += thread.bytes.load(std::memory_order_relaxed);
+    metrics.flushes += thread.flushes.load(std::memory_order_relaxed);
+    metrics.rotations += thread.rotations.load(std::memory_order_relaxed);
+    metrics.rotation_us += thread.rotation_ns.load(std::memory_order_relaxed) / 1000;
+    metrics.lock_waits += thread.lock_waits.load(std::memory_order_relaxed);
+    metrics.lock_wait_us += thread.lock_wait_ns.load(std::memory_order_relaxed) / 1000;
+    for (int i = 0; i < LOG_METRICS_HIST_BUCKETS; ++i) {
+        metrics.write_us_hist[i] += thread.write_hist[i].load(std::memory_order_relaxed);
+        metrics.flush_us_hist[i] += thread.flush_hist[i].load(std::memory_order_relaxed);
+    }
+}
+
+// the sum of the threads exited, under the lock of MetricsRegistry
+static LogMetrics s_exited;
+
+static void add_exited_metrics(const ThreadLogMetrics& thread) {
+    add_thread_metrics(s_exited, thread);
+}
+
+typedef LogThreadRegistry<ThreadLogMetrics, &add_exited_metrics> MetricsRegistry;
+
+ThreadLogMetrics& thread_log_metrics() {
+    return MetricsRegistry::local();
+}
+
+void add_log_latency(std::atomic<uint64_t>* hist, uint64_t ns) {
+    const uint64_t us = ns / 1000;
+    int bucket = 0;
+    if (us > 0) {
+        bucket = 64 - __builtin_clzll(us);
+        if (bucket >= LOG_METRICS_HIST_BUCKETS) {
+            bucket = LOG_METRICS_HIST_BUCKETS - 1;
+        }
+    }
+    add_log_metric(hist[bucket], 1);
+}
+
+uint64_t log_metrics_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+bool log_metrics_latency_on() {
+    return s_latency_on.load(std::memory_order_relaxed);
+}
+
+void set_log_metrics_latency(bool on) {
+    s_latency_on.store(on, std::memory_order_relaxed);
+}
+
+void get_log_metrics(LogMetrics& metrics) {
+    boost::lock_guard<boost::mutex> lock(MetricsRegistry::mutex());
+    const vector<ThreadLogMetrics*>& threads = MetricsRegistry::objects();
+
+    metrics = s_exited;
+    for (size_t i = 0; i < threads.size(); ++i) {
+        add_thread_metrics(metrics, *threads[i]);
+    }
+}
+
+unsigned long long get_log_latency_percentile(const unsigned long long* hist, double percent) {
+    unsigned long long total = 0;
+    for (int i = 0; i < LOG_METRICS_HIST_BUCKETS; ++i) {
+        total += hist[i];
+    }
+    if (0 == total) {
+        return 0;
+    }
+
+    const double wanted = total * percent / 100;
+    unsigned long long count = 0;
+    for (int i = 0; i < LOG_METRICS_HIST_BUCKETS - 1; ++i) {
+        count += hist[i];
+        if (count >= wanted) {
+            return 1ULL << i;
+        }
+    }
+    return 1ULL << (LOG_METRICS_HIST_BUCKETS - 2);
+}
+
+
+LogMetricsReporter::LogMetricsReporter(unsigned long interval_ms):
+    interval_ms_(interval_ms),
+    thread_("metrics reporter", boost::bind(&LogMetricsReporter::report, this), false) {
+
+    if (interval_ms_ < 1) {
+        interval_ms_ = 1;
+        Assert(false, "metrics_interval_ms > 0");
+    }
+    memset(&last_, 0, sizeof(last_));
+}
+
+LogMetricsReporter::~LogMetricsReporter() {
+    stop();
+}
+
+bool LogMetricsReporter::start() {
+    get_log_metrics(last_);
+    return thread_.start(interval_ms_);
+}
+
+void LogMetricsReporter::stop() {
+    thread_.stop();
+}
+
+// logs what changed since the last report, at INFO
+void LogMetricsReporter::report() {
+    LogMetrics now;
+    get_log_metrics(now);
+
+    LogMetrics diff;
+    for (int i = 0; i < LOG_LEVEL_MAX; ++i) {
+        diff.records[i] = now.records[i] - last_.records[i];
+    }
+    diff.filtered = now.filtered - last_.filtered;
+    diff.writes = now.writes - last_.writes;
+    diff.bytes = now.bytes - last_.bytes;
+    diff.flushes = now.flushes - last_.flushes;
+    diff.rotations = now.rotations - last_.rotations;
+    diff.rotation_us = now.rotation_us - last_.rotation_us;
+    diff.lock_waits = now.lock_waits - last_.lock_waits;
+    diff.lock_wait_us = now.lock_wait_us - last_.lock_wait_us;
+    for (int i = 0; i < LOG_METRICS_HIST_BUCKETS; ++i) {
+        diff.write_us_hist[i] = now.write_us_hist[i] - last_.write_us_hist[i];
+        diff.flush_us_hist[i] = now.flush_us_hist[i] - last_.flush_us_hist[i];
+    }
+    last_ = now;
+
+    char line[512];
+    int n = snprintf(line, sizeof(line),
+            "[LOG METRICS] in %lu ms: records %llu/%llu/%llu/%llu (DEBUG/INFO/WARNING/ERROR), filtered %llu, "
+            "written %llu (%llu bytes), flushes %llu, rotations %llu (%llu us), lock waits %llu (%llu us)",
+            interval_ms_, diff.records[LOG_LEVEL_DEBUG], diff.records[LOG_LEVEL_INFO],
+            diff.records[LOG_LEVEL_WARNING], diff.records[LOG_LEVEL_ERROR], diff.filtered,
+            diff.writes, diff.bytes, diff.flushes, diff.rotations, diff.rotation_us,
+            diff.lock_waits, diff.lock_wait_us);
+
+    if (log_metrics_latency_on() && n > 0 && static_cast<size_t>(n) < sizeof(line)) {
+        snprintf(line + n, sizeof(line) - n,
+                ", write p50/p99 %llu/%llu us, flush p50/p99 %llu/%llu us",
+                get_log_latency_percentile(diff.write_us_hist, 50),
+                get_log_latency_percentile(diff.write_us_hist, 99),
+                get_log_latency_percentile(diff.flush_us_hist, 50),
+                get_log_latency_percentile(diff.flush_us_hist, 99));
+    }
+
+    LogSys::getInstance().log(line, strlen(line), LOG_LEVEL_INFO);
+}
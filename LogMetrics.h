@@ -0,0 +1,95 @@
+/*
+ * LogMetrics.h
+ *
+ *  Note:
+ *  The counters behind LOG_GET_METRICS. Every thread has its own, written
+ *  only by the thread itself with plain relaxed stores, so counting costs no
+ *  lock and no atomic read-modify-write; a snapshot sums up the threads, and
+ *  the counts of a thread that exits are kept.
+ *
+ *  The latencies of the writes and flushes cost two clock reads each, so
+ *  they are only taken with metrics_latency = 1. A wait for the lock of a
+ *  logger is timed only when the lock is found taken.
+ *
+ *  LogMetricsReporter logs the counters of the last interval as one line,
+ *  every metrics_interval_ms.
+ */
+
+#ifndef LOGMETRICS_H_
+#define LOGMETRICS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#include "common.h"
+#include "LogPeriodicThread.h"
+
+
+// the counters of one thread
+struct ThreadLogMetrics {
+    ThreadLogMetrics();
+
+    std::atomic<uint64_t> records[LOG_LEVEL_MAX];
+    std::atomic<uint64_t> filtered;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> writes;
+    std::atomic<uint64_t> flushes;
+    std::atomic<uint64_t> rotations;
+    std::atomic<uint64_t> rotation_ns;
+    std::atomic<uint64_t> lock_waits;
+    std::atomic<uint64_t> lock_wait_ns;
+    std::atomic<uint64_t> write_hist[LOG_METRICS_HIST_BUCKETS];
+    std::atomic<uint64_t> flush_hist[LOG_METRICS_HIST_BUCKETS];
+};
+
+// the counters of the calling thread
+ThreadLogMetrics& thread_log_metrics();
+
+// only the thread of the counter may add to it
+inline void add_log_metric(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// to the bucket of 'ns' in 'hist', see LogMetrics
+void add_log_latency(std::atomic<uint64_t>* hist, uint64_t ns);
+
+// CLOCK_MONOTONIC
+uint64_t log_metrics_now_ns();
+
+// metrics_latency
+bool log_metrics_latency_on();
+void set_log_metrics_latency(bool on);
+
+// the sum of all the threads, from the start of the process
+void get_log_metrics(LogMetrics& metrics);
+
+// the latency in us under which 'percent' of the ones in 'hist' are, as the
+// upper bound of its bucket; 0 if 'hist' is empty
+unsigned long long get_log_latency_percentile(const unsigned long long* hist, double percent);
+
+
+class LogMetricsReporter {
+public:
+    explicit LogMetricsReporter(unsigned long interval_ms);
+    virtual ~LogMetricsReporter();
+
+    bool start();
+    void stop();
+
+private:
+    // disabled methods
+    LogMetricsReporter(const LogMetricsReporter& rhs);
+    const LogMetricsReporter& operator=(const LogMetricsReporter& rhs);
+
+private:
+    void report();
+
+private:
+    unsigned long interval_ms_;
+    LogMetrics last_;   // at the last report
+
+    LogPeriodicThread thread_;
+};
+
+#endif /* LOGMETRICS_H_ */
@@ -0,0 +1,88 @@
+/*
+ * LogPeriodicThread.cpp
+ */
+
+#include <boost/bind/bind.hpp>
+#include "LogPeriodicThread.h"
+#include "common.h"
+
+
+using namespace std;
+
+
+LogPeriodicThread::LogPeriodicThread(const string& name, const boost::function<void ()>& task, bool last_at_stop):
+    name_(name),
+    task_(task),
+    last_at_stop_(last_at_stop),
+    interval_ms_(1),
+    running_(false) {
+}
+
+LogPeriodicThread::~LogPeriodicThread() {
+    stop();
+}
+
+bool LogPeriodicThread::start(unsigned long interval_ms) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (running_) {
+        LOG_TO_STDERR("The %s thread is already started!", name_.c_str());
+        assert(false);
+        return true;
+    }
+
+    interval_ms_ = interval_ms > 0 ? interval_ms : 1;
+
+    try {
+        thread_ = boost::thread(boost::bind(&LogPeriodicThread::run, this));
+    }
+    catch (const std::exception& e) {
+        LOG_TO_STDERR("Failed to start the %s thread: %s", name_.c_str(), e.what());
+        return false;
+    }
+
+    running_ = true;
+    return true;
+}
+
+void LogPeriodicThread::stop() {
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    cond_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void LogPeriodicThread::run() {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    const boost::posix_time::milliseconds interval(interval_ms_);
+    boost::system_time deadline = boost::get_system_time() + interval;
+
+    while (running_) {
+        if (cond_.timed_wait(lock, deadline) || boost::get_system_time() < deadline) {
+            continue;   // woken up, by stop() or spuriously
+        }
+
+        lock.unlock();
+        task_();
+        lock.lock();
+
+        deadline += interval;
+        if (deadline < boost::get_system_time()) {
+            deadline = boost::get_system_time() + interval;    // fell behind, skip
+        }
+    }
+
+    lock.unlock();
+    if (last_at_stop_) {
+        task_();
+    }
+}
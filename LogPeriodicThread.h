@@ -0,0 +1,54 @@
+/*
+ * LogPeriodicThread.h
+ *
+ *  Note:
+ *  A thread calling a task every interval, for LogFlusher and
+ *  LogMetricsReporter. The calls keep to the interval from start(): a slow
+ *  call doesn't push the next ones back, and calls missed behind a slower
+ *  one are skipped rather than made up in a row.
+ */
+
+#ifndef LOGPERIODICTHREAD_H_
+#define LOGPERIODICTHREAD_H_
+
+#include <string>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+
+class LogPeriodicThread {
+public:
+    // 'name' is for the errors; with 'last_at_stop' the task is called once
+    // more by stop()
+    LogPeriodicThread(const std::string& name, const boost::function<void ()>& task, bool last_at_stop);
+    virtual ~LogPeriodicThread();
+
+    // 'interval_ms' > 0
+    bool start(unsigned long interval_ms);
+
+    // waits for the thread to exit
+    void stop();
+
+private:
+    // disabled methods
+    LogPeriodicThread(const LogPeriodicThread& rhs);
+    const LogPeriodicThread& operator=(const LogPeriodicThread& rhs);
+
+private:
+    void run();
+
+private:
+    std::string name_;
+    boost::function<void ()> task_;
+    bool last_at_stop_;
+    unsigned long interval_ms_;
+
+    bool running_;
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    boost::thread thread_;
+};
+
+#endif /* LOGPERIODICTHREAD_H_ */
@@ -0,0 +1,66 @@
+/*
+ * LogRcu.cpp
+ */
+
+#include <stdint.h>
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#include "LogRcu.h"
+#include "LogThreadRegistry.h"
+
+
+using namespace std;
+
+
+namespace {
+
+struct RcuReader {
+    RcuReader(): depth(0) {
+        seq.store(0);
+    }
+
+    std::atomic<uint64_t> seq;      // odd while inside
+    unsigned long depth;            // of the nested sections, only for the thread itself
+};
+
+typedef LogThreadRegistry<RcuReader> RcuRegistry;
+
+} // namespace
+
+
+void log_rcu_read_lock() {
+    RcuReader& reader = RcuRegistry::local();
+    if (0 == reader.depth++) {
+        reader.seq.store(reader.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        // the store is seen before any pointer loaded inside, or
+        // log_rcu_synchronize() could miss the thread
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+void log_rcu_read_unlock() {
+    RcuReader& reader = RcuRegistry::local();
+    if (0 == --reader.depth) {
+        reader.seq.store(reader.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+}
+
+void log_rcu_synchronize() {
+    // the new pointers are published before the counters are read
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    boost::lock_guard<boost::mutex> lock(RcuRegistry::mutex());
+    const vector<RcuReader*>& readers = RcuRegistry::objects();
+
+    for (size_t i = 0; i < readers.size(); ++i) {
+        const uint64_t seq = readers[i]->seq.load(std::memory_order_acquire);
+        if (0 == seq % 2) {
+            continue;
+        }
+
+        // inside for one log, which may wait for room in the async queue
+        while (readers[i]->seq.load(std::memory_order_acquire) == seq) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+        }
+    }
+}
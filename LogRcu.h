@@ -0,0 +1,52 @@
+/*
+ * LogRcu.h
+ *
+ *  Note:
+ *  What a config reload swaps (the sinks, the settings of a logger) is read
+ *  by the logging threads without a lock, between log_rcu_read_lock() and
+ *  log_rcu_read_unlock(). The reload publishes the new one, waits in
+ *  log_rcu_synchronize() for every thread that may still use the old one to
+ *  leave, then frees it.
+ *
+ *  Every thread has a counter of its own, odd while it's inside: entering
+ *  and leaving are a store each, to a line of memory no other thread writes.
+ */
+
+#ifndef LOGRCU_H_
+#define LOGRCU_H_
+
+
+// may be nested
+void log_rcu_read_lock();
+void log_rcu_read_unlock();
+
+// waits until every thread inside when called has left; not to be called
+// from the inside
+void log_rcu_synchronize();
+
+
+// a read-side section for its scope, or nothing if 'on' is false
+class LogRcuReadGuard {
+public:
+    explicit LogRcuReadGuard(bool on): on_(on) {
+        if (on_) {
+            log_rcu_read_lock();
+        }
+    }
+
+    ~LogRcuReadGuard() {
+        if (on_) {
+            log_rcu_read_unlock();
+        }
+    }
+
+private:
+    // disabled methods
+    LogRcuReadGuard(const LogRcuReadGuard& rhs);
+    const LogRcuReadGuard& operator=(const LogRcuReadGuard& rhs);
+
+private:
+    const bool on_;
+};
+
+#endif /* LOGRCU_H_ */
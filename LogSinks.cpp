@@ -0,0 +1,317 @@
+/*
+ * LogSinks.cpp
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "LogSinks.h"
+#include "LogMetrics.h"
+
+
+using namespace std;
+
+
+void add_flush_stats(LogFlushStats& total, const LogFlushStats& one) {
+    total.flushes += one.flushes;
+    total.timer_flushes += one.timer_flushes;
+    total.fsyncs += one.fsyncs;
+    if (one.dirty_age_ms > total.dirty_age_ms) {
+        total.dirty_age_ms = one.dirty_age_ms;
+    }
+    if (one.max_dirty_age_ms > total.max_dirty_age_ms) {
+        total.max_dirty_age_ms = one.max_dirty_age_ms;
+    }
+}
+
+
+// the keys that can't change on an opened logger; see LogSinks::takeOver()
+static const char* const s_StructuralKeys[] = {
+    TEXT_LOG_DESTINATION,
+    TEXT_LOG_FILE_PATH,
+    TEXT_LOG_FILE_BASE_NAME,
+    TEXT_LOG_FILE_SUFFIX,
+    TEXT_LOG_FILE_BACKEND,
+    TEXT_LOG_FILE_BUFFER_SIZE,
+    TEXT_LOG_MMAP_CHUNK_SIZE,
+    TEXT_LOG_COMPRESS_ROTATED,
+    TEXT_LOG_COMPRESS_LEVEL,
+    TEXT_LOG_COMPRESS_CPU_PERCENT,
+};
+
+// true if a logger configured by 'lhs' can be reconfigured to 'rhs'
+static bool is_same_sink(const LogConfig& lhs, const LogConfig& rhs) {
+    for (size_t i = 0; i < sizeof(s_StructuralKeys) / sizeof(s_StructuralKeys[0]); ++i) {
+        string lhs_value, rhs_value;
+        const bool lhs_found = lhs.getString(s_StructuralKeys[i], lhs_value);
+        const bool rhs_found = rhs.getString(s_StructuralKeys[i], rhs_value);
+        if (lhs_found != rhs_found || lhs_value != rhs_value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+LogSinks::LogSinks():
+    need_thread_id_(false) {
+}
+
+LogSinks::~LogSinks() {
+}
+
+bool LogSinks::open(const LogConfig& conf) {
+    if (!loggers_.empty()) {
+        Assert(false, "The log sinks are already opened!");
+        return true;
+    }
+
+    return configure(conf) && takeOver(NULL);
+}
+
+bool LogSinks::open(const LogConfig& conf, const vector<string>& names) {
+    if (!loggers_.empty()) {
+        Assert(false, "The log sinks are already opened!");
+        return true;
+    }
+
+    return configure(conf, names) && takeOver(NULL);
+}
+
+bool LogSinks::configure(const LogConfig& conf) {
+    vector<string> names;
+    if (conf.getList(TEXT_LOG_SINKS, names)) {
+        return configure(conf, names);
+    }
+
+    boost::shared_ptr<Logger> logger = createLogger(conf);
+    if (!logger) {
+        return false;
+    }
+    loggers_.push_back(logger);
+    names_.push_back("");
+    own_levels_.push_back(false);
+    return true;
+}
+
+bool LogSinks::configure(const LogConfig& conf, const vector<string>& names) {
+    if (names.empty()) {
+        Assert(false, "No sink is given by 'sinks'!");
+        return false;
+    }
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        LOG_TO_STDERR("Configuring sink <%s>...", names[i].c_str());
+
+        boost::shared_ptr<Logger> logger = createLogger(conf.getSection(names[i]));
+        if (!logger) {
+            LOG_TO_STDERR("Failed to configure sink <%s>", names[i].c_str());
+            loggers_.clear();
+            names_.clear();
+            own_levels_.clear();
+            return false;
+        }
+        loggers_.push_back(logger);
+        names_.push_back(names[i]);
+
+        string level;
+        own_levels_.push_back(conf.getString(names[i] + "." + TEXT_LOG_LEVEL, level));
+    }
+
+    return true;
+}
+
+bool LogSinks::takeOver(const LogSinks* previous) {
+    vector<boost::shared_ptr<Logger> > olds(loggers_.size());
+    for (size_t i = 0; i < loggers_.size(); ++i) {
+        if (previous != NULL) {
+            olds[i] = previous->findLogger(names_[i]);
+        }
+    }
+
+    // the new sinks first, so that a failure leaves the old ones untouched
+    for (size_t i = 0; i < loggers_.size(); ++i) {
+        if (olds[i]) {
+            continue;
+        }
+
+        if (!names_[i].empty()) {
+            LOG_TO_STDERR("Opening sink <%s>...", names_[i].c_str());
+        }
+        if (!loggers_[i]->open()) {
+            LOG_TO_STDERR("Failed to open sink <%s>", getDisplayName(i));
+            for (size_t j = 0; j < i; ++j) {
+                if (!olds[j]) {
+                    loggers_[j]->close();
+                }
+            }
+            return false;
+        }
+    }
+
+    need_thread_id_ = false;
+    for (size_t i = 0; i < loggers_.size(); ++i) {
+        if (olds[i]) {
+            if (is_same_sink(olds[i]->getConfig(), loggers_[i]->getConfig())) {
+                LOG_TO_STDERR("Reconfiguring sink <%s>...", getDisplayName(i));
+                olds[i]->reconfig(loggers_[i]->getConfig());
+                loggers_[i] = olds[i];
+            }
+            else {
+                LOG_TO_STDERR("Replacing sink <%s>...", getDisplayName(i));
+                if (!olds[i]->retire(loggers_[i])) {
+                    loggers_[i] = olds[i];
+                }
+            }
+        }
+        need_thread_id_ = need_thread_id_ || loggers_[i]->needThreadId();
+    }
+
+    return true;
+}
+
+void LogSinks::closeAllBut(const LogSinks* kept) {
+    for (size_t i = 0; i < loggers_.size(); ++i) {
+        if (NULL == kept || std::find(kept->loggers_.begin(), kept->loggers_.end(), loggers_[i])
+                == kept->loggers_.end()) {
+            loggers_[i]->close();
+        }
+    }
+}
+
+void LogSinks::reclaim() {
+    for (size_t i = 0; i < loggers_.size(); ++i) {
+        loggers_[i]->reclaim();
+    }
+}
+
+// created and configured, NULL on failure
+boost::shared_ptr<Logger> LogSinks::createLogger(const LogConfig& conf) {
+    unsigned long dest = static_cast<unsigned long>(LOG_DEFAULT_LOG_DEST);
+    conf.getUnsigned(TEXT_LOG_DESTINATION, dest);
+
+    boost::shared_ptr<Logger> logger;
+    try {
+        logger = Logger::createLoggerInterface(ENUM_LOG_TYPE(dest));
+    }
+    catch (const std::exception& e) {
+        LOG_TO_STDERR("Exception: %s, log_dest: %lu", e.what(), dest);
+    }
+
+    if (NULL == logger) {
+        LOG_TO_STDERR("Failed to create the logger interface!");
+        return boost::shared_ptr<Logger>();
+    }
+
+    if (!logger->config(conf)) {
+        LOG_TO_STDERR("Failed to config the log system");
+        return boost::shared_ptr<Logger>();
+    }
+
+    return logger;
+}
+
+// for the messages
+const char* LogSinks::getDisplayName(size_t index) const {
+    return names_[index].empty() ? "default" : names_[index].c_str();
+}
+
+// NULL if there's none
+boost::shared_ptr<Logger> LogSinks::findLogger(const std::string& name) const {
+    for (size_t i = 0; i < names_.size(); ++i) {
+        if (names_[i] == name) {
+            return loggers_[i];
+        }
+    }
+    return boost::shared_ptr<Logger>();
+}
+
+bool LogSinks::log(const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level,
+        const struct timeval& when, bool check_level, pid_t tid) {
+    // the final text, reused by every log of the thread
+    static thread_local string line;
+    const Logger* formatted_by = NULL;     // 'line' is made by it
+    uint64_t msg_hash = 0;
+    bool hashed = false;
+    bool taken = false;
+    bool logged = false;
+
+    for (size_t i = 0; i < loggers_.size(); ++i) {
+        Logger& logger = *loggers_[i];
+        if (check_level && level < logger.getLevel()) {
+            continue;
+        }
+        taken = true;
+
+        if (NULL == formatted_by || !logger.sameLayout(*formatted_by)) {
+            logger.formatLine(line, msg, len, text_len, level, when, tid);
+            formatted_by = &logger;
+        }
+
+        if (logger.needMsgHash() && !hashed) {
+            msg_hash = hash_log_msg(msg, len, text_len);
+            hashed = true;
+        }
+
+        if (logger.logLine(line.data(), line.size(), level, when, msg_hash)) {
+            logged = true;
+        }
+    }
+
+    if (!taken) {
+        add_log_metric(thread_log_metrics().filtered, 1);
+    }
+    return logged;
+}
+
+ENUM_LOG_LEVEL LogSinks::getLevel() const {
+    ENUM_LOG_LEVEL lowest = LOG_LEVEL_MAX;
+
+    for (size_t i = 0; i < loggers_.size(); ++i) {
+        if (loggers_[i]->getLevel() < lowest) {
+            lowest = loggers_[i]->getLevel();
+        }
+    }
+
+    return lowest;
+}
+
+void LogSinks::setLevel(ENUM_LOG_LEVEL level) {
+    for (size_t i = 0; i < loggers_.size(); ++i) {
+        if (!own_levels_[i]) {
+            loggers_[i]->setLevel(level);
+        }
+    }
+}
+
+bool LogSinks::setLevel(const string& name, ENUM_LOG_LEVEL level) {
+    boost::shared_ptr<Logger> logger = findLogger(name);
+    if (!logger) {
+        return false;
+    }
+
+    logger->setLevel(level);
+    return true;
+}
+
+bool LogSinks::needThreadId() const {
+    return need_thread_id_;
+}
+
+const boost::shared_ptr<Logger>& LogSinks::getFirst() const {
+    Assert(!loggers_.empty(), "No sink is opened!");
+    return loggers_.front();
+}
+
+void LogSinks::flushPending(bool sync) {
+    for (size_t i = 0; i < loggers_.size(); ++i) {
+        loggers_[i]->flushPending(sync);
+    }
+}
+
+void LogSinks::getFlushStats(LogFlushStats& stats) {
+    for (size_t i = 0; i < loggers_.size(); ++i) {
+        LogFlushStats one;
+        loggers_[i]->getFlushStats(one);
+        add_flush_stats(stats, one);
+    }
+}
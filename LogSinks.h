@@ -0,0 +1,112 @@
+/*
+ * LogSinks.h
+ *
+ *  Note:
+ *  The loggers a log goes to, e.g. the ERRORs to stderr and everything to a
+ *  rolling file:
+ *
+ *      sinks = console, main
+ *      console.log_dest = 0
+ *      console.log_level = 3
+ *      main.log_dest = 2
+ *      main.num_logs_to_flush = 100
+ *
+ *  Every sink is configured by the keys of its section, "<name>.<key>", on
+ *  top of the keys out of any section; without 'sinks' there is one logger
+ *  configured by the keys out of any section.
+ *
+ *  A log is formatted once and the same bytes are given to every sink that
+ *  takes its level; it's only formatted again for a sink with another
+ *  time_precision, log_format or log_pattern.
+ *
+ *  On a config reload, a sink of the same name whose log_dest and file keys
+ *  (file_path, file_backend, compress_rotated ...) are the same is kept, and
+ *  only gets the new level, flush policy, layout and rotation; any other
+ *  change makes a new logger, opened once the old one is closed.
+ */
+
+#ifndef LOGSINKS_H_
+#define LOGSINKS_H_
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "log_config.h"
+#include "Logger.h"
+
+
+// the counts are summed up, the ages are the largest
+void add_flush_stats(LogFlushStats& total, const LogFlushStats& one);
+
+
+class LogSinks {
+public:
+    LogSinks();
+    virtual ~LogSinks();
+
+    // creates, configures and opens the sinks
+    bool open(const LogConfig& conf);
+    // the sinks of the sections 'names' of 'conf'
+    bool open(const LogConfig& conf, const std::vector<std::string>& names);
+
+    // config reload, in two steps so that nothing is changed unless the
+    // whole config is good:
+    // creates and configures the sinks, not opened yet
+    bool configure(const LogConfig& conf);
+    bool configure(const LogConfig& conf, const std::vector<std::string>& names);
+    // opens them in place of the ones of 'previous' (may be NULL): a sink
+    // kept is reconfigured (Logger::reconfig), a changed one is retired in
+    // favour of the new one (Logger::retire)
+    bool takeOver(const LogSinks* previous);
+    // closes the sinks not also in 'kept' (may be NULL), once no log can
+    // reach them
+    void closeAllBut(const LogSinks* kept);
+    // see Logger::reclaim()
+    void reclaim();
+
+    // the first 'text_len' bytes of 'msg' are its text, the rest its fields
+    // (see LOG_OUT). 'check_level' false: every sink takes the log whatever
+    // its level, for a category with a level of its own. 'tid' is the thread
+    // that made the log, 0 for the calling one
+    bool log(const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level, const struct timeval& when,
+            bool check_level = true, pid_t tid = 0);
+
+    // the lowest level of the sinks: what's under it is dropped by all
+    ENUM_LOG_LEVEL getLevel() const;
+    // sets the level of the sinks without a "<name>.log_level" of their own,
+    // which take log_level; the level of the others is kept, so that the
+    // logs still go where the config routes them
+    void setLevel(ENUM_LOG_LEVEL level);
+    // sets the level of the sink 'name'; false if there's none
+    bool setLevel(const std::string& name, ENUM_LOG_LEVEL level);
+
+    // true if a sink writes the id of the thread that made a log; a log
+    // written on another thread must then be given it
+    bool needThreadId() const;
+
+    // the first sink, whose num_logs_to_flush and time_precision the binary
+    // mode takes
+    const boost::shared_ptr<Logger>& getFirst() const;
+
+    void flushPending(bool sync);
+    // adds the stats of the sinks to 'stats', see add_flush_stats()
+    void getFlushStats(LogFlushStats& stats);
+
+private:
+    // disabled methods
+    LogSinks(const LogSinks& rhs);
+    const LogSinks& operator=(const LogSinks& rhs);
+
+private:
+    static boost::shared_ptr<Logger> createLogger(const LogConfig& conf);
+    boost::shared_ptr<Logger> findLogger(const std::string& name) const;
+    const char* getDisplayName(size_t index) const;
+
+private:
+    std::vector<boost::shared_ptr<Logger> > loggers_;
+    std::vector<std::string> names_;    // of loggers_, "" without 'sinks'
+    std::vector<bool> own_levels_;      // of loggers_, "<name>.log_level" is set
+    bool need_thread_id_;
+};
+
+#endif /* LOGSINKS_H_ */
@@ -5,7 +5,12 @@
  *      Author: xieliang
  */
 
+#include <string.h>
+#include <stdlib.h>
+#include <boost/bind/bind.hpp>
 #include "LogSys.h"
+#include "LogRcu.h"
+#include "LogCrashHandler.h"
 #include "allyes-log.h"
 #include "common.h"
 
@@ -20,13 +25,82 @@ LogSys& LogSys::getInstance() {
     return the_one;
 }
 
-LogSys::LogSys() {
+// the keys a config reload doesn't apply
+static const char* const s_RestartKeys[] = {
+    TEXT_LOG_ASYNC,
+    TEXT_LOG_ASYNC_QUEUE_SIZE,
+    TEXT_LOG_ASYNC_QUEUE_BYTES,
+    TEXT_LOG_ASYNC_OVERFLOW,
+    TEXT_LOG_ASYNC_BLOCK_TIMEOUT_MS,
+    TEXT_LOG_BINARY,
+    TEXT_LOG_CONFIG_RELOAD,
+    TEXT_LOG_CRASH_HANDLER,
+};
+
+
+LogSys::LogSys():
+    active_sinks_(NULL),
+    reloadable_(false) {
 }
 
 LogSys::~LogSys() {
-    if(logger_) {
-        logger_.reset();
+    // no reload from now on
+    if(watcher_) {
+        watcher_->stop();
+        watcher_.reset();
+    }
+
+    if(metrics_reporter_) {
+        metrics_reporter_->stop();
+        metrics_reporter_.reset();
+    }
+
+    if(flusher_) {
+        flusher_->stop();
+        flusher_.reset();
+    }
+
+    if(binary_writer_) {
+        g_LogBinaryMode.store(false);
+        binary_writer_->close();
+        binary_writer_.reset();
+    }
+
+    // write all the queued records before the logger goes away
+    if(async_writer_) {
+        async_writer_->stop();
+
+        LogQueueStats stats;
+        async_writer_->getStats(stats);
+        if (stats.blocked > 0 || stats.dropped_newest > 0 || stats.dropped_lowest_level > 0
+                || stats.dropped_timeout > 0) {
+            LOG_TO_STDERR("Async queue full: %llu logs waited, dropped %llu newest, %llu lowest level, "
+                    "%llu timed out; max queued bytes: %llu", stats.blocked, stats.dropped_newest,
+                    stats.dropped_lowest_level, stats.dropped_timeout, stats.max_queued_bytes);
+        }
+        async_writer_.reset();
+    }
+
+    if(sinks_) {
+        LogFlushStats stats;
+        getFlushStats(stats);
+        LOG_TO_STDERR("Flushes: %llu (%llu by the timer), fsyncs: %llu, max dirty age: %lu ms",
+                stats.flushes, stats.timer_flushes, stats.fsyncs, stats.max_dirty_age_ms);
     }
+
+    // the handles may outlive the sinks
+    {
+        boost::lock_guard<boost::mutex> lock(category_mutex_);
+        for (std::map<string, boost::shared_ptr<LogCategory> >::iterator it = categories_.begin();
+                it != categories_.end(); ++it) {
+            it->second->sinks_.store(NULL);
+        }
+        category_sinks_.clear();
+        active_sinks_.store(NULL);
+    }
+    sinks_.reset();
+
+    uninstall_log_crash_handler();
 }
 
 bool LogSys::initialize(const string& config_file) {
@@ -44,37 +118,572 @@ bool LogSys::initialize(const string& config_file) {
         }
     }
 
-    unsigned long dest = static_cast<unsigned long>(LOG_DEFAULT_LOG_DEST);
-    config.getUnsigned(TEXT_LOG_DESTINATION, dest);
+    unsigned long config_reload = LOG_DEFAULT_CONFIG_RELOAD;
+    config.getUnsigned(TEXT_LOG_CONFIG_RELOAD, config_reload);
+    reloadable_ = config_reload != 0 && !config_file.empty();
+
+    sinks_ = boost::shared_ptr<LogSinks>(new LogSinks());
+    if (!sinks_->open(config)) {
+        sinks_.reset();
+        return false;
+    }
+    active_sinks_.store(sinks_.get(), std::memory_order_release);
+
+    std::map<string, ENUM_LOG_LEVEL> category_levels;
+    std::map<string, boost::shared_ptr<LogSinks> > category_sinks;
+    if (!configureCategories(config, category_levels, category_sinks)) {
+        return false;
+    }
+    for (std::map<string, boost::shared_ptr<LogSinks> >::const_iterator it = category_sinks.begin();
+            it != category_sinks.end(); ++it) {
+        if (!it->second->takeOver(NULL)) {
+            LOG_TO_STDERR("Failed to open the sinks of category <%s>", it->first.c_str());
+            return false;
+        }
+    }
+    {
+        boost::lock_guard<boost::mutex> lock(category_mutex_);
+        category_levels_ = category_levels;
+        category_sinks_ = category_sinks;
+    }
+
+    unsigned long async = LOG_DEFAULT_ASYNC;
+    config.getUnsigned(TEXT_LOG_ASYNC, async);
+
+    if (async) {
+        unsigned long queue_size = LOG_DEFAULT_ASYNC_QUEUE_SIZE;
+        config.getUnsigned(TEXT_LOG_ASYNC_QUEUE_SIZE, queue_size);
+
+        unsigned long queue_bytes = LOG_DEFAULT_ASYNC_QUEUE_BYTES;
+        config.getUnsigned(TEXT_LOG_ASYNC_QUEUE_BYTES, queue_bytes);
+
+        ENUM_LOG_OVERFLOW_POLICY policy = LOG_DEFAULT_ASYNC_OVERFLOW;
+        string overflow;
+        if (config.getString(TEXT_LOG_ASYNC_OVERFLOW, overflow)) {
+            if ("block" == overflow) {
+                policy = OVERFLOW_BLOCK;
+            }
+            else if ("drop_newest" == overflow) {
+                policy = OVERFLOW_DROP_NEWEST;
+            }
+            else if ("drop_lowest_level_first" == overflow) {
+                policy = OVERFLOW_DROP_LOWEST_LEVEL;
+            }
+            else if ("block_with_timeout" == overflow) {
+                policy = OVERFLOW_BLOCK_WITH_TIMEOUT;
+            }
+            else {
+                Assert(false, "async_overflow must be 'block', 'drop_newest', 'drop_lowest_level_first' "
+                        "or 'block_with_timeout'!");
+                return false;
+            }
+        }
+
+        unsigned long block_timeout_ms = LOG_DEFAULT_ASYNC_BLOCK_TIMEOUT_MS;
+        config.getUnsigned(TEXT_LOG_ASYNC_BLOCK_TIMEOUT_MS, block_timeout_ms);
+
+        async_writer_ = boost::shared_ptr<AsyncLogWriter>(new AsyncLogWriter(sinks_, queue_size,
+                queue_bytes, policy, block_timeout_ms));
+        if (!async_writer_->start()) {
+            LOG_TO_STDERR("Failed to start the async log writer");
+            async_writer_.reset();
+            return false;
+        }
+        LOG_TO_STDERR("Async logging on, async_queue_size: %lu, async_queue_bytes: %lu, async_overflow: %s",
+                queue_size, queue_bytes, overflow.empty() ? "block" : overflow.c_str());
+    }
+
+    unsigned long binary = LOG_DEFAULT_BINARY;
+    config.getUnsigned(TEXT_LOG_BINARY, binary);
+
+    if (binary) {
+        string path = LOG_DEFAULT_FILE_PATH;
+        string base_name = LOG_DEFAULT_FILE_BASENAME;
+        config.getString(TEXT_LOG_FILE_PATH, path);
+        config.getString(TEXT_LOG_FILE_BASE_NAME, base_name);
 
-    logger_ = Logger::createLoggerInterface(ENUM_LOG_TYPE(dest));
-    if (NULL == logger_) {
-        LOG_TO_STDERR("Failed to create the logger interface!");
+        string file_name(path);
+        if (!file_name.empty() && file_name[file_name.size() - 1] != '/') {
+            file_name += "/";
+        }
+        file_name += base_name + LOG_BINARY_FILE_SUFFIX;
+
+        binary_writer_ = boost::shared_ptr<BinaryLogWriter>(
+                new BinaryLogWriter(file_name, sinks_->getFirst()->getMaxFlushNum(),
+                        sinks_->getFirst()->getTimePrecision()));
+        if (!binary_writer_->open()) {
+            LOG_TO_STDERR("Failed to open the binary log file");
+            binary_writer_.reset();
+            return false;
+        }
+
+        g_LogBinaryMode.store(true);
+        LOG_TO_STDERR("Binary logging on, use allyes-log-decode to read <%s>", file_name.c_str());
+    }
+
+    if (!startFlusher(config)) {
         return false;
     }
 
-    if (!logger_->config(config)) {
-        LOG_TO_STDERR("Failed to config the log system");
+    g_LogLevelGate.store(sinks_->getLevel(), std::memory_order_relaxed);
+    resolveCategories();
+
+    if (!startMetricsReporter(config)) {
         return false;
     }
 
-    if (!logger_->open()) {
-        LOG_TO_STDERR("Failed to open the log system");
+    unsigned long crash_handler = LOG_DEFAULT_CRASH_HANDLER;
+    config.getUnsigned(TEXT_LOG_CRASH_HANDLER, crash_handler);
+    if (crash_handler && !install_log_crash_handler()) {
         return false;
     }
 
+    config_file_ = config_file;
+    config_ = config;
+    if (reloadable_) {
+        watcher_ = boost::shared_ptr<LogConfigWatcher>(
+                new LogConfigWatcher(config_file, boost::bind(&LogSys::reload, this)));
+        if (!watcher_->start()) {
+            watcher_.reset();
+            return false;
+        }
+    }
+
     LOG_TO_STDERR("Log system initialized OK!");
     return true;
 }
 
+// the new sinks are opened in place of the old ones, and swapped in; the
+// old ones are closed once no log can reach them any more
+bool LogSys::reload() {
+    boost::lock_guard<boost::mutex> reload_lock(reload_mutex_);
+
+    LOG_TO_STDERR("Reloading the log config <%s>...", config_file_.c_str());
+
+    LogConfig config;
+    if (!config.parseConfig(config_file_)) {
+        LOG_TO_STDERR("Errors happened when read the log config file, the running config is kept!");
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(s_RestartKeys) / sizeof(s_RestartKeys[0]); ++i) {
+        string old_value, new_value;
+        if (config_.getString(s_RestartKeys[i], old_value) != config.getString(s_RestartKeys[i], new_value)
+                || old_value != new_value) {
+            LOG_TO_STDERR("<%s> is changed, which takes effect after a restart", s_RestartKeys[i]);
+        }
+    }
+
+    // all configured before anything is changed
+    boost::shared_ptr<LogSinks> sinks(new LogSinks());
+    std::map<string, ENUM_LOG_LEVEL> category_levels;
+    std::map<string, boost::shared_ptr<LogSinks> > category_sinks;
+    if (!sinks->configure(config) || !configureCategories(config, category_levels, category_sinks)) {
+        LOG_TO_STDERR("Bad log config, the running config is kept!");
+        return false;
+    }
+
+    if (!sinks->takeOver(sinks_.get())) {
+        LOG_TO_STDERR("Failed to open the new sinks, the running config is kept!");
+        return false;
+    }
+
+    for (std::map<string, boost::shared_ptr<LogSinks> >::iterator it = category_sinks.begin();
+            it != category_sinks.end(); ) {
+        std::map<string, boost::shared_ptr<LogSinks> >::const_iterator old = category_sinks_.find(it->first);
+        const LogSinks* previous = old != category_sinks_.end() ? old->second.get() : NULL;
+        if (it->second->takeOver(previous)) {
+            ++it;
+            continue;
+        }
+
+        LOG_TO_STDERR("Failed to open the new sinks of category <%s>, the old ones are kept", it->first.c_str());
+        if (previous != NULL) {
+            it->second = old->second;
+            ++it;
+        }
+        else {
+            category_sinks.erase(it++);
+        }
+    }
+
+    // swap them in
+    boost::shared_ptr<LogSinks> old_sinks = sinks_;
+    std::map<string, boost::shared_ptr<LogSinks> > old_category_sinks = category_sinks_;
+    {
+        boost::lock_guard<boost::mutex> lock(category_mutex_);
+        sinks_ = sinks;
+        category_sinks_ = category_sinks;
+        category_levels_ = category_levels;
+        active_sinks_.store(sinks_.get(), std::memory_order_release);
+    }
+    g_LogLevelGate.store(sinks_->getLevel(), std::memory_order_relaxed);
+    resolveCategories();
+
+    // the threads still on the old sinks leave, and what they have queued is
+    // written; then the timer is moved to the new ones
+    log_rcu_synchronize();
+    if (async_writer_) {
+        async_writer_->waitWritten();
+    }
+
+    if (flusher_) {
+        flusher_->stop();
+        flusher_.reset();
+    }
+    if (!startFlusher(config)) {
+        LOG_TO_STDERR("Failed to start the log flusher, no flush_interval_ms until the next reload!");
+    }
+
+    old_sinks->closeAllBut(sinks_.get());
+    for (std::map<string, boost::shared_ptr<LogSinks> >::const_iterator it = old_category_sinks.begin();
+            it != old_category_sinks.end(); ++it) {
+        std::map<string, boost::shared_ptr<LogSinks> >::const_iterator kept = category_sinks_.find(it->first);
+        it->second->closeAllBut(kept != category_sinks_.end() ? kept->second.get() : NULL);
+    }
+
+    const std::vector<boost::shared_ptr<LogSinks> > all = getAllSinks();
+    for (size_t i = 0; i < all.size(); ++i) {
+        all[i]->reclaim();
+    }
+
+    // the reporter is started again only for a new metrics_interval_ms
+    unsigned long old_interval_ms = LOG_DEFAULT_METRICS_INTERVAL_MS;
+    unsigned long new_interval_ms = LOG_DEFAULT_METRICS_INTERVAL_MS;
+    config_.getUnsigned(TEXT_LOG_METRICS_INTERVAL_MS, old_interval_ms);
+    config.getUnsigned(TEXT_LOG_METRICS_INTERVAL_MS, new_interval_ms);
+    if (new_interval_ms != old_interval_ms && metrics_reporter_) {
+        metrics_reporter_->stop();
+        metrics_reporter_.reset();
+    }
+    if (!startMetricsReporter(config)) {
+        LOG_TO_STDERR("Failed to start the log metrics reporter, no metrics_interval_ms until the next reload!");
+    }
+
+    config_ = config;
+    LOG_TO_STDERR("Log config reloaded OK!");
+    return true;
+}
+
+// not NULL only when 'flush_interval_ms' is set
+bool LogSys::startFlusher(const LogConfig& config) {
+    unsigned long flush_interval_ms = LOG_DEFAULT_FLUSH_INTERVAL_MS;
+    config.getUnsigned(TEXT_LOG_FLUSH_INTERVAL_MS, flush_interval_ms);
+
+    if (flush_interval_ms > 0) {
+        unsigned long flush_fsync = LOG_DEFAULT_FLUSH_FSYNC;
+        config.getUnsigned(TEXT_LOG_FLUSH_FSYNC, flush_fsync);
+
+        flusher_ = boost::shared_ptr<LogFlusher>(
+                new LogFlusher(getAllSinks(), binary_writer_, flush_interval_ms, flush_fsync != 0));
+        if (!flusher_->start()) {
+            flusher_.reset();
+            return false;
+        }
+        LOG_TO_STDERR("flush_interval_ms: %lu, flush_fsync: %lu", flush_interval_ms, flush_fsync);
+    }
+
+    return true;
+}
+
+// metrics_latency, and the reporter of metrics_interval_ms if it's not
+// running yet
+bool LogSys::startMetricsReporter(const LogConfig& config) {
+    unsigned long metrics_latency = LOG_DEFAULT_METRICS_LATENCY;
+    config.getUnsigned(TEXT_LOG_METRICS_LATENCY, metrics_latency);
+    set_log_metrics_latency(metrics_latency != 0);
+
+    unsigned long metrics_interval_ms = LOG_DEFAULT_METRICS_INTERVAL_MS;
+    config.getUnsigned(TEXT_LOG_METRICS_INTERVAL_MS, metrics_interval_ms);
+
+    if (metrics_interval_ms > 0 && !metrics_reporter_) {
+        metrics_reporter_ = boost::shared_ptr<LogMetricsReporter>(new LogMetricsReporter(metrics_interval_ms));
+        if (!metrics_reporter_->start()) {
+            metrics_reporter_.reset();
+            return false;
+        }
+    }
+    LOG_TO_STDERR("metrics_latency: %lu, metrics_interval_ms: %lu", metrics_latency, metrics_interval_ms);
+
+    return true;
+}
+
+// category_level.<name> and category_sinks.<name>; the sinks are configured,
+// not opened, see LogSinks::takeOver()
+bool LogSys::configureCategories(const LogConfig& config, std::map<std::string, ENUM_LOG_LEVEL>& levels,
+        std::map<std::string, boost::shared_ptr<LogSinks> >& sinks_by_name) {
+    map<string, string> values;
+    config.getPrefixed(TEXT_LOG_CATEGORY_LEVEL, values);
+    for (map<string, string>::const_iterator it = values.begin(); it != values.end(); ++it) {
+        const unsigned long num = strtoul(it->second.c_str(), NULL, 0);
+        if (num >= static_cast<unsigned long>(LOG_LEVEL_MAX)) {
+            Assert(false, "Log level of category out of range!");
+            return false;
+        }
+        levels[it->first] = static_cast<ENUM_LOG_LEVEL>(num);
+        LOG_TO_STDERR("Level of category <%s>: %s", it->first.c_str(), get_log_level_txt(levels[it->first]));
+    }
+
+    config.getPrefixed(TEXT_LOG_CATEGORY_SINKS, values);
+    for (map<string, string>::const_iterator it = values.begin(); it != values.end(); ++it) {
+        vector<string> names;
+        config.getList(string(TEXT_LOG_CATEGORY_SINKS) + "." + it->first, names);
+
+        LOG_TO_STDERR("Configuring the sinks of category <%s>: %s", it->first.c_str(), it->second.c_str());
+        boost::shared_ptr<LogSinks> sinks(new LogSinks());
+        if (!sinks->configure(config, names)) {
+            LOG_TO_STDERR("Failed to configure the sinks of category <%s>", it->first.c_str());
+            return false;
+        }
+        sinks_by_name[it->first] = sinks;
+    }
+
+    return true;
+}
+
+// the level and the sinks of the longest name configured among the category
+// and the ones above it, "net.http", then "net"; called with category_mutex_
+void LogSys::resolveCategory(LogCategory& category) const {
+    bool level_found = false;
+    ENUM_LOG_LEVEL level = LOG_LEVEL_DEBUG;
+    bool sinks_found = false;
+    LogSinks* sinks = NULL;
+
+    string name = category.name_;
+    for (;;) {
+        if (!level_found) {
+            std::map<string, ENUM_LOG_LEVEL>::const_iterator it = category_levels_.find(name);
+            if (it != category_levels_.end()) {
+                level = it->second;
+                level_found = true;
+            }
+        }
+        if (!sinks_found) {
+            std::map<string, boost::shared_ptr<LogSinks> >::const_iterator it = category_sinks_.find(name);
+            if (it != category_sinks_.end()) {
+                sinks = it->second.get();
+                sinks_found = true;
+            }
+        }
+
+        const string::size_type dot = name.rfind('.');
+        if ((level_found && sinks_found) || string::npos == dot) {
+            break;
+        }
+        name.erase(dot);
+    }
+
+    // else the level of the sinks, everything before LOG_SYS_INIT
+    if (!level_found) {
+        if (sinks != NULL) {
+            level = sinks->getLevel();
+        }
+        else if (sinks_) {
+            level = sinks_->getLevel();
+        }
+    }
+
+    category.sinks_.store(sinks);
+    category.own_level_.store(level_found);
+    category.level_.store(level, std::memory_order_relaxed);
+}
+
+void LogSys::resolveCategories() {
+    boost::lock_guard<boost::mutex> lock(category_mutex_);
+
+    for (std::map<string, boost::shared_ptr<LogCategory> >::iterator it = categories_.begin();
+            it != categories_.end(); ++it) {
+        resolveCategory(*it->second);
+    }
+}
+
+std::vector<boost::shared_ptr<LogSinks> > LogSys::getAllSinks() const {
+    std::vector<boost::shared_ptr<LogSinks> > all;
+
+    if (sinks_) {
+        all.push_back(sinks_);
+    }
+    for (std::map<string, boost::shared_ptr<LogSinks> >::const_iterator it = category_sinks_.begin();
+            it != category_sinks_.end(); ++it) {
+        all.push_back(it->second);
+    }
+
+    return all;
+}
+
 void LogSys::log(const string& msg, ENUM_LOG_LEVEL level) {
-    if(logger_) {
-        logger_->log(msg, level);
+    log(msg.data(), msg.size(), level);
+}
+
+void LogSys::log(const char* msg, size_t len, ENUM_LOG_LEVEL level) {
+    log(msg, len, len, level);
+}
+
+void LogSys::log(const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level) {
+    ThreadLogMetrics& metrics = thread_log_metrics();
+    add_log_metric(metrics.records[level], 1);
+
+    // the sinks may be swapped by reload() meanwhile
+    LogRcuReadGuard guard(reloadable_);
+    LogSinks* sinks = active_sinks_.load(std::memory_order_acquire);
+
+    if(binary_writer_) {
+        if(sinks != NULL && level >= sinks->getLevel()) {
+            binary_writer_->writeText(msg, len, text_len, level);
+        }
+        else {
+            add_log_metric(metrics.filtered, 1);
+        }
+    }
+    else if(async_writer_) {
+        // don't queue what every sink will drop anyway
+        if(sinks != NULL && level >= sinks->getLevel()) {
+            async_writer_->push(msg, len, text_len, level, sinks);
+        }
+        else {
+            add_log_metric(metrics.filtered, 1);
+        }
+    }
+    else if(sinks != NULL) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        sinks->log(msg, len, text_len, level, now);
+    }
+}
+
+void LogSys::log(const LogCategory* category, const char* msg, size_t len, ENUM_LOG_LEVEL level) {
+    add_log_metric(thread_log_metrics().records[level], 1);
+
+    // its level is checked already; the sinks may be swapped by reload()
+    LogRcuReadGuard guard(reloadable_);
+    LogSinks* sinks = category->sinks_.load(std::memory_order_acquire);
+    if (NULL == sinks) {
+        sinks = active_sinks_.load(std::memory_order_acquire);
+    }
+    const bool check_level = !category->own_level_.load(std::memory_order_relaxed);
+
+    if(binary_writer_) {
+        binary_writer_->writeText(msg, len, len, level);
+    }
+    else if(async_writer_) {
+        async_writer_->push(msg, len, len, level, sinks, check_level);
+    }
+    else if(sinks != NULL) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        sinks->log(msg, len, len, level, now, check_level);
     }
 }
 
 void LogSys::setLevel(ENUM_LOG_LEVEL level) {
-    if(logger_) {
-        logger_->setLevel(level);
+    boost::lock_guard<boost::mutex> reload_lock(reload_mutex_);
+
+    if(sinks_) {
+        sinks_->setLevel(level);
+        g_LogLevelGate.store(sinks_->getLevel(), std::memory_order_relaxed);
+        resolveCategories();
+    }
+}
+
+bool LogSys::setSinkLevel(const string& name, ENUM_LOG_LEVEL level) {
+    if (level >= LOG_LEVEL_MAX) {
+        Assert(false, "Invalid log level!");
+        return false;
+    }
+
+    boost::lock_guard<boost::mutex> reload_lock(reload_mutex_);
+
+    // the same name may be used by 'sinks' and by a category
+    bool found = false;
+    const std::vector<boost::shared_ptr<LogSinks> > all = getAllSinks();
+    for (size_t i = 0; i < all.size(); ++i) {
+        if (all[i]->setLevel(name, level)) {
+            found = true;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+    g_LogLevelGate.store(sinks_->getLevel(), std::memory_order_relaxed);
+    resolveCategories();
+
+    LOG_TO_STDERR("Level of sink <%s> has been reset to: %s", name.c_str(), get_log_level_txt(level));
+    return true;
+}
+
+LogCategory* LogSys::getCategory(const string& name) {
+    boost::lock_guard<boost::mutex> lock(category_mutex_);
+
+    boost::shared_ptr<LogCategory>& category = categories_[name];
+    if (!category) {
+        category = boost::shared_ptr<LogCategory>(new LogCategory(name));
+        resolveCategory(*category);
+    }
+
+    return category.get();
+}
+
+void LogSys::setCategoryLevel(const string& name, ENUM_LOG_LEVEL level) {
+    if (level >= LOG_LEVEL_MAX) {
+        Assert(false, "Invalid log level!");
+        return;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(category_mutex_);
+        category_levels_[name] = level;
+    }
+    resolveCategories();
+
+    LOG_TO_STDERR("Level of category <%s> has been reset to: %s", name.c_str(), get_log_level_txt(level));
+}
+
+bool LogSys::getFlushStats(LogFlushStats& stats) {
+    boost::lock_guard<boost::mutex> reload_lock(reload_mutex_);
+
+    if(!sinks_) {
+        return false;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    const std::vector<boost::shared_ptr<LogSinks> > all = getAllSinks();
+    for (size_t i = 0; i < all.size(); ++i) {
+        all[i]->getFlushStats(stats);
+    }
+    return true;
+}
+
+bool LogSys::getMetrics(LogMetrics& metrics) {
+    if(NULL == active_sinks_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    get_log_metrics(metrics);
+    return true;
+}
+
+bool LogSys::getQueueStats(LogQueueStats& stats) {
+    if(!async_writer_) {
+        return false;
+    }
+
+    async_writer_->getStats(stats);
+    return true;
+}
+
+unsigned int LogSys::registerBinaryFormat(const char* format) {
+    const unsigned int id = BinaryLogWriter::registerFormat(format);
+
+    if(binary_writer_) {
+        binary_writer_->writeFormat(id, format);
+    }
+
+    return id;
+}
+
+void LogSys::logBinary(const char* record, size_t len) {
+    if(binary_writer_) {
+        binary_writer_->write(record, len);
     }
 }
@@ -8,8 +8,18 @@
 #ifndef LOGSYS_H_
 #define LOGSYS_H_
 
+#include <map>
+#include <vector>
+#include <atomic>
+#include <boost/thread/mutex.hpp>
+
 #include "log_config.h"
-#include "Logger.h"
+#include "LogSinks.h"
+#include "AsyncLogWriter.h"
+#include "BinaryLogWriter.h"
+#include "LogFlusher.h"
+#include "LogMetrics.h"
+#include "LogConfigWatcher.h"
 
 
 class LogSys {
@@ -20,16 +30,76 @@ public:
     virtual ~LogSys();
 
     bool initialize(const std::string& config_file);
+    // reads the config file again and applies it, see config_reload; the
+    // running config is kept if the file is bad
+    bool reload();
 
     void log(const std::string& msg, ENUM_LOG_LEVEL level);
+    void log(const char* msg, size_t len, ENUM_LOG_LEVEL level);
+    // 'text_len' < 'len' for a log with fields, see LOG_OUT
+    void log(const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level);
+    void log(const LogCategory* category, const char* msg, size_t len, ENUM_LOG_LEVEL level);
 
     void setLevel(ENUM_LOG_LEVEL level);
+    // of a sink of 'sinks' or of 'category_sinks'; false if there's none
+    bool setSinkLevel(const std::string& name, ENUM_LOG_LEVEL level);
+
+    // categories
+    LogCategory* getCategory(const std::string& name);
+    void setCategoryLevel(const std::string& name, ENUM_LOG_LEVEL level);
+
+    bool getFlushStats(LogFlushStats& stats);
+    bool getQueueStats(LogQueueStats& stats);
+    bool getMetrics(LogMetrics& metrics);
+
+    // binary mode
+    unsigned int registerBinaryFormat(const char* format);
+    void logBinary(const char* record, size_t len);
 
 private:
     LogSys();
 
+    static bool configureCategories(const LogConfig& config, std::map<std::string, ENUM_LOG_LEVEL>& levels,
+            std::map<std::string, boost::shared_ptr<LogSinks> >& sinks);
+    bool startFlusher(const LogConfig& config);
+    bool startMetricsReporter(const LogConfig& config);
+    void resolveCategory(LogCategory& category) const;
+    void resolveCategories();
+    std::vector<boost::shared_ptr<LogSinks> > getAllSinks() const;
+
 private:
-    boost::shared_ptr<Logger> logger_;
+    boost::shared_ptr<LogSinks> sinks_;
+    // sinks_, as read by the logs; swapped by reload(), see LogRcu.h
+    std::atomic<LogSinks*> active_sinks_;
+
+    // category_sinks, by the name of the category
+    std::map<std::string, boost::shared_ptr<LogSinks> > category_sinks_;
+
+    // category_level and LOG_SET_CATEGORY_LEVEL, by the name of the category
+    std::map<std::string, ENUM_LOG_LEVEL> category_levels_;
+
+    // every handle given out, by its name
+    std::map<std::string, boost::shared_ptr<LogCategory> > categories_;
+    boost::mutex category_mutex_;
+
+    // not NULL only when 'log_async' is on
+    boost::shared_ptr<AsyncLogWriter> async_writer_;
+
+    // not NULL only when 'log_binary' is on
+    boost::shared_ptr<BinaryLogWriter> binary_writer_;
+
+    // not NULL only when 'flush_interval_ms' is set
+    boost::shared_ptr<LogFlusher> flusher_;
+
+    // not NULL only when 'metrics_interval_ms' is set
+    boost::shared_ptr<LogMetricsReporter> metrics_reporter_;
+
+    // config_reload
+    std::string config_file_;
+    LogConfig config_;      // in use
+    bool reloadable_;
+    boost::shared_ptr<LogConfigWatcher> watcher_;   // not NULL only when 'config_reload' is on
+    boost::mutex reload_mutex_;
 };
 
 #endif /* LOGSYS_H_ */
@@ -0,0 +1,73 @@
+/*
+ * LogThreadRegistry.h
+ *
+ *  Note:
+ *  An object of type T for every thread, created on the first call of
+ *  local() in the thread and registered until the thread exits, so another
+ *  thread can go through all of them under mutex(): the counters of
+ *  LogMetrics and the readers of LogRcu. ON_EXIT is called with the object
+ *  of an exiting thread, under mutex(), right before it's unregistered.
+ */
+
+#ifndef LOGTHREADREGISTRY_H_
+#define LOGTHREADREGISTRY_H_
+
+#include <vector>
+#include <algorithm>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+
+template <typename T>
+void log_thread_exit_nothing(const T&) {
+}
+
+template <typename T, void (*ON_EXIT)(const T&) = &log_thread_exit_nothing<T> >
+class LogThreadRegistry {
+public:
+    // the object of the calling thread
+    static T& local() {
+        static thread_local Slot slot;
+        return slot.object;
+    }
+
+    // to be held while objects() is gone through
+    static boost::mutex& mutex() {
+        return registry().mutex;
+    }
+
+    static const std::vector<T*>& objects() {
+        return registry().objects;
+    }
+
+private:
+    struct Registry {
+        boost::mutex mutex;
+        std::vector<T*> objects;
+    };
+
+    // never destroyed: a thread may exit after the static objects are gone
+    static Registry& registry() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    struct Slot {
+        Slot() {
+            Registry& reg = registry();
+            boost::lock_guard<boost::mutex> lock(reg.mutex);
+            reg.objects.push_back(&object);
+        }
+
+        ~Slot() {
+            Registry& reg = registry();
+            boost::lock_guard<boost::mutex> lock(reg.mutex);
+            ON_EXIT(object);
+            reg.objects.erase(std::remove(reg.objects.begin(), reg.objects.end(), &object), reg.objects.end());
+        }
+
+        T object;
+    };
+};
+
+#endif /* LOGTHREADREGISTRY_H_ */
@@ -5,8 +5,15 @@
  *      Author: xieliang
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <boost/bind/bind.hpp>
 #include <boost/filesystem.hpp>
 #include "Logger.h"
+#include "LogMetrics.h"
+#include "log_json.h"
 
 
 using namespace std;
@@ -18,25 +25,45 @@ using namespace boost::filesystem;
 // helper functions:
 //
 
-static string get_current_time_str() {
-    time_t now;
-    char dbgtime[26] ;
-    time(&now);
-    ctime_r(&now, dbgtime);
-    dbgtime[24] = '\0';
-    return dbgtime;
+// writes "[time] LEVEL msg\n" into 'out', reusing its memory
+void generate_final_log(std::string& out, const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level,
+        const struct timeval& when, ENUM_LOG_TIME_PRECISION precision, ENUM_LOG_FORMAT format) {
+    if (LOG_FORMAT_JSON == format) {
+        generate_json_log(out, msg, len, text_len, level, when, precision);
+        return;
+    }
+
+    static const LogPattern default_pattern;
+    default_pattern.format(out, msg, len, text_len, level, when, precision, 0);
 }
 
-static string generate_final_log(const std::string& msg, ENUM_LOG_LEVEL level) {
-    ostringstream out;
-    out << "[" << get_current_time_str() << "] " << get_log_level_txt(level) << " " << msg << "\n";
-    return out.str();
+uint64_t hash_log_msg(const char* msg, size_t len, size_t text_len) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len ^ (static_cast<uint64_t>(text_len) << 32);
+
+    while (len >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, msg, sizeof(word));
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+        msg += sizeof(word);
+        len -= sizeof(word);
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, msg, len);
+    h = (h ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 29;
+    return h;
 }
 
-static bool the_same_day(const struct tm& day1, const struct tm& day2) {
-    return day1.tm_year == day2.tm_year &&
-           day1.tm_mon == day2.tm_mon &&
-           day1.tm_mday == day2.tm_mday;
+// milliseconds from 'begin' to 'end'; 0 if 'end' is earlier
+static unsigned long long get_elapsed_ms(const struct timeval& begin, const struct timeval& end) {
+    struct timeval elapsed;
+    timersub(&end, &begin, &elapsed);
+    if (elapsed.tv_sec < 0) {
+        return 0;
+    }
+    return elapsed.tv_sec * 1000ULL + elapsed.tv_usec / 1000;
 }
 
 static string get_file_name(const string& base_name, const string& suffix) {
@@ -77,24 +104,93 @@ static string get_formatted_date_desc(const struct tm& date) {
     return oss.str();
 }
 
-static void rename_file_with_timestamp(const std::string& src_file_path, const struct tm& date) {
-    string file_name_with_date = src_file_path + "." + get_formatted_date_desc(date);
+// return something like: 2012-08-23-10
+static string get_formatted_hour_desc(const struct tm& date) {
+    ostringstream oss;
+    oss << get_formatted_date_desc(date) << '-' << setw(2) << setfill('0') << date.tm_hour;
+    return oss.str();
+}
+
+// renames 'src_file_path' to '<dst_file_path>.<time_desc>', or
+// '<dst_file_path>.<time_desc>-1' ... if taken, compressed or not
+// returns the new name
+static string rename_file_with_timestamp(const std::string& src_file_path, const std::string& dst_file_path,
+        const std::string& time_desc) {
+    string file_name_with_date = dst_file_path + "." + time_desc;
 
     int i = 0;
-    while (exists(file_name_with_date)) {
+    while (LogCompressor::isNameTaken(file_name_with_date)) {
         ostringstream oss;
         oss << ++i;
-        file_name_with_date = src_file_path + "." + get_formatted_date_desc(date) + "-" + oss.str();
+        file_name_with_date = dst_file_path + "." + time_desc + "-" + oss.str();
     }
 
     rename(src_file_path, file_name_with_date);
     LOG_TO_STDERR("rename <%s> to <%s>", src_file_path.c_str(), file_name_with_date.c_str());
+    return file_name_with_date;
+}
+
+static bool create_log_directory(const string& path) {
+    try {
+        if (!boost::filesystem::exists(path)) {
+            if (boost::filesystem::create_directories(path)) {
+                LOG_TO_STDERR("Created log directory <%s>", path.c_str());
+            }
+            else {
+                LOG_TO_STDERR("Failed to created log directory <%s>", path.c_str());
+                return false;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        LOG_TO_STDERR("Exception: %s", e.what());
+        return false;
+    }
+
+    return true;
+}
+
+// file_backend, and file_buffer_size or mmap_chunk_size, shared by the file
+// loggers; 'backend' keeps its value if not configured, or if 'fixed'
+static bool get_file_backend_conf(const LogConfig& conf, ENUM_LOG_FILE_BACKEND& backend, unsigned long& buffer_size,
+        bool fixed = false) {
+    unsigned long num = 0;
+    if (!fixed && conf.getUnsigned(TEXT_LOG_FILE_BACKEND, num)) {
+        if (num < static_cast<unsigned long>(FILE_BACKEND_MAX)) {
+            backend = static_cast<ENUM_LOG_FILE_BACKEND>(num);
+        }
+        else {
+            Assert(false, "File backend out of range!");
+            return false;
+        }
+    }
+
+    if (FILE_BACKEND_MMAP == backend) {
+        buffer_size = LOG_DEFAULT_MMAP_CHUNK_SIZE;
+        conf.getUnsigned(TEXT_LOG_MMAP_CHUNK_SIZE, buffer_size);
+        LOG_TO_STDERR("file_backend: mmap, mmap_chunk_size: %lu", buffer_size);
+        return true;
+    }
+
+    buffer_size = LOG_DEFAULT_FILE_BUFFER_SIZE;
+    conf.getUnsigned(TEXT_LOG_FILE_BUFFER_SIZE, buffer_size);
+
+    if (FILE_BACKEND_FD == backend) {
+        LOG_TO_STDERR("file_backend: fd, file_buffer_size: %lu", buffer_size);
+    }
+    else if (FILE_BACKEND_URING == backend) {
+        LOG_TO_STDERR("file_backend: io_uring, file_buffer_size: %lu", buffer_size);
+    }
+    else {
+        LOG_TO_STDERR("file_backend: fstream");
+    }
+    return true;
 }
 
 // helper end.
 
 
-boost::shared_ptr<Logger> Logger::createLoggerInterface(ENUM_LOG_TYPE type) throw (runtime_error) {
+boost::shared_ptr<Logger> Logger::createLoggerInterface(ENUM_LOG_TYPE type) {
     switch(type) {
     case TO_STDERR:
         return boost::shared_ptr<Logger>( new StdErrLogger() );
@@ -108,6 +204,14 @@ boost::shared_ptr<Logger> Logger::createLoggerInterface(ENUM_LOG_TYPE type) thro
         return boost::shared_ptr<Logger>( new RollingFileLogger() );
         break;
 
+    case TO_MMAP_FILE:
+        return boost::shared_ptr<Logger>( new FileLogger(FILE_BACKEND_MMAP) );
+        break;
+
+    case TO_URING_FILE:
+        return boost::shared_ptr<Logger>( new FileLogger(FILE_BACKEND_URING) );
+        break;
+
     default:
         runtime_error ex("Wrong log type!");
         throw ex;
@@ -117,18 +221,56 @@ boost::shared_ptr<Logger> Logger::createLoggerInterface(ENUM_LOG_TYPE type) thro
     return boost::shared_ptr<Logger>();
 }
 
+LoggerSettings::LoggerSettings():
+    max_flush_num(LOG_DEFAULT_FLUSH_NUM),
+    time_precision(LOG_DEFAULT_TIME_PRECISION),
+    format(LOG_DEFAULT_FORMAT),
+    repeat_window_ms(LOG_DEFAULT_REPEAT_WINDOW_MS) {
+}
+
+
 // constructor
 Logger::Logger():
+    level_(LOG_DEFAULT_LOGLEVEL),
+    settings_(NULL),
     not_flushed_num_(0),
+    not_synced_(false),
+    flush_count_(0),
+    timer_flush_count_(0),
+    fsync_count_(0),
+    max_dirty_age_us_(0),
+    has_last_(false),
+    last_hash_(0),
+    last_level_(LOG_LEVEL_DEBUG),
+    repeated_(0),
     status_(CREATED) {
     setDefaultConf();
+    timerclear(&dirty_since_);
+    timerclear(&run_since_);
+    timerclear(&last_when_);
 }
 
-Logger::Logger(ENUM_LOG_LEVEL level, unsigned long flush_num):
+Logger::Logger(ENUM_LOG_LEVEL level, unsigned long flush_num, ENUM_LOG_TIME_PRECISION time_precision):
     level_(level),
-    max_flush_num_(flush_num),
+    settings_(NULL),
     not_flushed_num_(0),
+    not_synced_(false),
+    flush_count_(0),
+    timer_flush_count_(0),
+    fsync_count_(0),
+    max_dirty_age_us_(0),
+    has_last_(false),
+    last_hash_(0),
+    last_level_(LOG_LEVEL_DEBUG),
+    repeated_(0),
     status_(CREATED) {
+    boost::shared_ptr<LoggerSettings> settings(new LoggerSettings());
+    settings->max_flush_num = flush_num;
+    settings->time_precision = time_precision;
+    publishSettings(settings);
+    timerclear(&dirty_since_);
+    timerclear(&run_since_);
+    timerclear(&last_when_);
 }
 
 // destructor
@@ -143,22 +285,49 @@ Logger::~Logger() {
 }
 
 void Logger::setDefaultConf() {
-    level_ = LOG_DEFAULT_LOGLEVEL;
-    max_flush_num_ = LOG_DEFAULT_FLUSH_NUM;
+    level_.store(LOG_DEFAULT_LOGLEVEL, std::memory_order_relaxed);
+    publishSettings(boost::shared_ptr<const LoggerSettings>(new LoggerSettings()));
+}
+
+// the one read by the logs from now on; the old one is kept until reclaim()
+void Logger::publishSettings(const boost::shared_ptr<const LoggerSettings>& settings) {
+    if (current_settings_) {
+        retired_settings_.push_back(current_settings_);
+    }
+    current_settings_ = settings;
+    settings_.store(settings.get(), std::memory_order_release);
+}
+
+const LoggerSettings& Logger::getSettings() const {
+    return *settings_.load(std::memory_order_acquire);
 }
 
 // get the config values of all items;
 // the default value will be used if not given
 bool Logger::config(const LogConfig& conf) {
-    lock_guard<mutex> write_lock(mutex_);
+    boost::lock_guard<boost::mutex> write_lock(mutex_);
 
-    if (OPENED == status_) {
+    if (status_ != CREATED && status_ != CLOSED) {
         Assert(false, "You can't config a logger when it's already opened!");
         return false;
     }
 
     setDefaultConf();
 
+    ENUM_LOG_LEVEL level = LOG_DEFAULT_LOGLEVEL;
+    boost::shared_ptr<LoggerSettings> settings(new LoggerSettings());
+    if (!parseSettings(conf, level, *settings)) {
+        return false;
+    }
+
+    level_.store(level, std::memory_order_relaxed);
+    publishSettings(settings);
+    conf_ = conf;
+
+    return configImpl(conf);
+}
+
+bool Logger::parseSettings(const LogConfig& conf, ENUM_LOG_LEVEL& level, LoggerSettings& settings) {
 
     //
     // get log level
@@ -168,33 +337,165 @@ bool Logger::config(const LogConfig& conf) {
     if(conf.getUnsigned(TEXT_LOG_LEVEL, num))
     {
         if(num < static_cast<unsigned long int>(LOG_LEVEL_MAX)) {
-            level_ = static_cast<ENUM_LOG_LEVEL>(num);
+            level = static_cast<ENUM_LOG_LEVEL>(num);
         }
         else {
             Assert(false, "Log level out of range!");
             return false;
         }
     }
-    LOG_TO_STDERR("Log level: %s", get_log_level_txt(level_));
+    LOG_TO_STDERR("Log level: %s", get_log_level_txt(level));
 
 
     //
     // num_logs_to_flush
     //
 
-    conf.getUnsigned(TEXT_LOG_FLUSH_NUM, max_flush_num_);
-    if (max_flush_num_ < 1) {
-        max_flush_num_ = 1;
+    conf.getUnsigned(TEXT_LOG_FLUSH_NUM, settings.max_flush_num);
+    if (settings.max_flush_num < 1) {
+        settings.max_flush_num = 1;
         Assert(false, "num_logs_to_flush > 0");
     }
-    LOG_TO_STDERR("num_logs_to_flush: %lu", max_flush_num_);
+    LOG_TO_STDERR("num_logs_to_flush: %lu", settings.max_flush_num);
 
 
-    return configImpl(conf);
+    //
+    // time_precision
+    //
+
+    if (conf.getUnsigned(TEXT_LOG_TIME_PRECISION, num)) {
+        if (num < static_cast<unsigned long int>(LOG_TIME_PRECISION_MAX)) {
+            settings.time_precision = static_cast<ENUM_LOG_TIME_PRECISION>(num);
+        }
+        else {
+            Assert(false, "Time precision out of range!");
+            return false;
+        }
+    }
+    LOG_TO_STDERR("time_precision: %d", settings.time_precision);
+
+
+    //
+    // log_format
+    //
+
+    string format;
+    if (conf.getString(TEXT_LOG_FORMAT, format)) {
+        if ("text" == format) {
+            settings.format = LOG_FORMAT_TEXT;
+        }
+        else if ("json" == format) {
+            settings.format = LOG_FORMAT_JSON;
+        }
+        else {
+            Assert(false, "log_format must be 'text' or 'json'!");
+            return false;
+        }
+    }
+    LOG_TO_STDERR("log_format: %s", LOG_FORMAT_JSON == settings.format ? "json" : "text");
+
+
+    //
+    // log_pattern
+    //
+
+    string pattern;
+    if (conf.getString(TEXT_LOG_PATTERN, pattern) && !settings.pattern.compile(pattern)) {
+        Assert(false, "Bad log_pattern!");
+        return false;
+    }
+    LOG_TO_STDERR("log_pattern: %s", settings.pattern.getText().c_str());
+
+
+    //
+    // repeat_window_ms
+    //
+
+    conf.getUnsigned(TEXT_LOG_REPEAT_WINDOW_MS, settings.repeat_window_ms);
+    LOG_TO_STDERR("repeat_window_ms: %lu", settings.repeat_window_ms);
+
+
+    return true;
+}
+
+bool Logger::reconfig(const LogConfig& conf) {
+    ENUM_LOG_LEVEL level = LOG_DEFAULT_LOGLEVEL;
+    boost::shared_ptr<LoggerSettings> settings(new LoggerSettings());
+    if (!parseSettings(conf, level, *settings)) {
+        return false;
+    }
+
+    boost::lock_guard<boost::mutex> write_lock(mutex_);
+
+    if (status_ != OPENED) {
+        Assert(false, "You can only reconfig an opened logger!");
+        return false;
+    }
+
+    // the copies counted are told of in the old layout
+    endRepeats();
+    has_last_ = false;
+
+    if (level_.load(std::memory_order_relaxed) != level) {
+        level_.store(level, std::memory_order_relaxed);
+        setLevelImpl(level);
+    }
+    publishSettings(settings);
+    reconfigImpl(conf);
+    conf_ = conf;
+
+    // a lower num_logs_to_flush takes effect now
+    if (not_flushed_num_ >= settings->max_flush_num) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        timedFlush();
+        flushed(now);
+    }
+    return true;
+}
+
+bool Logger::retire(const boost::shared_ptr<Logger>& successor) {
+    boost::lock_guard<boost::mutex> write_lock(mutex_);
+
+    if (status_ != OPENED) {
+        Assert(false, "You can only retire an opened logger!");
+        return false;
+    }
+
+    // the successor may write to the same file: this one is closed first
+    endRepeats();
+    closeImpl();
+
+    if (successor && !successor->open()) {
+        LOG_TO_STDERR("Failed to open the new logger, the old one is kept!");
+        if (!openImpl()) {
+            status_ = CLOSED;
+        }
+        return false;
+    }
+
+    successor_ = successor;
+    status_ = RETIRED;
+    return true;
+}
+
+void Logger::reclaim() {
+    boost::lock_guard<boost::mutex> write_lock(mutex_);
+    retired_settings_.clear();
+}
+
+const LogConfig& Logger::getConfig() const {
+    return conf_;
+}
+
+// the logger the logs go to once this one is retired, NULL if none
+boost::shared_ptr<Logger> Logger::getSuccessor() {
+    boost::lock_guard<boost::mutex> write_lock(mutex_);
+    return successor_;
 }
 
 bool Logger::open() {
-    lock_guard<mutex> write_lock(mutex_);
+    boost::lock_guard<boost::mutex> write_lock(mutex_);
 
     if (OPENED == status_) {
         Assert(false, "The logger is already opened!");
@@ -210,62 +511,304 @@ bool Logger::open() {
 }
 
 void Logger::close() {
-    lock_guard<mutex> write_lock(mutex_);
+    boost::lock_guard<boost::mutex> write_lock(mutex_);
+
+    // closed already; no more logs to pass on
+    if (RETIRED == status_) {
+        successor_.reset();
+        status_ = CLOSED;
+        return;
+    }
 
     if (status_ != OPENED) {
         LOG_TO_STDERR("The logger is already closed!");
         return;
     }
 
+    endRepeats();
     closeImpl();
     status_ = CLOSED;
 }
 
 bool Logger::log(const std::string& msg, ENUM_LOG_LEVEL level) {
-    lock_guard<mutex> write_lock(mutex_);
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return log(msg, level, now);
+}
+
+// 'when' is the time the record was produced, which may be earlier than now
+// if the record has been queued (see AsyncLogWriter)
+bool Logger::log(const std::string& msg, ENUM_LOG_LEVEL level, const struct timeval& when) {
+    return log(msg.data(), msg.size(), msg.size(), level, when);
+}
+
+bool Logger::log(const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level, const struct timeval& when) {
+    boost::unique_lock<boost::mutex> write_lock(mutex_, boost::try_to_lock);
+    if (!write_lock.owns_lock()) {
+        waitForLock(write_lock);
+    }
+
+    if (RETIRED == status_) {
+        write_lock.unlock();
+        boost::shared_ptr<Logger> successor = getSuccessor();
+        return successor ? successor->log(msg, len, text_len, level, when) : false;
+    }
 
     if (status_ != OPENED) {
         Assert(false, "The logger is NOT ready for logging !!!");
         return false;
     }
 
-    if (level < level_) {
+    if (level < level_.load(std::memory_order_relaxed)) {
         return false;
     }
 
-    if (!logImpl(msg, level)) {
+    const uint64_t msg_hash = getSettings().repeat_window_ms > 0 ? hash_log_msg(msg, len, text_len) : 0;
+    formatLine(line_, msg, len, text_len, level, when, 0);
+    return logLineLocked(line_.data(), line_.size(), level, when, msg_hash);
+}
+
+bool Logger::logLine(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when,
+        uint64_t msg_hash) {
+    boost::unique_lock<boost::mutex> write_lock(mutex_, boost::try_to_lock);
+    if (!write_lock.owns_lock()) {
+        waitForLock(write_lock);
+    }
+
+    // 'line' is in the layout of this logger, which the successor may not
+    // have: it's written as it is, like the last logs before a reload
+    if (RETIRED == status_) {
+        write_lock.unlock();
+        boost::shared_ptr<Logger> successor = getSuccessor();
+        return successor ? successor->logLine(line, len, level, when, msg_hash) : false;
+    }
+
+    if (status_ != OPENED) {
+        Assert(false, "The logger is NOT ready for logging !!!");
         return false;
     }
 
+    return logLineLocked(line, len, level, when, msg_hash);
+}
+
+// the lock is taken by another thread: waits for it, timed for the metrics
+void Logger::waitForLock(boost::unique_lock<boost::mutex>& lock) {
+    const uint64_t begin = log_metrics_now_ns();
+    lock.lock();
+
+    ThreadLogMetrics& metrics = thread_log_metrics();
+    add_log_metric(metrics.lock_waits, 1);
+    add_log_metric(metrics.lock_wait_ns, log_metrics_now_ns() - begin);
+}
+
+// a copy of the last log within repeat_window_ms of it is only counted
+bool Logger::logLineLocked(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when,
+        uint64_t msg_hash) {
+    const unsigned long repeat_window_ms = getSettings().repeat_window_ms;
+    if (0 == repeat_window_ms) {
+        return writeLine(line, len, level, when);
+    }
+
+    if (has_last_ && msg_hash == last_hash_ && level == last_level_
+            && get_elapsed_ms(run_since_, when) < repeat_window_ms) {
+        repeated_++;
+        last_when_ = when;
+        return true;
+    }
+
+    endRepeats();
+    has_last_ = true;
+    last_hash_ = msg_hash;
+    last_level_ = level;
+    run_since_ = when;
+    return writeLine(line, len, level, when);
+}
+
+// writes "last message repeated N times" for the copies counted
+void Logger::endRepeats() {
+    if (0 == repeated_) {
+        return;
+    }
+
+    char msg[64];
+    const int n = snprintf(msg, sizeof(msg), "last message repeated %lu times", repeated_);
+    repeated_ = 0;
+
+    formatLine(repeat_line_, msg, n, n, last_level_, last_when_, 0);
+    writeLine(repeat_line_.data(), repeat_line_.size(), last_level_, last_when_);
+}
+
+// writes the line and flushes every num_logs_to_flush logs
+bool Logger::writeLine(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when) {
+    ThreadLogMetrics& metrics = thread_log_metrics();
+
+    if (log_metrics_latency_on()) {
+        const uint64_t begin = log_metrics_now_ns();
+        if (!logImpl(line, len, level, when)) {
+            return false;
+        }
+        add_log_latency(metrics.write_hist, log_metrics_now_ns() - begin);
+    }
+    else if (!logImpl(line, len, level, when)) {
+        return false;
+    }
+    add_log_metric(metrics.writes, 1);
+    add_log_metric(metrics.bytes, len);
+
+    if (0 == not_flushed_num_) {
+        dirty_since_ = when;
+    }
     not_flushed_num_++;
-    if (not_flushed_num_ >= max_flush_num_) {
-        flush();
-        not_flushed_num_ = 0;
+    if (not_flushed_num_ >= getSettings().max_flush_num) {
+        timedFlush();
+        flushed(when);
     }
 
     return true;
 }
 
+// flush(), timed with metrics_latency = 1
+void Logger::timedFlush() {
+    if (!log_metrics_latency_on()) {
+        flush();
+        return;
+    }
+
+    const uint64_t begin = log_metrics_now_ns();
+    flush();
+    add_log_latency(thread_log_metrics().flush_hist, log_metrics_now_ns() - begin);
+}
+
+void Logger::flushPending(bool sync) {
+    boost::lock_guard<boost::mutex> write_lock(mutex_);
+
+    if (status_ != OPENED) {
+        return;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    // the copies of a log are told of once its window is over, even if no
+    // other log comes
+    if (repeated_ > 0 && get_elapsed_ms(run_since_, now) >= getSettings().repeat_window_ms) {
+        endRepeats();
+        has_last_ = false;
+    }
+
+    if (not_flushed_num_ > 0) {
+        timedFlush();
+        flushed(now);
+        timer_flush_count_++;
+    }
+
+    // one fsync for everything flushed since the last one
+    if (sync && not_synced_) {
+        this->sync();
+        not_synced_ = false;
+        fsync_count_++;
+    }
+}
+
+void Logger::getFlushStats(LogFlushStats& stats) {
+    boost::lock_guard<boost::mutex> write_lock(mutex_);
+
+    stats.flushes = flush_count_;
+    stats.timer_flushes = timer_flush_count_;
+    stats.fsyncs = fsync_count_;
+    stats.max_dirty_age_ms = max_dirty_age_us_ / 1000;
+    stats.dirty_age_ms = 0;
+
+    if (not_flushed_num_ > 0) {
+        struct timeval now, age;
+        gettimeofday(&now, NULL);
+        timersub(&now, &dirty_since_, &age);
+        if (age.tv_sec >= 0) {
+            stats.dirty_age_ms = age.tv_sec * 1000 + age.tv_usec / 1000;
+        }
+    }
+}
+
+// the bookkeeping after flush(), with the logger locked
+void Logger::flushed(const struct timeval& now) {
+    struct timeval age;
+    timersub(&now, &dirty_since_, &age);
+    if (age.tv_sec >= 0) {
+        const unsigned long long age_us = age.tv_sec * 1000000ULL + age.tv_usec;
+        if (age_us > max_dirty_age_us_) {
+            max_dirty_age_us_ = age_us;
+        }
+    }
+
+    not_flushed_num_ = 0;
+    not_synced_ = true;
+    flush_count_++;
+    add_log_metric(thread_log_metrics().flushes, 1);
+}
+
 ENUM_LOG_LEVEL Logger::getLevel() const {
-    return level_;
+    return level_.load(std::memory_order_relaxed);
 }
 
 void Logger::setLevel(ENUM_LOG_LEVEL new_level) {
-    lock_guard<mutex> write_lock(mutex_);
+    boost::lock_guard<boost::mutex> write_lock(mutex_);
 
     if (new_level >= LOG_LEVEL_MAX) {
         Assert(false, "Invalid log level!");
     }
-    else if(level_ != new_level) {
-        level_ = new_level;
+    else if(level_.load(std::memory_order_relaxed) != new_level) {
+        level_.store(new_level, std::memory_order_relaxed);
         setLevelImpl(new_level);
-        LOG_TO_STDERR("Log level has been reset to: %s", get_log_level_txt(level_));
+        LOG_TO_STDERR("Log level has been reset to: %s", get_log_level_txt(new_level));
     }
 }
 
 unsigned long Logger::getMaxFlushNum() const
 {
-    return max_flush_num_;
+    return getSettings().max_flush_num;
+}
+
+ENUM_LOG_TIME_PRECISION Logger::getTimePrecision() const
+{
+    return getSettings().time_precision;
+}
+
+ENUM_LOG_FORMAT Logger::getFormat() const
+{
+    return getSettings().format;
+}
+
+bool Logger::needMsgHash() const
+{
+    return getSettings().repeat_window_ms > 0;
+}
+
+bool Logger::needThreadId() const
+{
+    const LoggerSettings& settings = getSettings();
+    return LOG_FORMAT_TEXT == settings.format && settings.pattern.needThreadId();
+}
+
+void Logger::formatLine(std::string& out, const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level,
+        const struct timeval& when, pid_t tid) const
+{
+    const LoggerSettings& settings = getSettings();
+    if (LOG_FORMAT_JSON == settings.format) {
+        generate_json_log(out, msg, len, text_len, level, when, settings.time_precision);
+    }
+    else {
+        settings.pattern.format(out, msg, len, text_len, level, when, settings.time_precision, tid);
+    }
+}
+
+bool Logger::sameLayout(const Logger& rhs) const
+{
+    const LoggerSettings& settings = getSettings();
+    const LoggerSettings& rhs_settings = rhs.getSettings();
+    if (settings.format != rhs_settings.format || settings.time_precision != rhs_settings.time_precision) {
+        return false;
+    }
+    return LOG_FORMAT_JSON == settings.format || settings.pattern.getText() == rhs_settings.pattern.getText();
 }
 
 
@@ -273,15 +816,26 @@ unsigned long Logger::getMaxFlushNum() const
 // calss FileLogger
 //
 
-FileLogger::FileLogger() {
+FileLogger::FileLogger():
+    default_backend_(LOG_DEFAULT_FILE_BACKEND) {
     setDefaultConf();
 }
 
-FileLogger::FileLogger(const string& path, const string& base_name, const string& suffix, ENUM_LOG_LEVEL level, unsigned long flush_num):
-    Logger(level, flush_num),
+FileLogger::FileLogger(ENUM_LOG_FILE_BACKEND default_backend):
+    default_backend_(default_backend) {
+    setDefaultConf();
+}
+
+FileLogger::FileLogger(const string& path, const string& base_name, const string& suffix,
+        ENUM_LOG_LEVEL level, unsigned long flush_num, ENUM_LOG_TIME_PRECISION time_precision,
+        ENUM_LOG_FILE_BACKEND backend, unsigned long buffer_size):
+    Logger(level, flush_num, time_precision),
     file_path_(path),
     file_base_name_(base_name),
-    file_suffix_(suffix) {
+    file_suffix_(suffix),
+    default_backend_(backend),
+    backend_(backend),
+    buffer_size_(buffer_size) {
 }
 
 FileLogger::~FileLogger() {
@@ -293,6 +847,8 @@ void FileLogger::setDefaultConf() {
     file_path_ = LOG_DEFAULT_FILE_PATH;
     file_base_name_ = LOG_DEFAULT_FILE_BASENAME;
     file_suffix_ = LOG_DEFAULT_FILE_SUFFIX;
+    backend_ = default_backend_;
+    buffer_size_ = LOG_DEFAULT_FILE_BUFFER_SIZE;
 }
 
 bool FileLogger::configImpl(const LogConfig& conf) {
@@ -300,7 +856,9 @@ bool FileLogger::configImpl(const LogConfig& conf) {
     conf.getString(TEXT_LOG_FILE_PATH,      file_path_);
     conf.getString(TEXT_LOG_FILE_BASE_NAME, file_base_name_);
     conf.getString(TEXT_LOG_FILE_SUFFIX,    file_suffix_);
-    return true;
+
+    // log_dest = 3 is mmap, whatever file_backend says
+    return get_file_backend_conf(conf, backend_, buffer_size_, FILE_BACKEND_MMAP == default_backend_);
 }
 
 bool FileLogger::openImpl() {
@@ -308,19 +866,7 @@ bool FileLogger::openImpl() {
     // create the directory first
     //
 
-    try {
-        if (!boost::filesystem::exists(file_path_)) {
-            if (boost::filesystem::create_directories(file_path_)) {
-                LOG_TO_STDERR("Created log directory <%s>", file_path_.c_str());
-            }
-            else {
-                LOG_TO_STDERR("Failed to created log directory <%s>", file_path_.c_str());
-                return false;
-            }
-        }
-    }
-    catch (const std::exception& e) {
-        LOG_TO_STDERR("Exception: %s", e.what());
+    if (!create_log_directory(file_path_)) {
         return false;
     }
 
@@ -329,37 +875,38 @@ bool FileLogger::openImpl() {
     // open file for write in append mode
     //
 
-    ios_base::openmode mode = fstream::out | fstream::app;
-    file_.open(getFullFileName().c_str(), mode);
-
-    if (!file_.good()) {
-        LOG_TO_STDERR("Failed to open log file <%s>", getFullFileName().c_str());
+    file_ = boost::shared_ptr<LogFile>(new LogFile(backend_, buffer_size_));
+    if (!file_->open(getFullFileName())) {
+        file_.reset();
         return false;
     }
-    else {
-        LOG_TO_STDERR("Opened log file <%s> to APPEND to", getFullFileName().c_str());
-        return true;
-    }
+    return true;
 }
 
 void FileLogger::closeImpl() {
-    if (file_.is_open()) {
-        file_.close();
+    if (file_) {
+        file_->close();
+        file_.reset();
     }
 }
 
-bool FileLogger::logImpl(const std::string& msg, ENUM_LOG_LEVEL level) {
-    if (!file_.is_open()) {
+bool FileLogger::logImpl(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when) {
+    if (!file_) {
         return false;
     }
 
-    file_ << generate_final_log(msg, level);
-    return !file_.bad();
+    return file_->append(line, len);
 }
 
 void FileLogger::flush() {
-    if (file_.is_open()) {
-        file_.flush();
+    if (file_) {
+        file_->flush();
+    }
+}
+
+void FileLogger::sync() {
+    if (file_) {
+        file_->sync();
     }
 }
 
@@ -391,8 +938,8 @@ bool StdErrLogger::openImpl() {
 void StdErrLogger::closeImpl() {
 }
 
-bool StdErrLogger::logImpl(const std::string& msg, ENUM_LOG_LEVEL level) {
-    fprintf(stderr, "%s", generate_final_log(msg, level).c_str());
+bool StdErrLogger::logImpl(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when) {
+    fwrite(line, 1, len, stderr);
     return true;
 }
 
@@ -404,7 +951,9 @@ void StdErrLogger::flush() {
 // calss RollingFileLogger
 //
 
-RollingFileLogger::RollingFileLogger() {
+RollingFileLogger::RollingFileLogger():
+    next_rotate_time_(0),
+    rotator_running_(false) {
     setDefaultConf();
 }
 
@@ -417,6 +966,13 @@ void RollingFileLogger::setDefaultConf() {
     file_path_ = LOG_DEFAULT_FILE_PATH;
     file_base_name_ = LOG_DEFAULT_FILE_BASENAME;
     file_suffix_ = LOG_DEFAULT_FILE_SUFFIX;
+    backend_ = LOG_DEFAULT_FILE_BACKEND;
+    buffer_size_ = LOG_DEFAULT_FILE_BUFFER_SIZE;
+    rotate_size_ = LOG_DEFAULT_ROTATE_SIZE_MB > 0 ? LOG_DEFAULT_ROTATE_SIZE_MB * 1024ULL * 1024ULL : ULLONG_MAX;
+    rotate_interval_ = LOG_DEFAULT_ROTATE_INTERVAL;
+    compress_ = LOG_DEFAULT_COMPRESS_ROTATED;
+    compress_level_ = LOG_DEFAULT_COMPRESS_LEVEL;
+    compress_cpu_percent_ = LOG_DEFAULT_COMPRESS_CPU_PERCENT;
 }
 
 bool RollingFileLogger::configImpl(const LogConfig& conf) {
@@ -424,93 +980,316 @@ bool RollingFileLogger::configImpl(const LogConfig& conf) {
     conf.getString(TEXT_LOG_FILE_PATH,      file_path_);
     conf.getString(TEXT_LOG_FILE_BASE_NAME, file_base_name_);
     conf.getString(TEXT_LOG_FILE_SUFFIX,    file_suffix_);
+
+    if (!getRotateConf(conf, rotate_size_, rotate_interval_)) {
+        return false;
+    }
+
+    conf.getUnsigned(TEXT_LOG_COMPRESS_ROTATED,     compress_);
+    conf.getUnsigned(TEXT_LOG_COMPRESS_LEVEL,       compress_level_);
+    conf.getUnsigned(TEXT_LOG_COMPRESS_CPU_PERCENT, compress_cpu_percent_);
+    if (compress_) {
+        LOG_TO_STDERR("compress_rotated: on, compress_level: %lu, compress_cpu_percent: %lu",
+                compress_level_, compress_cpu_percent_);
+    }
+
+    return get_file_backend_conf(conf, backend_, buffer_size_);
+}
+
+// rotate_size_mb and rotate_interval
+bool RollingFileLogger::getRotateConf(const LogConfig& conf, unsigned long long& size,
+        ENUM_LOG_ROTATE_INTERVAL& interval) {
+    unsigned long size_mb = LOG_DEFAULT_ROTATE_SIZE_MB;
+    conf.getUnsigned(TEXT_LOG_ROTATE_SIZE_MB, size_mb);
+    size = size_mb > 0 ? size_mb * 1024ULL * 1024ULL : ULLONG_MAX;
+
+    interval = LOG_DEFAULT_ROTATE_INTERVAL;
+    string text;
+    if (conf.getString(TEXT_LOG_ROTATE_INTERVAL, text)) {
+        if ("day" == text) {
+            interval = ROTATE_DAILY;
+        }
+        else if ("hour" == text) {
+            interval = ROTATE_HOURLY;
+        }
+        else {
+            Assert(false, "rotate_interval must be 'day' or 'hour'!");
+            return false;
+        }
+    }
+    LOG_TO_STDERR("rotate_interval: %s, rotate_size_mb: %lu",
+            ROTATE_HOURLY == interval ? "hour" : "day", size_mb);
     return true;
 }
 
+// the file being written is rotated by the new rules from its next log on
+void RollingFileLogger::reconfigImpl(const LogConfig& conf) {
+    unsigned long long size = 0;
+    ENUM_LOG_ROTATE_INTERVAL interval = LOG_DEFAULT_ROTATE_INTERVAL;
+    if (!getRotateConf(conf, size, interval)) {
+        return;
+    }
+
+    rotate_size_ = size;
+    if (interval != rotate_interval_) {
+        rotate_interval_ = interval;
+        setNextRotateTime();
+    }
+}
+
 bool RollingFileLogger::openImpl() {
-    getCurrentDate(last_created_time_);
+    startPeriod(time(NULL));
 
-    file_logger_ = boost::shared_ptr<Logger>(new FileLogger(file_path_, file_base_name_, file_suffix_, getLevel(), getMaxFlushNum()));
-    if (NULL == file_logger_) {
-        Assert(false, "Creating FileLogger failed! In RollingFileLogger::open()");
+    try {
+        if (!create_log_directory(file_path_)) {
+            return false;
+        }
+
+        // what a crash left in <name>.next belongs to no file yet
+        const string next_file_name = getNextFileName();
+        MmapFile::trim(next_file_name);
+        if (exists(next_file_name)) {
+            if (0 == file_size(next_file_name)) {
+                remove(next_file_name);
+            }
+            else {
+                rename_file_with_timestamp(next_file_name, getCurrentFileName(),
+                        getTimeDesc(last_created_time_, rotate_interval_));
+            }
+        }
+    }
+    catch (const std::exception& ex) {
+        LOG_TO_STDERR("Exception: %s", ex.what());
+    }
+
+    file_ = openFile(getCurrentFileName());
+    if (!file_) {
         return false;
     }
 
-    return file_logger_->open();
-}
+    if (compress_) {
+        compressor_ = boost::shared_ptr<LogCompressor>(new LogCompressor(compress_level_, compress_cpu_percent_));
+        if (compressor_->start()) {
+            compressor_->pushLeftovers(getCurrentFileName());
+        }
+        else {
+            compressor_.reset();
+        }
+    }
 
-void RollingFileLogger::closeImpl() {
-    if (file_logger_) {
-        file_logger_->close();
-        file_logger_.reset();
+    // the rotator opens the next file right away
+    boost::lock_guard<boost::mutex> lock(rotator_mutex_);
+    try {
+        rotator_thread_ = boost::thread(boost::bind(&RollingFileLogger::runRotator, this));
     }
+    catch (const std::exception& e) {
+        LOG_TO_STDERR("Failed to start the log rotator thread: %s", e.what());
+        file_->close();
+        file_.reset();
+        return false;
+    }
+    rotator_running_ = true;
 
-    const string cur_file_name = get_file_full_name(file_path_, get_file_name(file_base_name_, file_suffix_));
-    rename_file_with_timestamp(cur_file_name, last_created_time_);
+    return true;
 }
 
-bool RollingFileLogger::logImpl(const std::string& msg, ENUM_LOG_LEVEL level) {
-    try {
-        // create a new file when a day passed
-        struct tm date_now;
-        getCurrentDate(date_now);
+void RollingFileLogger::closeImpl() {
+    stopRotator();
 
-        if (!the_same_day(date_now, last_created_time_)) {
-            rotateFile(last_created_time_, date_now);
+    // what's left is compressed after the next open()
+    if (compressor_) {
+        compressor_->stop();
+        compressor_.reset();
+    }
+
+    if (next_file_) {
+        next_file_->close();
+        next_file_.reset();
+        try {
+            remove(getNextFileName());
+        }
+        catch (const std::exception& ex) {
+            LOG_TO_STDERR("Exception: %s", ex.what());
         }
+    }
 
-        if (file_logger_)
-            return file_logger_->log(msg, level);
-        else
-            return false;
+    if (file_) {
+        file_->close();
+        file_.reset();
     }
-    catch (std::exception& ex) {
+
+    try {
+        rename_file_with_timestamp(getCurrentFileName(), getCurrentFileName(),
+                getTimeDesc(last_created_time_, rotate_interval_));
+    }
+    catch (const std::exception& ex) {
         LOG_TO_STDERR("Exception: %s", ex.what());
+    }
+}
+
+bool RollingFileLogger::logImpl(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when) {
+    if (!file_) {
         return false;
     }
 
-    return true;
+    if (when.tv_sec >= next_rotate_time_ || file_->getSize() >= rotate_size_) {
+        rotate(when);
+    }
+
+    return file_->append(line, len);
 }
 
 void RollingFileLogger::flush() {
+    if (file_) {
+        file_->flush();
+    }
 }
 
-void RollingFileLogger::setLevelImpl(ENUM_LOG_LEVEL new_level) {
-    if (file_logger_) {
-        file_logger_->setLevel(new_level);
+void RollingFileLogger::sync() {
+    if (file_) {
+        file_->sync();
     }
 }
 
-void RollingFileLogger::rotateFile(const struct tm& old_date, const struct tm& new_date) {
-    // close the current file
-    file_logger_->close();
-    file_logger_.reset();
+// NULL if it can't be opened
+boost::shared_ptr<LogFile> RollingFileLogger::openFile(const std::string& file_name) const {
+    boost::shared_ptr<LogFile> file(new LogFile(backend_, buffer_size_));
+    if (!file->open(file_name)) {
+        file.reset();
+    }
+    return file;
+}
 
-    //
-    // rename the current file to something like: test.log.2012-08-23
-    // or test.log.2012-08-23-1 if test.log.2012-08-23 already exists
-    //
+std::string RollingFileLogger::getCurrentFileName() const {
+    return get_file_full_name(file_path_, get_file_name(file_base_name_, file_suffix_));
+}
 
-    const string cur_file_name = get_file_full_name(file_path_, get_file_name(file_base_name_, file_suffix_));
-    rename_file_with_timestamp(cur_file_name, old_date);
+std::string RollingFileLogger::getNextFileName() const {
+    return get_file_name(getCurrentFileName(), LOG_ROTATE_NEXT_FILE_SUFFIX);
+}
+
+std::string RollingFileLogger::getTimeDesc(const struct tm& created_time, ENUM_LOG_ROTATE_INTERVAL interval) {
+    return ROTATE_HOURLY == interval ?
+            get_formatted_hour_desc(created_time) : get_formatted_date_desc(created_time);
+}
+
+// the current file starts at 'now'; works out when the next one starts
+void RollingFileLogger::startPeriod(time_t now) {
+    localtime_r(&now, &last_created_time_);
+    setNextRotateTime();
+}
+
+// the start of the day or hour after the current file was created
+void RollingFileLogger::setNextRotateTime() {
+    struct tm next = last_created_time_;
+    next.tm_sec = 0;
+    next.tm_min = 0;
+    if (ROTATE_HOURLY == rotate_interval_) {
+        next.tm_hour += 1;
+    }
+    else {
+        next.tm_hour = 0;
+        next.tm_mday += 1;
+    }
+    next.tm_isdst = -1;
+    next_rotate_time_ = mktime(&next);
+}
+
+// swaps in the file opened ahead; called with the logger locked
+void RollingFileLogger::rotate(const struct timeval& when) {
+    const uint64_t begin = log_metrics_now_ns();
+    boost::lock_guard<boost::mutex> lock(rotator_mutex_);
 
+    if (!next_file_) {
+        return;     // not ready, try again with the next log
+    }
+
+    RetiredFile retired = { file_, last_created_time_, rotate_interval_ };
+    retired_.push_back(retired);
+    file_ = next_file_;
+    next_file_.reset();
+    rotator_cond_.notify_one();
+
+    startPeriod(when.tv_sec);
+
+    ThreadLogMetrics& metrics = thread_log_metrics();
+    add_log_metric(metrics.rotations, 1);
+    add_log_metric(metrics.rotation_ns, log_metrics_now_ns() - begin);
+}
+
+void RollingFileLogger::runRotator() {
+    boost::unique_lock<boost::mutex> lock(rotator_mutex_);
+
+    for (;;) {
+        while (rotator_running_ && retired_.empty() && next_file_) {
+            rotator_cond_.wait(lock);
+        }
+
+        // the renames first: <name>.next must become <name> before the
+        // next <name>.next is opened
+        if (!retired_.empty()) {
+            const RetiredFile file = retired_.front();
+            retired_.pop_front();
+            lock.unlock();
+            retireFile(file);
+            lock.lock();
+            continue;
+        }
+
+        if (!rotator_running_) {
+            break;
+        }
+
+        lock.unlock();
+        boost::shared_ptr<LogFile> next = openFile(getNextFileName());
+        lock.lock();
+
+        if (next) {
+            next_file_ = next;
+        }
+        else {
+            // try again later, the current file is still being written
+            rotator_cond_.timed_wait(lock, boost::posix_time::seconds(1));
+        }
+    }
+}
+
+// on the rotator thread
+void RollingFileLogger::retireFile(const RetiredFile& file) {
+    file.file->close();
 
     //
-    // open a new file for logging
+    // rename the current file to something like: test.log.2012-08-23
+    // or test.log.2012-08-23-1 if test.log.2012-08-23 already exists,
+    // then the file swapped in to test.log
     //
 
-    openImpl();
-}
+    try {
+        const string cur_file_name = getCurrentFileName();
+        const string rotated = rename_file_with_timestamp(cur_file_name, cur_file_name,
+                getTimeDesc(file.created_time, file.interval));
+        rename(getNextFileName(), cur_file_name);
 
-void RollingFileLogger::getCurrentDate(struct tm& date) {
-    time_t raw_time = time(NULL);
-    localtime_r(&raw_time, &date);
+        if (compressor_) {
+            compressor_->push(rotated);
+        }
+    }
+    catch (const std::exception& ex) {
+        LOG_TO_STDERR("Exception: %s", ex.what());
+    }
 }
 
-string RollingFileLogger::getFileNameByDate(const struct tm& date) {
-    ostringstream filename;
-    filename << file_base_name_ << '-' << date.tm_year + 1900 << '-'
-            << setw(2) << setfill('0') << date.tm_mon + 1 << '-'
-            << setw(2) << setfill('0') << date.tm_mday;
-    return filename.str();
+void RollingFileLogger::stopRotator() {
+    {
+        boost::lock_guard<boost::mutex> lock(rotator_mutex_);
+        if (!rotator_running_) {
+            return;
+        }
+        rotator_running_ = false;
+    }
+    rotator_cond_.notify_one();
+
+    if (rotator_thread_.joinable()) {
+        rotator_thread_.join();
+    }
 }
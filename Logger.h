@@ -8,12 +8,49 @@
 #ifndef LOGGER_H_
 #define LOGGER_H_
 
+#include <sys/time.h>
+#include <sys/types.h>
+#include <deque>
+#include <vector>
+#include <atomic>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include "allyes-log.h"
 #include "log_config.h"
 #include "common.h"
+#include "LogFile.h"
+#include "LogCompressor.h"
+#include "log_pattern.h"
+
+
+// the final text of a log in the default log_pattern, "[time] LEVEL msg
+// key=value\n", or the line of log_format = json; 'out' is overwritten. The
+// first 'text_len' bytes of 'msg' are its text, the rest its fields (see
+// LOG_OUT)
+void generate_final_log(std::string& out, const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level,
+        const struct timeval& when, ENUM_LOG_TIME_PRECISION precision, ENUM_LOG_FORMAT format = LOG_FORMAT_TEXT);
+
+// a hash of the text and the fields of a log, before the time and the level
+// are added; tells the copies of a log apart for repeat_window_ms
+uint64_t hash_log_msg(const char* msg, size_t len, size_t text_len);
+
+
+// what a logger reads for every log besides its level. Never changed once
+// given to a logger: a config reload gives it a new one, and the old one is
+// freed by reclaim() when no thread can be using it any more (see LogRcu.h)
+struct LoggerSettings {
+    LoggerSettings();
+
+    unsigned long max_flush_num;
+    ENUM_LOG_TIME_PRECISION time_precision;
+    ENUM_LOG_FORMAT format;
+    LogPattern pattern;             // of log_format = text
+    unsigned long repeat_window_ms;
+};
 
 
 class Logger {
@@ -23,45 +60,137 @@ public:
         CREATED = 0,    // the logger is created with the default or specified configurations
         OPENED,         // the logger is opend and ready for logging
         CLOSED,         // the logger is closed
+        RETIRED,        // closed by a config reload; its logs go to the successor
     };
 
 
     // static:
-    static boost::shared_ptr<Logger> createLoggerInterface(ENUM_LOG_TYPE type) throw (std::runtime_error);
+    // throws std::runtime_error for a wrong type
+    static boost::shared_ptr<Logger> createLoggerInterface(ENUM_LOG_TYPE type);
 
     virtual ~Logger();
 
     bool config(const LogConfig& conf);
     bool open();
     void close();
+
+    // config reload, see LogSys::reload():
+    // applies what can change on an opened logger: the level, the flush
+    // policy, the layout, and the rotation of RollingFileLogger. 'conf' has
+    // been checked by config() of another logger
+    bool reconfig(const LogConfig& conf);
+    // closes the logger, opens 'successor' (may be NULL) and passes it the
+    // logs still coming; the logger is left open if 'successor' fails
+    bool retire(const boost::shared_ptr<Logger>& successor);
+    // frees the settings replaced by reconfig(), once no thread can be using
+    // them
+    void reclaim();
+    const LogConfig& getConfig() const;
+
     bool log(const std::string& msg, ENUM_LOG_LEVEL level);
+    bool log(const std::string& msg, ENUM_LOG_LEVEL level, const struct timeval& when);
+    // see LogSinks::log() for 'text_len'
+    bool log(const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level, const struct timeval& when);
+    // 'line' is the final text of the log, made by formatLine() of this
+    // logger or of one with sameLayout(); the caller has checked the level of
+    // the log against getLevel(). 'msg_hash' is hash_log_msg() of the text,
+    // needed only if needMsgHash(). See LogSinks
+    bool logLine(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when,
+            uint64_t msg_hash);
     void setLevel(ENUM_LOG_LEVEL new_level);
 
+    // flushes the logs written since the last flush, then fsyncs the file if
+    // 'sync'; called by the timer of flush_interval_ms (see LogFlusher)
+    void flushPending(bool sync);
+    void getFlushStats(LogFlushStats& stats);
+
     ENUM_LOG_LEVEL getLevel() const;
     unsigned long getMaxFlushNum() const;
+    ENUM_LOG_TIME_PRECISION getTimePrecision() const;
+    ENUM_LOG_FORMAT getFormat() const;
+    // true if repeat_window_ms is set
+    bool needMsgHash() const;
+    // true if the lines have the id of the thread that made the log (%t)
+    bool needThreadId() const;
+
+    // the final text of a log, in the log_format, log_pattern and
+    // time_precision of this logger. 'tid' is the thread that made the log, 0
+    // for the calling one; 'out' is overwritten. See LogSinks::log() for
+    // 'text_len'
+    void formatLine(std::string& out, const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level,
+            const struct timeval& when, pid_t tid) const;
+    // true if the lines of 'rhs' are the same as the ones of this logger
+    bool sameLayout(const Logger& rhs) const;
 
 protected:
     // constructors
     Logger();
-    Logger(ENUM_LOG_LEVEL level, unsigned long flush_num);
+    Logger(ENUM_LOG_LEVEL level, unsigned long flush_num, ENUM_LOG_TIME_PRECISION time_precision);
 
     virtual bool configImpl(const LogConfig& conf) = 0;
+    // the part of reconfig() of the subclass, with the logger locked
+    virtual void reconfigImpl(const LogConfig& conf) {}
     virtual bool openImpl() = 0;
     virtual void closeImpl() = 0;
-    virtual bool logImpl(const std::string& msg, ENUM_LOG_LEVEL level) = 0;
+    // writes 'line', the final text of a log
+    virtual bool logImpl(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when) = 0;
     virtual void setLevelImpl(ENUM_LOG_LEVEL new_level) {}
     virtual void flush() = 0;
+    // makes what flush() wrote durable
+    virtual void sync() {}
+
+private:
+    // disabled methods
+    Logger(const Logger& rhs);
+    const Logger& operator=(const Logger& rhs);
 
 private:
+    static bool parseSettings(const LogConfig& conf, ENUM_LOG_LEVEL& level, LoggerSettings& settings);
     void setDefaultConf();
+    void publishSettings(const boost::shared_ptr<const LoggerSettings>& settings);
+    const LoggerSettings& getSettings() const;
+    boost::shared_ptr<Logger> getSuccessor();
+    bool logLineLocked(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when,
+            uint64_t msg_hash);
+    bool writeLine(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when);
+    void waitForLock(boost::unique_lock<boost::mutex>& lock);
+    void timedFlush();
+    void endRepeats();
+    void flushed(const struct timeval& now);
 
 private:
-    ENUM_LOG_LEVEL level_;
-    unsigned long max_flush_num_;
+    // read without the lock, and only changed with it
+    std::atomic<ENUM_LOG_LEVEL> level_;
+    std::atomic<const LoggerSettings*> settings_;
+    boost::shared_ptr<const LoggerSettings> current_settings_;
+    std::vector<boost::shared_ptr<const LoggerSettings> > retired_settings_;
+    LogConfig conf_;
+
     unsigned long not_flushed_num_; // the num of logs not to be flushed
 
+    // the flush stats
+    struct timeval dirty_since_;    // the time of the first log not flushed
+    bool not_synced_;               // flushed since the last sync()
+    unsigned long long flush_count_;
+    unsigned long long timer_flush_count_;
+    unsigned long long fsync_count_;
+    unsigned long long max_dirty_age_us_;
+
+    // repeat_window_ms: the copies of a log right after it, in this long from
+    // it, are only counted, then written as "last message repeated N times"
+    bool has_last_;
+    uint64_t last_hash_;            // of the last log written
+    ENUM_LOG_LEVEL last_level_;
+    struct timeval run_since_;      // when the last log written was made
+    struct timeval last_when_;      // of its last copy
+    unsigned long repeated_;        // its copies not written
+    std::string repeat_line_;
+
     ENUM_LOGGER_STATUS status_;
+    boost::shared_ptr<Logger> successor_;   // once RETIRED
     boost::mutex mutex_;
+
+    std::string line_;  // the final text of a log given to log(), reused
 };
 
 
@@ -71,11 +200,17 @@ private:
 class FileLogger: public Logger {
 public:
     FileLogger();
+    // file_backend defaults to 'default_backend' (log_dest = 4 is io_uring);
+    // FILE_BACKEND_MMAP (log_dest = 3) can't be changed by it
+    explicit FileLogger(ENUM_LOG_FILE_BACKEND default_backend);
     FileLogger(const std::string& path,
             const std::string& base_name,
             const std::string& suffix,
             ENUM_LOG_LEVEL level,
-            unsigned long flush_num);
+            unsigned long flush_num,
+            ENUM_LOG_TIME_PRECISION time_precision,
+            ENUM_LOG_FILE_BACKEND backend,
+            unsigned long buffer_size);
 
     virtual ~FileLogger();
 
@@ -83,8 +218,9 @@ protected:
     virtual bool configImpl(const LogConfig& conf);
     virtual bool openImpl();
     virtual void closeImpl();
-    virtual bool logImpl(const std::string& msg, ENUM_LOG_LEVEL level);
+    virtual bool logImpl(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when);
     virtual void flush();
+    virtual void sync();
 
 private:
     // disabled methods
@@ -99,7 +235,11 @@ private:
     std::string file_path_;
     std::string file_base_name_;
     std::string file_suffix_;
-    std::fstream file_;
+
+    ENUM_LOG_FILE_BACKEND default_backend_;
+    ENUM_LOG_FILE_BACKEND backend_;
+    unsigned long buffer_size_;
+    boost::shared_ptr<LogFile> file_;
 };
 
 
@@ -115,7 +255,7 @@ protected:
     virtual bool configImpl(const LogConfig& conf);
     virtual bool openImpl();
     virtual void closeImpl();
-    virtual bool logImpl(const std::string& msg, ENUM_LOG_LEVEL level);
+    virtual bool logImpl(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when);
     virtual void flush();
 
 private:
@@ -127,6 +267,22 @@ private:
 //
 // class RollingFileLogger
 //
+// Starts a new file every day or hour (rotate_interval), and when the file
+// reaches rotate_size_mb. The file being written is always <name>; the old
+// ones are renamed to <name>.2012-08-23 (or <name>.2012-08-23-10 hourly),
+// with "-1", "-2" ... added if the name is taken.
+//
+// The logs are written to a LogFile directly, under the lock of Logger::log()
+// only. When the next file starts is worked out once per file, as an epoch
+// deadline, so a log costs two integer compares before it's written.
+//
+// A rotator thread keeps the next file opened ahead as <name>.next. The
+// logging thread only swaps it in and hands the old file over; the rotator
+// closes the old file, renames it and <name>.next, and opens the next one.
+// If the next file isn't ready yet, the logs go to the current file a little
+// longer. With compress_rotated = 1 the renamed files are then gzipped by a
+// LogCompressor.
+//
 class RollingFileLogger : public Logger {
 public:
     RollingFileLogger();
@@ -134,11 +290,13 @@ public:
 
 protected:
     virtual bool configImpl(const LogConfig& conf);
+    // rotate_size_mb and rotate_interval
+    virtual void reconfigImpl(const LogConfig& conf);
     virtual bool openImpl();
     virtual void closeImpl();
-    virtual bool logImpl(const std::string& msg, ENUM_LOG_LEVEL level);
-    virtual void setLevelImpl(ENUM_LOG_LEVEL new_level);
+    virtual bool logImpl(const char* line, size_t len, ENUM_LOG_LEVEL level, const struct timeval& when);
     virtual void flush();
+    virtual void sync();
 
 private:
     // disabled methods
@@ -146,20 +304,54 @@ private:
     const RollingFileLogger& operator=(const RollingFileLogger& rhs);
 
 private:
-    void rotateFile(const struct tm& old_date, const struct tm& new_date);
-    void getCurrentDate(struct tm& date);
+    // a file swapped out, for the rotator to close and rename
+    struct RetiredFile {
+        boost::shared_ptr<LogFile> file;
+        struct tm created_time;
+        ENUM_LOG_ROTATE_INTERVAL interval;  // when it was created
+    };
+
+    static bool getRotateConf(const LogConfig& conf, unsigned long long& size, ENUM_LOG_ROTATE_INTERVAL& interval);
+    static std::string getTimeDesc(const struct tm& created_time, ENUM_LOG_ROTATE_INTERVAL interval);
+
     void setDefaultConf();
-    std::string getFileNameByDate(const struct tm& date);
+    boost::shared_ptr<LogFile> openFile(const std::string& file_name) const;
+    std::string getCurrentFileName() const;
+    std::string getNextFileName() const;
+    void startPeriod(time_t now);
+    void setNextRotateTime();
+    void rotate(const struct timeval& when);
+
+    void runRotator();
+    void retireFile(const RetiredFile& file);
+    void stopRotator();
 
 private:
     std::string file_path_;
     std::string file_base_name_;
     std::string file_suffix_;
+    ENUM_LOG_FILE_BACKEND backend_;
+    unsigned long buffer_size_;
+    unsigned long long rotate_size_;    // bytes, ULLONG_MAX for no limit
+    ENUM_LOG_ROTATE_INTERVAL rotate_interval_;
+    unsigned long compress_;
+    unsigned long compress_level_;
+    unsigned long compress_cpu_percent_;
 
-    // Rolling file logger uses a "file logger" to write log
-    boost::shared_ptr<Logger> file_logger_;
+    boost::shared_ptr<LogFile> file_;   // <name>
 
     struct tm last_created_time_;
+    time_t next_rotate_time_;   // the start of the next day or hour
+
+    // shared with the rotator thread
+    boost::shared_ptr<LogFile> next_file_;          // opened on <name>.next
+    std::deque<RetiredFile> retired_;
+    bool rotator_running_;
+    boost::mutex rotator_mutex_;
+    boost::condition_variable rotator_cond_;
+    boost::thread rotator_thread_;
+
+    boost::shared_ptr<LogCompressor> compressor_;
 };
 
 #endif /* LOGGER_H_ */
@@ -0,0 +1,229 @@
+/*
+ * MmapFile.cpp
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "MmapFile.h"
+#include "common.h"
+
+
+using namespace std;
+
+
+// not text: a log file written by another backend doesn't end with it
+static const char MMAP_TRAILER_MAGIC[8] = { '\0', 'A', 'L', 'Y', 'S', 'M', 'A', 'P' };
+
+static off_t get_page_size() {
+    return sysconf(_SC_PAGESIZE);
+}
+
+
+MmapFile::MmapFile(size_t chunk_size):
+    fd_(-1),
+    chunk_size_(0),
+    length_(0),
+    map_(NULL),
+    map_offset_(0),
+    trailer_(NULL) {
+    // whole pages, as the chunks are mapped one by one; and two of them at
+    // least, so that the next chunk, mapped from the page of the end of the
+    // logs, always goes further than the current one
+    const size_t page_size = get_page_size();
+    chunk_size_ = (chunk_size + page_size - 1) / page_size * page_size;
+    if (chunk_size_ < 2 * page_size) {
+        chunk_size_ = 2 * page_size;
+    }
+}
+
+MmapFile::~MmapFile() {
+    close();
+}
+
+bool MmapFile::open(const string& file_name) {
+    if (fd_ >= 0) {
+        Assert(false, "The file is already opened!");
+        return true;
+    }
+
+    fd_ = ::open(file_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        LOG_TO_STDERR("Failed to open <%s>: %s", file_name.c_str(), strerror(errno));
+        return false;
+    }
+    file_name_ = file_name;
+
+    // append after the logs already there, without the padding of a crash
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        LOG_TO_STDERR("Failed to stat <%s>: %s", file_name.c_str(), strerror(errno));
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    length_ = st.st_size;
+    if (readTrailer(fd_, st.st_size, length_) && ftruncate(fd_, length_) != 0) {
+        LOG_TO_STDERR("Failed to trim <%s>: %s", file_name.c_str(), strerror(errno));
+    }
+
+    if (!mapChunkAt(length_ / get_page_size() * get_page_size())) {
+        if (ftruncate(fd_, length_) != 0) {
+            LOG_TO_STDERR("Failed to trim <%s>: %s", file_name.c_str(), strerror(errno));
+        }
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void MmapFile::close() {
+    if (fd_ < 0) {
+        return;
+    }
+
+    unmap();
+
+    // drop the padding and the trailer
+    if (ftruncate(fd_, length_) != 0) {
+        LOG_TO_STDERR("Failed to trim <%s>: %s", file_name_.c_str(), strerror(errno));
+    }
+
+    ::close(fd_);
+    fd_ = -1;
+}
+
+bool MmapFile::isOpen() const {
+    return fd_ >= 0;
+}
+
+bool MmapFile::append(const char* data, size_t len) {
+    if (NULL == map_) {
+        return false;
+    }
+
+    while (len > 0) {
+        // up to the trailer
+        const size_t room = map_offset_ + chunk_size_ - sizeof(Trailer) - length_;
+        if (0 == room) {
+            // the next chunk starts at the page of the end of the logs, which
+            // has the trailer of this one in it; the logs overwrite it
+            const off_t page_size = get_page_size();
+            unmap();
+            if (!mapChunkAt(length_ / page_size * page_size)) {
+                return false;
+            }
+            continue;
+        }
+
+        const size_t n = len < room ? len : room;
+        memcpy(map_ + (length_ - map_offset_), data, n);
+        data += n;
+        len -= n;
+        length_ += n;
+
+        // the logs first, then the length that covers them
+        trailer_->length = length_;
+    }
+
+    return true;
+}
+
+bool MmapFile::sync() {
+    if (fd_ >= 0 && fdatasync(fd_) != 0) {
+        LOG_TO_STDERR("Failed to sync <%s>: %s", file_name_.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+unsigned long long MmapFile::getLength() const {
+    return length_;
+}
+
+bool MmapFile::trim(const string& file_name) {
+    const int fd = ::open(file_name.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool trimmed = false;
+    struct stat st;
+    off_t length = 0;
+    if (0 == fstat(fd, &st) && readTrailer(fd, st.st_size, length)) {
+        if (0 == ftruncate(fd, length)) {
+            LOG_TO_STDERR("Trimmed <%s> to %lld bytes, left padded by mmap", file_name.c_str(),
+                    static_cast<long long>(length));
+            trimmed = true;
+        }
+        else {
+            LOG_TO_STDERR("Failed to trim <%s>: %s", file_name.c_str(), strerror(errno));
+        }
+    }
+
+    ::close(fd);
+    return trimmed;
+}
+
+// the length in the trailer at the end of the file, if it has one
+bool MmapFile::readTrailer(int fd, off_t size, off_t& length) {
+    if (size < static_cast<off_t>(sizeof(Trailer))) {
+        return false;
+    }
+
+    Trailer trailer;
+    if (pread(fd, &trailer, sizeof(trailer), size - sizeof(trailer)) != sizeof(trailer)
+            || memcmp(trailer.magic, MMAP_TRAILER_MAGIC, sizeof(trailer.magic)) != 0
+            || trailer.length > static_cast<uint64_t>(size - sizeof(trailer))) {
+        return false;
+    }
+
+    length = trailer.length;
+    return true;
+}
+
+// maps [offset, offset + chunk_size_) as the end of the file, with the
+// trailer in its last bytes. The disk space is allocated first, so that a full
+// disk fails here and not with a SIGBUS in append(); then the trailer is
+// written at the new end with one pwrite(), so that the file always ends with
+// a valid one.
+bool MmapFile::mapChunkAt(off_t offset) {
+    const off_t end = offset + chunk_size_;
+
+    if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, offset, chunk_size_) != 0 && errno != EOPNOTSUPP) {
+        LOG_TO_STDERR("Failed to extend <%s>: %s", file_name_.c_str(), strerror(errno));
+        return false;
+    }
+
+    Trailer trailer;
+    memcpy(trailer.magic, MMAP_TRAILER_MAGIC, sizeof(trailer.magic));
+    trailer.length = length_;
+    if (pwrite(fd_, &trailer, sizeof(trailer), end - sizeof(trailer)) != sizeof(trailer)) {
+        LOG_TO_STDERR("Failed to extend <%s>: %s", file_name_.c_str(), strerror(errno));
+        return false;
+    }
+
+    void* addr = mmap(NULL, chunk_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, offset);
+    if (MAP_FAILED == addr) {
+        LOG_TO_STDERR("Failed to map <%s>: %s", file_name_.c_str(), strerror(errno));
+        return false;
+    }
+
+    map_ = static_cast<char*>(addr);
+    map_offset_ = offset;
+    trailer_ = reinterpret_cast<Trailer*>(map_ + chunk_size_ - sizeof(Trailer));
+    return true;
+}
+
+void MmapFile::unmap() {
+    if (map_ != NULL) {
+        munmap(map_, chunk_size_);
+        map_ = NULL;
+        trailer_ = NULL;
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * MmapFile.h
+ *
+ *  Note:
+ *  A log file written through mmap(), the "mmap" backend of FileLogger and
+ *  RollingFileLogger (file_backend = 3, and log_dest = 3). There's no
+ *  syscall per log: the file is extended by mmap_chunk_size at a time and
+ *  the logs are copied into the mapping, whose pages belong to the kernel at
+ *  once, so they survive a crash of the process without any flush.
+ *
+ *  While the file is open its end is padding, and its last bytes are a
+ *  trailer with the length of the logs, updated with every log; close()
+ *  trims the file to that length. A file left padded by a crash is trimmed
+ *  by trim() the next time it's opened, by any backend, so a '\0' at the end
+ *  of the logs is kept.
+ *
+ *  Not thread safe: the owner locks it.
+ */
+
+#ifndef MMAPFILE_H_
+#define MMAPFILE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+
+
+class MmapFile {
+public:
+    // 'chunk_size' is rounded up to whole pages, two at least
+    explicit MmapFile(size_t chunk_size);
+    virtual ~MmapFile();
+
+    bool open(const std::string& file_name);
+    void close();
+    bool isOpen() const;
+
+    bool append(const char* data, size_t len);
+
+    // fdatasync(), which writes back the pages dirtied through the mapping too
+    bool sync();
+
+    // the bytes of logs in the file
+    unsigned long long getLength() const;
+
+    // trims a file left padded by a crash to its logs; false if it isn't one
+    static bool trim(const std::string& file_name);
+
+private:
+    // disabled methods
+    MmapFile(const MmapFile& rhs);
+    const MmapFile& operator=(const MmapFile& rhs);
+
+private:
+    struct Trailer {
+        char magic[8];
+        uint64_t length;
+    };
+
+    static bool readTrailer(int fd, off_t size, off_t& length);
+    bool mapChunkAt(off_t offset);
+    void unmap();
+
+private:
+    std::string file_name_;
+    int fd_;
+    size_t chunk_size_;
+
+    off_t length_;          // the bytes of logs in the file
+    char* map_;             // the mapped chunk, starting at map_offset_, which
+    off_t map_offset_;      // ends the file
+    Trailer* trailer_;      // the last bytes of the chunk
+};
+
+#endif /* MMAPFILE_H_ */
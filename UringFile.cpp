@@ -0,0 +1,470 @@
+/*
+ * UringFile.cpp
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "UringFile.h"
+#include "common.h"
+
+
+using namespace std;
+
+
+//
+// helper functions:
+//
+
+static const size_t URING_BUFFER_ALIGNMENT = 4096;
+static const uint64_t URING_FSYNC_USER_DATA = ~0ULL;
+
+static int uring_setup(unsigned int entries, struct io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int ring_fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int ring_fd, unsigned int opcode, const void* arg, unsigned int num) {
+    return syscall(__NR_io_uring_register, ring_fd, opcode, arg, num);
+}
+
+// helper end.
+
+
+bool UringFile::isAvailable() {
+    static const bool available = [] {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        const int fd = uring_setup(2, &params);
+        if (fd < 0) {
+            return false;
+        }
+        ::close(fd);
+        return true;
+    }();
+    return available;
+}
+
+UringFile::UringFile(size_t buffer_size, unsigned int buffer_num):
+    fd_(-1),
+    offset_(0),
+    current_(0),
+    in_flight_(0),
+    writes_in_flight_(0),
+    fsync_in_flight_(false),
+    fsync_wanted_(false),
+    fixed_buffers_(false),
+    has_data_(false),
+    ring_fd_(-1),
+    sq_entries_(0),
+    sq_ring_(MAP_FAILED),
+    sq_ring_size_(0),
+    cq_ring_(MAP_FAILED),
+    cq_ring_size_(0),
+    sqes_(NULL),
+    sqes_size_(0) {
+    buffer_size_ = (buffer_size + URING_BUFFER_ALIGNMENT - 1) / URING_BUFFER_ALIGNMENT * URING_BUFFER_ALIGNMENT;
+    if (0 == buffer_size_) {
+        buffer_size_ = URING_BUFFER_ALIGNMENT;
+    }
+    if (buffer_num < 2) {
+        buffer_num = 2;
+    }
+
+    for (unsigned int i = 0; i < buffer_num; ++i) {
+        void* mem = NULL;
+        if (posix_memalign(&mem, URING_BUFFER_ALIGNMENT, buffer_size_) != 0) {
+            break;
+        }
+        Buffer buffer = { static_cast<char*>(mem), 0, false, 0 };
+        buffers_.push_back(buffer);
+    }
+}
+
+UringFile::~UringFile() {
+    close();
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+        free(buffers_[i].data);
+    }
+}
+
+bool UringFile::open(const string& file_name) {
+    if (fd_ >= 0) {
+        Assert(false, "The file is already opened!");
+        return true;
+    }
+
+    if (buffers_.size() < 2) {
+        LOG_TO_STDERR("No memory for the io_uring buffers");
+        return false;
+    }
+
+    // not O_APPEND: every write has its own offset, see the header
+    fd_ = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        LOG_TO_STDERR("Failed to open <%s>: %s", file_name.c_str(), strerror(errno));
+        return false;
+    }
+
+    offset_ = lseek(fd_, 0, SEEK_END);
+    if (offset_ < 0 || !setupRing()) {
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    file_name_ = file_name;
+    current_ = 0;
+    has_data_ = false;
+    register_log_crash_file(this);
+    return true;
+}
+
+void UringFile::close() {
+    if (fd_ < 0) {
+        return;
+    }
+
+    unregister_log_crash_file(this);
+    submitBuffer(current_);
+    waitForAll();
+    if (fsync_wanted_) {
+        fdatasync(fd_);
+        fsync_wanted_ = false;
+    }
+    destroyRing();
+
+    ::close(fd_);
+    fd_ = -1;
+}
+
+bool UringFile::isOpen() const {
+    return fd_ >= 0;
+}
+
+bool UringFile::append(const char* data, size_t len) {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    // the fsync of an earlier flush may be waiting for its writes
+    if (fsync_wanted_) {
+        reapCompletions();
+        submitFsync();
+    }
+    has_data_ = true;
+
+    while (len > 0) {
+        Buffer& buffer = buffers_[current_];
+        const size_t room = buffer_size_ - buffer.used;
+        const size_t n = len < room ? len : room;
+        memcpy(buffer.data + buffer.used, data, n);
+        buffer.used += n;
+        data += n;
+        len -= n;
+
+        if (buffer.used == buffer_size_) {
+            if (!submitBuffer(current_)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool UringFile::flush() {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    if (!submitBuffer(current_)) {
+        return false;
+    }
+    fsync_wanted_ = true;
+    return submitFsync();
+}
+
+// in the signal handler: the writes in flight may never complete once the
+// process is gone, so they are made again by pwrite(), at the same offsets
+int UringFile::flushOnCrash() {
+    const int fd = fd_;
+    if (fd < 0 || !has_data_) {
+        return -1;
+    }
+
+    off_t end = offset_;
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+        const Buffer& buffer = buffers_[i];
+        const bool pending = (i == current_ && !buffer.in_flight);
+        if ((!buffer.in_flight && !pending) || 0 == buffer.used) {
+            continue;
+        }
+
+        log_pwrite_fully(fd, buffer.data, buffer.used, pending ? offset_ : buffer.offset);
+        if (pending) {
+            end = offset_ + buffer.used;
+        }
+    }
+
+    // the marker goes after the logs
+    lseek(fd, end, SEEK_SET);
+    return fd;
+}
+
+bool UringFile::setupRing() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    // a write per buffer and an fsync per flush at most, with room to spare
+    ring_fd_ = uring_setup(buffers_.size() * 4, &params);
+    if (ring_fd_ < 0) {
+        LOG_TO_STDERR("io_uring is not available: %s", strerror(errno));
+        return false;
+    }
+    sq_entries_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_ring_size_ > sq_ring_size_) {
+            sq_ring_size_ = cq_ring_size_;
+        }
+        cq_ring_size_ = sq_ring_size_;
+    }
+
+    sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == sq_ring_) {
+        LOG_TO_STDERR("Failed to map the io_uring: %s", strerror(errno));
+        destroyRing();
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_ = sq_ring_;
+    }
+    else {
+        cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == cq_ring_) {
+            LOG_TO_STDERR("Failed to map the io_uring: %s", strerror(errno));
+            destroyRing();
+            return false;
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (MAP_FAILED == sqes) {
+        LOG_TO_STDERR("Failed to map the io_uring: %s", strerror(errno));
+        destroyRing();
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // fixed buffers save the kernel mapping them on every write; they count
+    // against RLIMIT_MEMLOCK on older kernels, so plain writes if refused
+    vector<struct iovec> iovs(buffers_.size());
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+        iovs[i].iov_base = buffers_[i].data;
+        iovs[i].iov_len = buffer_size_;
+    }
+    fixed_buffers_ = 0 == uring_register(ring_fd_, IORING_REGISTER_BUFFERS, &iovs[0], iovs.size());
+    if (!fixed_buffers_) {
+        LOG_TO_STDERR("io_uring buffers not registered (%s), using plain writes", strerror(errno));
+    }
+
+    return true;
+}
+
+void UringFile::destroyRing() {
+    if (sqes_ != NULL) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = NULL;
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = MAP_FAILED;
+    if (sq_ring_ != MAP_FAILED) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = MAP_FAILED;
+    }
+    if (ring_fd_ >= 0) {
+        ::close(ring_fd_);     // also unregisters the buffers
+        ring_fd_ = -1;
+    }
+    in_flight_ = 0;
+    writes_in_flight_ = 0;
+    fsync_in_flight_ = false;
+}
+
+// writes the buffer at the end of the file and moves on to the next buffer
+bool UringFile::submitBuffer(unsigned int index) {
+    Buffer& buffer = buffers_[index];
+    if (0 == buffer.used) {
+        return true;
+    }
+
+    struct io_uring_sqe* sqe = getSqe();
+    if (NULL == sqe) {
+        return false;
+    }
+    sqe->opcode = fixed_buffers_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer.data);
+    sqe->len = buffer.used;
+    sqe->off = offset_;
+    sqe->buf_index = fixed_buffers_ ? index : 0;
+    sqe->user_data = index;
+
+    buffer.offset = offset_;
+    buffer.in_flight = true;
+    offset_ += buffer.used;
+    in_flight_++;
+    writes_in_flight_++;
+
+    commitSqe();
+    if (!enter(1, 0)) {
+        return false;
+    }
+
+    current_ = (index + 1) % buffers_.size();
+    return waitForBuffer(current_);
+}
+
+// Group commit: one fsync in flight at most, started once the writes before
+// it are done. The flushes meanwhile are covered by the next one. No
+// IOSQE_IO_DRAIN, which would hold the writes after it too.
+bool UringFile::submitFsync() {
+    if (!fsync_wanted_ || fsync_in_flight_ || writes_in_flight_ > 0) {
+        return true;
+    }
+
+    struct io_uring_sqe* sqe = getSqe();
+    if (NULL == sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd_;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe->user_data = URING_FSYNC_USER_DATA;
+    in_flight_++;
+    fsync_in_flight_ = true;
+    fsync_wanted_ = false;
+
+    commitSqe();
+    return enter(1, 0);
+}
+
+// a cleared entry at the tail of the submission queue
+struct io_uring_sqe* UringFile::getSqe() {
+    // keep the completion queue from overflowing too
+    reapCompletions();
+    while (in_flight_ >= sq_entries_) {
+        if (!enter(0, 1)) {
+            return NULL;
+        }
+        reapCompletions();
+    }
+
+    const unsigned int tail = *sq_tail_;
+    const unsigned int index = tail & *sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    return sqe;
+}
+
+// hands the entry from getSqe() to the kernel, once it's filled
+void UringFile::commitSqe() {
+    __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+}
+
+bool UringFile::enter(unsigned int to_submit, unsigned int min_complete) {
+    const unsigned int flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (uring_enter(ring_fd_, to_submit, min_complete, flags) < 0) {
+        if (EINTR == errno) {
+            continue;
+        }
+        LOG_TO_STDERR("io_uring_enter() failed for <%s>: %s", file_name_.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void UringFile::reapCompletions() {
+    unsigned int head = *cq_head_;
+    const unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+        in_flight_--;
+
+        if (URING_FSYNC_USER_DATA == cqe.user_data) {
+            fsync_in_flight_ = false;
+            if (cqe.res < 0) {
+                LOG_TO_STDERR("Failed to fsync <%s>: %s", file_name_.c_str(), strerror(-cqe.res));
+            }
+            continue;
+        }
+
+        Buffer& buffer = buffers_[cqe.user_data];
+
+        // a short or failed write: the rest goes the slow way, to the same place
+        const size_t written = cqe.res > 0 ? cqe.res : 0;
+        if (written < buffer.used) {
+            if (!log_pwrite_fully(fd_, buffer.data + written, buffer.used - written, buffer.offset + written)) {
+                LOG_TO_STDERR("Failed to write <%s>: %s", file_name_.c_str(),
+                        strerror(cqe.res < 0 ? -cqe.res : errno));
+            }
+        }
+
+        buffer.used = 0;
+        buffer.in_flight = false;
+        writes_in_flight_--;
+    }
+
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+}
+
+bool UringFile::waitForBuffer(unsigned int index) {
+    reapCompletions();
+    while (buffers_[index].in_flight) {
+        if (!enter(0, 1)) {
+            return false;
+        }
+        reapCompletions();
+    }
+    return true;
+}
+
+void UringFile::waitForAll() {
+    reapCompletions();
+    while (in_flight_ > 0) {
+        if (!enter(0, 1)) {
+            return;
+        }
+        reapCompletions();
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * UringFile.h
+ *
+ *  Note:
+ *  A log file written through io_uring (log_dest = 4), so the logging thread
+ *  doesn't wait in write(2) when the disk is slow. The logs are copied into
+ *  one of a few buffers registered with the ring; a full buffer, or the one
+ *  in use when flush() is called, is submitted as a WRITE_FIXED at the next
+ *  offset of the file, and the next buffer is taken. The caller only waits
+ *  when every buffer is still being written.
+ *
+ *  The offsets are given explicitly, so the logs stay in order in the file
+ *  whatever order the writes complete in. flush() also asks for an fsync
+ *  through the ring, started once the writes before it are done; flushes
+ *  made while an fsync is running share the next one.
+ *
+ *  The crash handler (crash_handler = 1) writes the buffer in use, and the
+ *  ones in flight, again with pwrite() at their offsets.
+ *
+ *  Talks to the kernel by the raw syscalls, no liburing needed. open() fails
+ *  with isAvailable() false on kernels without io_uring.
+ *
+ *  Not thread safe: the owner locks it.
+ */
+
+#ifndef URINGFILE_H_
+#define URINGFILE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+#include "LogCrashHandler.h"
+
+
+class UringFile: public LogCrashFile {
+public:
+    UringFile(size_t buffer_size, unsigned int buffer_num);
+    virtual ~UringFile();
+
+    // false if io_uring can't be used here at all
+    static bool isAvailable();
+
+    bool open(const std::string& file_name);
+    void close();
+    bool isOpen() const;
+
+    bool append(const char* data, size_t len);
+
+    // submits what's buffered and asks for an fsync after it, doesn't wait
+    bool flush();
+
+    // see LogCrashHandler.h
+    virtual int flushOnCrash();
+
+private:
+    // disabled methods
+    UringFile(const UringFile& rhs);
+    const UringFile& operator=(const UringFile& rhs);
+
+private:
+    struct Buffer {
+        char* data;
+        size_t used;
+        bool in_flight;
+        off_t offset;       // where it's written to
+    };
+
+    bool setupRing();
+    void destroyRing();
+    bool submitBuffer(unsigned int index);
+    bool submitFsync();
+    struct io_uring_sqe* getSqe();
+    void commitSqe();
+    bool enter(unsigned int to_submit, unsigned int min_complete);
+    void reapCompletions();
+    bool waitForBuffer(unsigned int index);
+    void waitForAll();
+
+private:
+    std::string file_name_;
+    int fd_;
+    off_t offset_;          // the end of the file, including what's in flight
+
+    size_t buffer_size_;
+    std::vector<Buffer> buffers_;
+    unsigned int current_;
+    unsigned int in_flight_;    // the ops submitted and not completed
+    unsigned int writes_in_flight_;
+    bool fsync_in_flight_;
+    bool fsync_wanted_;         // flushed since the last fsync started
+    bool fixed_buffers_;        // the buffers are registered with the ring
+    bool has_data_;             // appended to since opened, for the crash marker
+
+    // the ring
+    int ring_fd_;
+    unsigned int sq_entries_;
+    void* sq_ring_;
+    size_t sq_ring_size_;
+    void* cq_ring_;
+    size_t cq_ring_size_;
+    struct io_uring_sqe* sqes_;
+    size_t sqes_size_;
+
+    unsigned int* sq_head_;
+    unsigned int* sq_tail_;
+    unsigned int* sq_mask_;
+    unsigned int* sq_array_;
+    unsigned int* cq_head_;
+    unsigned int* cq_tail_;
+    unsigned int* cq_mask_;
+    struct io_uring_cqe* cqes_;
+};
+
+#endif /* URINGFILE_H_ */
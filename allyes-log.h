@@ -26,6 +26,48 @@
 //
 // #5
 // void LOG_SET_LEVEL(ENUM_LOG_LEVEL level);
+// bool LOG_SET_SINK_LEVEL(const string& sink, ENUM_LOG_LEVEL level);
+//
+// #6
+// allyes::log::debug/info/warning/error("user {} took {} us", id, us);
+// Every {} is replaced by the next argument ("{{" and "}}" for the braces).
+// The argument types are checked at compile time, and so is the number of {}
+// with a C++20 compiler.
+//
+// #7
+// bool LOG_GET_FLUSH_STATS(LogFlushStats& stats);
+//
+// #8
+// LogCategory* LOG_GET_CATEGORY(const string& name);
+// LOG_CAT_DEBUG/INFO/WARNING/ERROR(category, format_string, ...)
+// void LOG_SET_CATEGORY_LEVEL(const string& name, ENUM_LOG_LEVEL level);
+//
+// #9
+// LOG_DEBUG/INFO/WARNING/ERROR_EVERY_N(n, format_string, ...)
+// LOG_DEBUG/INFO/WARNING/ERROR_FIRST_N(n, format_string, ...)
+// LOG_DEBUG/INFO/WARNING/ERROR_RATE(per_sec, format_string, ...)
+// Limit the logs of one call site: the 1st of every n calls, the first n calls
+// only, or at most per_sec a second on average (with bursts of up to a second
+// of them). A call that is skipped isn't formatted at all; the next log written
+// by the site ends with "(<num> suppressed)".
+//
+// #10
+// bool LOG_GET_QUEUE_STATS(LogQueueStats& stats);
+//
+// #11
+// bool LOG_GET_METRICS(LogMetrics& metrics);
+//
+// #12
+// LOG_DEBUG/INFO/WARNING/ERROR_KV(msg, LOG_KV(key, value), ...)
+// allyes::log::debug/info/warning/error_kv(msg, allyes::log::kv(key, value), ...);
+// A log with typed fields. log_format = json writes them as the members of the
+// object of the log, next to "time", "level" and "msg"; the text format as
+// " key=value" after the message.
+//
+// The logs with a level lower than the current one are dropped before any of
+// their arguments is evaluated or formatted.
+// Define LOG_COMPILE_MIN_LEVEL (0: DEBUG, 1: INFO, 2: WARNING, 3: ERROR) before
+// including this file to remove the lower-level LOG_XXX calls from the build.
 
 
 #ifndef _LOG_H_
@@ -33,7 +75,14 @@
 
 #include <time.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#include <utility>
 
 
 enum ENUM_LOG_LEVEL {
@@ -44,91 +93,992 @@ enum ENUM_LOG_LEVEL {
     LOG_LEVEL_MAX   // DEBUG <= level < MAX !
 };
 
+#ifndef LOG_COMPILE_MIN_LEVEL
+#define LOG_COMPILE_MIN_LEVEL 0
+#endif
+
+// the current level of the log system, updated by LOG_SYS_INIT and LOG_SET_LEVEL.
+// used only inside this file !!!
+extern std::atomic<int> g_LogLevelGate;
+
+#define LOG_LEVEL_ENABLED(level)                                            \
+    ((level) >= LOG_COMPILE_MIN_LEVEL &&                                    \
+     (level) >= g_LogLevelGate.load(std::memory_order_relaxed))
+
+// used only inside this file !!!
+inline const char* log_format_cstr(const char* format) { return format; }
+inline const char* log_format_cstr(const std::string& format) { return format.c_str(); }
+
+// printf() compatible; the usual conversions are done without libc, and a
+// format without any conversion is copied at once
+int log_snprintf(char* buf, size_t size, const char* format, ...);
+int log_vsnprintf(char* buf, size_t size, const char* format, va_list args);
+
+// the decimal digits of 'value', written backwards from 'end'; returns the
+// first digit
+char* log_format_u64(char* end, uint64_t value);
+
+// the shortest text that reads back as the same double
+const size_t LOG_DOUBLE_BUF_SIZE = 32;
+size_t log_format_double(char* buf, double value);
+
+// the fields of LOG_XXX_KV follow the text of the log, whose length is given
+// to LOG_OUT apart, each as
+//     <type> <key length> <key> <value length> <value>
+// the lengths being uint32_t, so any byte can be in the text or a value.
+// used only inside this file and by the log system !!!
+const char LOG_FIELD_STRING = 's';
+const char LOG_FIELD_NUMBER = 'n';     // written as it is in JSON
+const char LOG_FIELD_BOOL = 'b';       // "true" or "false"
+
+
+//
+// binary mode, used only inside this file !!!
+//
+
+extern std::atomic<bool> g_LogBinaryMode;
+
+#define LOG_BINARY_MODE_ON() g_LogBinaryMode.load(std::memory_order_relaxed)
+
+// only a string literal (or another const char array) is sure to have the
+// same text on every call, as the id is kept by the call site; a const char*,
+// a char array or a std::string is formatted as text
+template <typename T>
+struct LogFormatIsLiteral { static const bool value = false; };
+template <size_t N>
+struct LogFormatIsLiteral<const char[N]> { static const bool value = true; };
+
+#define LOG_FORMAT_IS_LITERAL(format_string)                                \
+    LogFormatIsLiteral<std::remove_reference<decltype(format_string)>::type>::value
+
+enum ENUM_LOG_BINARY_ARG_TYPE {
+    LOG_BINARY_ARG_INT = 1,     // int64_t
+    LOG_BINARY_ARG_UINT,        // uint64_t
+    LOG_BINARY_ARG_DOUBLE,      // double
+    LOG_BINARY_ARG_STRING,      // uint32_t length + the chars, no '\0'
+    LOG_BINARY_ARG_POINTER,     // uint64_t
+};
+
+const size_t LOG_BINARY_MAX_RECORD_LEN = 4096;
+
+struct LogBinaryBuf {
+    char* pos;
+    char* end;
+    bool overflow;
+};
+
+unsigned int log_binary_register_format(const char* format);
+void log_binary_begin(LogBinaryBuf& buf, unsigned int format_id, ENUM_LOG_LEVEL level, size_t arg_num);
+void log_binary_end(LogBinaryBuf& buf, char* record, unsigned int format_id, ENUM_LOG_LEVEL level);
+
+inline void log_binary_put(LogBinaryBuf& buf, const void* data, size_t len) {
+    if (len <= static_cast<size_t>(buf.end - buf.pos)) {
+        memcpy(buf.pos, data, len);
+        buf.pos += len;
+    }
+    else {
+        buf.overflow = true;    // log_binary_end() will drop the record
+    }
+}
+
+inline void log_binary_put_typed(LogBinaryBuf& buf, ENUM_LOG_BINARY_ARG_TYPE type, const void* data, size_t len) {
+    const uint8_t tag = type;
+    log_binary_put(buf, &tag, sizeof(tag));
+    log_binary_put(buf, data, len);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+log_binary_arg(LogBinaryBuf& buf, T value) {
+    const int64_t v = value;
+    log_binary_put_typed(buf, LOG_BINARY_ARG_INT, &v, sizeof(v));
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+log_binary_arg(LogBinaryBuf& buf, T value) {
+    const uint64_t v = value;
+    log_binary_put_typed(buf, LOG_BINARY_ARG_UINT, &v, sizeof(v));
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type
+log_binary_arg(LogBinaryBuf& buf, T value) {
+    const int64_t v = value;
+    log_binary_put_typed(buf, LOG_BINARY_ARG_INT, &v, sizeof(v));
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+log_binary_arg(LogBinaryBuf& buf, T value) {
+    const double v = value;
+    log_binary_put_typed(buf, LOG_BINARY_ARG_DOUBLE, &v, sizeof(v));
+}
+
+inline void log_binary_arg(LogBinaryBuf& buf, const char* str) {
+    if (NULL == str) {
+        str = "(null)";
+    }
+    const uint32_t len = strlen(str);
+    log_binary_put_typed(buf, LOG_BINARY_ARG_STRING, &len, sizeof(len));
+    log_binary_put(buf, str, len);
+}
+
+inline void log_binary_arg(LogBinaryBuf& buf, char* str) {
+    log_binary_arg(buf, const_cast<const char*>(str));
+}
+
+template <typename T>
+inline void log_binary_arg(LogBinaryBuf& buf, T* ptr) {
+    const uint64_t v = reinterpret_cast<uintptr_t>(ptr);
+    log_binary_put_typed(buf, LOG_BINARY_ARG_POINTER, &v, sizeof(v));
+}
+
+inline void log_binary_args(LogBinaryBuf&) {
+}
+
+template <typename T, typename... Rest>
+inline void log_binary_args(LogBinaryBuf& buf, const T& value, const Rest&... rest) {
+    log_binary_arg(buf, value);
+    log_binary_args(buf, rest...);
+}
+
+template <typename... Args>
+inline void log_binary_write(unsigned int format_id, ENUM_LOG_LEVEL level, const Args&... args) {
+    char record[LOG_BINARY_MAX_RECORD_LEN];
+    LogBinaryBuf buf = { record, record + sizeof(record), false };
+
+    log_binary_begin(buf, format_id, level, sizeof...(args));
+    log_binary_args(buf, args...);
+    log_binary_end(buf, record, format_id, level);
+}
+
+// used only inside this file !!!
+#define LOG_IMPL_TEXT(level, format_string, ...)							\
+    allyes::log::detail::log_printf(level, NULL, log_format_cstr(format_string), ##__VA_ARGS__);
+
 // used only inside this file !!!
+// In binary mode (log_binary = 1) a log with a string literal as the format is
+// not formatted at all: the id of its format, the time, the level and the raw
+// arguments are written, and allyes-log-decode turns them into text later.
 #define LOG_IMPL(level, format_string, ...)									\
-{																			\
-    std::string format("%s");                                               \
-    format.append(format_string);                                           \
-                                                                            \
-    const size_t max_log_text_len = 4096;                                   \
-    char str_log[max_log_text_len + 1];			    					    \
-                                                                            \
-    const int n = snprintf(str_log, sizeof(str_log), format.c_str(), "", ##__VA_ARGS__);\
-    																		\
-	if(n >= 0) {															\
-		if( (unsigned int)(n) < sizeof(str_log) ) {							\
-			LOG_OUT(str_log, level);										\
-		}																	\
-		else {																\
-			std::string msg(n+1, '\0'); 									\
-			snprintf(&msg[0], n+1, format.c_str(), "", ##__VA_ARGS__);      \
-			LOG_OUT(msg.c_str(), level);									\
-		} 																	\
-	}																		\
+if (LOG_LEVEL_ENABLED(level)) {												\
+    if (LOG_BINARY_MODE_ON() && LOG_FORMAT_IS_LITERAL(format_string)) {     \
+        static const unsigned int log_format_id_ =                          \
+            log_binary_register_format(log_format_cstr(format_string));     \
+        log_binary_write(log_format_id_, level, ##__VA_ARGS__);             \
+    }                                                                       \
+    else LOG_IMPL_TEXT(level, format_string, ##__VA_ARGS__);                \
 }
 
 // interface #0, call this function before you use this LOG SYSTEM !!!
+// With config_reload = 1 the file is watched and applied again when saved.
 bool LOG_SYS_INIT(const std::string& log_config_file);
 
 // interface #1
+#if LOG_COMPILE_MIN_LEVEL <= 0
 #define LOG_DEBUG(format_string,...)										\
 {																		    \
 	LOG_IMPL(LOG_LEVEL_DEBUG, format_string, ##__VA_ARGS__);				\
 }
+#else
+#define LOG_DEBUG(format_string,...) {}
+#endif
 
 // interface #2
+#if LOG_COMPILE_MIN_LEVEL <= 1
 #define LOG_INFO(format_string,...)										    \
 {																		    \
 	LOG_IMPL(LOG_LEVEL_INFO, format_string, ##__VA_ARGS__);				    \
 }
+#else
+#define LOG_INFO(format_string,...) {}
+#endif
 
 // interface #3
+#if LOG_COMPILE_MIN_LEVEL <= 2
 #define LOG_WARNING(format_string,...)										\
 {																		    \
 	LOG_IMPL(LOG_LEVEL_WARNING, format_string, ##__VA_ARGS__);				\
 }
+#else
+#define LOG_WARNING(format_string,...) {}
+#endif
 
 // interface #4
+#if LOG_COMPILE_MIN_LEVEL <= 3
 #define LOG_ERROR(format_string,...)										\
 {																		    \
 	LOG_IMPL(LOG_LEVEL_ERROR, format_string, ##__VA_ARGS__);				\
 }
+#else
+#define LOG_ERROR(format_string,...) {}
+#endif
 
 // interface #5
+// sets log_level: the level of the main sinks (see 'sinks' in log_config.conf)
+// without a "<name>.log_level" of their own, and so of the categories without
+// a level or sinks of their own. A sink with a level of its own keeps it.
 void LOG_SET_LEVEL(ENUM_LOG_LEVEL level);
+// sets the level of the sink 'sink', of 'sinks' or 'category_sinks'; false if
+// there's none
+bool LOG_SET_SINK_LEVEL(const std::string& sink, ENUM_LOG_LEVEL level);
+
+// interface #7
+// how the logs have been flushed to the file so far, summed up over the sinks;
+// false before LOG_SYS_INIT
+struct LogFlushStats {
+    unsigned long long flushes;         // all of them
+    unsigned long long timer_flushes;   // by the timer of flush_interval_ms
+    unsigned long long fsyncs;          // flush_fsync = 1
+    unsigned long dirty_age_ms;         // how long the oldest log not flushed has waited
+    unsigned long max_dirty_age_ms;     // the longest a log has waited for its flush
+};
+bool LOG_GET_FLUSH_STATS(LogFlushStats& stats);
+
+// interface #8
+// A named category of logs, like "net.http", whose level is set apart from the
+// others: the level of the longest of "net.http", "net" configured by
+// "category_level.<name>", else the level of its sinks. Its logs go to the
+// sinks of "category_sinks.<name>" the same way, else to the main ones.
+// See log_config.conf.
+//
+// Get the handle once and keep it; checking its level is one atomic load.
+class LogSinks;
+class LogCategory {
+public:
+    bool enabled(ENUM_LOG_LEVEL level) const {
+        return level >= LOG_COMPILE_MIN_LEVEL && level >= level_.load(std::memory_order_relaxed);
+    }
+    const std::string& getName() const { return name_; }
+
+private:
+    friend class LogSys;
+    explicit LogCategory(const std::string& name): name_(name), level_(LOG_LEVEL_DEBUG), own_level_(false), sinks_(NULL) {}
+    LogCategory(const LogCategory&);
+    const LogCategory& operator=(const LogCategory&);
+
+    const std::string name_;
+    std::atomic<int> level_;        // the level in effect, kept up to date by the log system
+    std::atomic<bool> own_level_;   // set by category_level, which overrides log_level of the sinks
+    std::atomic<LogSinks*> sinks_;  // NULL for the main sinks
+};
+
+// never NULL; the handle lives as long as the program. It can be got before
+// LOG_SYS_INIT, which works out its level then
+LogCategory* LOG_GET_CATEGORY(const std::string& name);
+// for the category and the ones under it that have no level of their own
+void LOG_SET_CATEGORY_LEVEL(const std::string& name, ENUM_LOG_LEVEL level);
+
+// interface #10
+// the queue of log_async = 1: what's in it, and the logs it has dropped, by
+// async_overflow; false if log_async is off or before LOG_SYS_INIT
+struct LogQueueStats {
+    unsigned long queued;               // logs queued or being written
+    unsigned long long queued_bytes;    // their bytes, see async_queue_bytes
+    unsigned long long max_queued_bytes;
+    unsigned long long blocked;         // logs whose caller waited for room
+    unsigned long long dropped_newest;  // "drop_newest"
+    unsigned long long dropped_lowest_level;    // "drop_lowest_level_first", queued or new
+    unsigned long long dropped_timeout; // "block_with_timeout"
+};
+bool LOG_GET_QUEUE_STATS(LogQueueStats& stats);
+
+// interface #11
+// what logging has cost so far, summed up over the threads; see also
+// metrics_interval_ms in log_config.conf. false before LOG_SYS_INIT
+#define LOG_METRICS_HIST_BUCKETS    (24)
+struct LogMetrics {
+    unsigned long long records[LOG_LEVEL_MAX];  // by level, that got to the log system
+    unsigned long long filtered;        // of them, taken by no sink for its log_level
+    unsigned long long writes;          // lines written by the sinks
+    unsigned long long bytes;           // and their bytes
+    unsigned long long flushes;
+    unsigned long long rotations;       // new files started by log_dest = 2
+    unsigned long long rotation_us;     // the time the logging threads spent on them
+    unsigned long long lock_waits;      // the times a thread found a sink locked
+    unsigned long long lock_wait_us;    // and waited for it
+    // metrics_latency = 1 only: bucket 0 counts the ones under 1 us, bucket i
+    // the ones in [2^(i-1), 2^i) us, and the last one all the longer ones
+    unsigned long long write_us_hist[LOG_METRICS_HIST_BUCKETS];
+    unsigned long long flush_us_hist[LOG_METRICS_HIST_BUCKETS];
+};
+bool LOG_GET_METRICS(LogMetrics& metrics);
 
 
 // log with context
 
 #define LOG_DEBUG_CTX(context, format_string, ...)\
 {\
-    std::string final_str;\
-    final_str.append("[").append(context).append("] ").append(format_string);\
-    LOG_DEBUG(final_str, ##__VA_ARGS__);\
+    if (LOG_LEVEL_ENABLED(LOG_LEVEL_DEBUG)) {\
+        allyes::log::detail::log_printf(LOG_LEVEL_DEBUG, log_format_cstr(context), log_format_cstr(format_string), ##__VA_ARGS__);\
+    }\
 }
 
 #define LOG_INFO_CTX(context, format_string, ...)\
 {\
-    std::string final_str;\
-    final_str.append("[").append(context).append("] ").append(format_string);\
-    LOG_INFO(final_str, ##__VA_ARGS__);\
+    if (LOG_LEVEL_ENABLED(LOG_LEVEL_INFO)) {\
+        allyes::log::detail::log_printf(LOG_LEVEL_INFO, log_format_cstr(context), log_format_cstr(format_string), ##__VA_ARGS__);\
+    }\
 }
 
 #define LOG_WARNING_CTX(context, format_string, ...)\
 {\
-    std::string final_str;\
-    final_str.append("[").append(context).append("] ").append(format_string);\
-    LOG_WARNING(final_str, ##__VA_ARGS__);\
+    if (LOG_LEVEL_ENABLED(LOG_LEVEL_WARNING)) {\
+        allyes::log::detail::log_printf(LOG_LEVEL_WARNING, log_format_cstr(context), log_format_cstr(format_string), ##__VA_ARGS__);\
+    }\
 }
+
 #define LOG_ERROR_CTX(context, format_string, ...)\
 {\
-    std::string final_str;\
-    final_str.append("[").append(context).append("] ").append(format_string);\
-    LOG_ERROR(final_str, ##__VA_ARGS__);\
+    if (LOG_LEVEL_ENABLED(LOG_LEVEL_ERROR)) {\
+        allyes::log::detail::log_printf(LOG_LEVEL_ERROR, log_format_cstr(context), log_format_cstr(format_string), ##__VA_ARGS__);\
+    }\
+}
+
+
+// log to a category, as "[name] text"
+
+#define LOG_CAT_DEBUG(category, format_string, ...)\
+{\
+    if ((category)->enabled(LOG_LEVEL_DEBUG)) {\
+        allyes::log::detail::log_category_printf(category, LOG_LEVEL_DEBUG, log_format_cstr(format_string), ##__VA_ARGS__);\
+    }\
+}
+
+#define LOG_CAT_INFO(category, format_string, ...)\
+{\
+    if ((category)->enabled(LOG_LEVEL_INFO)) {\
+        allyes::log::detail::log_category_printf(category, LOG_LEVEL_INFO, log_format_cstr(format_string), ##__VA_ARGS__);\
+    }\
+}
+
+#define LOG_CAT_WARNING(category, format_string, ...)\
+{\
+    if ((category)->enabled(LOG_LEVEL_WARNING)) {\
+        allyes::log::detail::log_category_printf(category, LOG_LEVEL_WARNING, log_format_cstr(format_string), ##__VA_ARGS__);\
+    }\
+}
+
+#define LOG_CAT_ERROR(category, format_string, ...)\
+{\
+    if ((category)->enabled(LOG_LEVEL_ERROR)) {\
+        allyes::log::detail::log_category_printf(category, LOG_LEVEL_ERROR, log_format_cstr(format_string), ##__VA_ARGS__);\
+    }\
+}
+
+
+// the rate limited logs
+
+// used only inside this file !!!
+#define LOG_IMPL_SITE(level, check, format_string, ...)\
+if (LOG_LEVEL_ENABLED(level)) {\
+    static allyes::log::detail::LogSite log_site_;\
+    uint64_t log_suppressed_ = 0;\
+    if (log_site_.check) {\
+        allyes::log::detail::log_site_printf(level, log_suppressed_, log_format_cstr(format_string), ##__VA_ARGS__);\
+    }\
+}
+
+#define LOG_DEBUG_EVERY_N(n, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_DEBUG, everyN(n, log_suppressed_), format_string, ##__VA_ARGS__); }
+#define LOG_INFO_EVERY_N(n, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_INFO, everyN(n, log_suppressed_), format_string, ##__VA_ARGS__); }
+#define LOG_WARNING_EVERY_N(n, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_WARNING, everyN(n, log_suppressed_), format_string, ##__VA_ARGS__); }
+#define LOG_ERROR_EVERY_N(n, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_ERROR, everyN(n, log_suppressed_), format_string, ##__VA_ARGS__); }
+
+#define LOG_DEBUG_FIRST_N(n, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_DEBUG, firstN(n), format_string, ##__VA_ARGS__); }
+#define LOG_INFO_FIRST_N(n, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_INFO, firstN(n), format_string, ##__VA_ARGS__); }
+#define LOG_WARNING_FIRST_N(n, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_WARNING, firstN(n), format_string, ##__VA_ARGS__); }
+#define LOG_ERROR_FIRST_N(n, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_ERROR, firstN(n), format_string, ##__VA_ARGS__); }
+
+#define LOG_DEBUG_RATE(per_sec, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_DEBUG, rate(per_sec, log_suppressed_), format_string, ##__VA_ARGS__); }
+#define LOG_INFO_RATE(per_sec, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_INFO, rate(per_sec, log_suppressed_), format_string, ##__VA_ARGS__); }
+#define LOG_WARNING_RATE(per_sec, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_WARNING, rate(per_sec, log_suppressed_), format_string, ##__VA_ARGS__); }
+#define LOG_ERROR_RATE(per_sec, format_string, ...)\
+{ LOG_IMPL_SITE(LOG_LEVEL_ERROR, rate(per_sec, log_suppressed_), format_string, ##__VA_ARGS__); }
+
+
+// the logs with fields
+
+#define LOG_KV(key, value) allyes::log::kv(key, value)
+
+#define LOG_DEBUG_KV(msg, ...)\
+{\
+    if (LOG_LEVEL_ENABLED(LOG_LEVEL_DEBUG)) {\
+        allyes::log::write_kv(LOG_LEVEL_DEBUG, msg, ##__VA_ARGS__);\
+    }\
+}
+
+#define LOG_INFO_KV(msg, ...)\
+{\
+    if (LOG_LEVEL_ENABLED(LOG_LEVEL_INFO)) {\
+        allyes::log::write_kv(LOG_LEVEL_INFO, msg, ##__VA_ARGS__);\
+    }\
+}
+
+#define LOG_WARNING_KV(msg, ...)\
+{\
+    if (LOG_LEVEL_ENABLED(LOG_LEVEL_WARNING)) {\
+        allyes::log::write_kv(LOG_LEVEL_WARNING, msg, ##__VA_ARGS__);\
+    }\
+}
+
+#define LOG_ERROR_KV(msg, ...)\
+{\
+    if (LOG_LEVEL_ENABLED(LOG_LEVEL_ERROR)) {\
+        allyes::log::write_kv(LOG_LEVEL_ERROR, msg, ##__VA_ARGS__);\
+    }\
 }
 
 
 void LOG_OUT(const std::string& log, ENUM_LOG_LEVEL level);
+void LOG_OUT(const char* log, size_t len, ENUM_LOG_LEVEL level);
+// a log with fields: its first 'text_len' bytes are the text
+void LOG_OUT(const char* log, size_t len, size_t text_len, ENUM_LOG_LEVEL level);
+void LOG_OUT(const LogCategory* category, const char* log, size_t len, ENUM_LOG_LEVEL level);
 const char* get_log_level_txt(ENUM_LOG_LEVEL);
 
+
+//
+// interface #6, the type-safe logging API
+//
+
+namespace allyes {
+namespace log {
+
+namespace detail {
+
+// the text of one log: on the stack, and on the heap only when it's too long
+class LogLine {
+public:
+    LogLine(): len_(0) {}
+
+    void append(const char* str, size_t len) {
+        if (heap_.empty() && len <= sizeof(buf_) - len_) {
+            memcpy(buf_ + len_, str, len);
+            len_ += len;
+        }
+        else {
+            spill();
+            heap_.append(str, len);
+        }
+    }
+
+    void append(char c) {
+        append(&c, 1);
+    }
+
+    // printf() style
+    void appendf(const char* format, ...);
+
+    // writes over 'len' bytes appended already, from 'pos'
+    void overwrite(size_t pos, const char* str, size_t len) {
+        memcpy((heap_.empty() ? buf_ : &heap_[0]) + pos, str, len);
+    }
+
+    const char* data() const { return heap_.empty() ? buf_ : heap_.data(); }
+    size_t size() const { return heap_.empty() ? len_ : heap_.size(); }
+
+private:
+    LogLine(const LogLine&);
+    const LogLine& operator=(const LogLine&);
+
+    void spill() {
+        if (heap_.empty()) {
+            heap_.reserve(len_ * 2 + 64);
+            heap_.assign(buf_, len_);
+        }
+    }
+
+private:
+    char buf_[4096];
+    size_t len_;
+    std::string heap_;
+};
+
+// the LOG_XXX and LOG_XXX_CTX macros end up here
+template <typename... Args>
+inline void log_printf(ENUM_LOG_LEVEL level, const char* context, const char* format, Args... args) {
+    LogLine line;
+
+    if (context != NULL) {
+        line.append('[');
+        line.append(context, strlen(context));
+        line.append("] ", 2);
+    }
+
+    line.appendf(format, args...);
+    LOG_OUT(line.data(), line.size(), level);
+}
+
+// the LOG_CAT_XXX macros end up here
+template <typename... Args>
+inline void log_category_printf(const LogCategory* category, ENUM_LOG_LEVEL level, const char* format, Args... args) {
+    LogLine line;
+
+    line.append('[');
+    line.append(category->getName().data(), category->getName().size());
+    line.append("] ", 2);
+
+    line.appendf(format, args...);
+    LOG_OUT(category, line.data(), line.size(), level);
+}
+
+// the state of a call site of LOG_XXX_EVERY_N, _FIRST_N and _RATE, shared by
+// the threads without a lock. Initialized at compile time.
+class LogSite {
+public:
+    constexpr LogSite(): calls_(0), suppressed_(0), next_ns_(0) {}
+
+    // the 1st, the n+1th, the 2n+1th ... call
+    bool everyN(uint64_t n, uint64_t& suppressed) {
+        const uint64_t call = calls_.fetch_add(1, std::memory_order_relaxed);
+        if (n > 1 && call % n != 0) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    // the first n calls; no more is written after them to report the rest
+    bool firstN(uint64_t n) {
+        if (calls_.load(std::memory_order_relaxed) >= n) {
+            return false;
+        }
+        return calls_.fetch_add(1, std::memory_order_relaxed) < n;
+    }
+
+    // a token bucket of per_sec tokens a second, holding up to a second of
+    // them; kept as the time the bucket would be full again (GCRA), so one CAS
+    // takes a token
+    bool rate(double per_sec, uint64_t& suppressed) {
+        const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        const int64_t interval = per_sec > 0 ? static_cast<int64_t>(1e9 / per_sec) : INT64_MAX / 2;
+        const int64_t burst = per_sec > 1 ? static_cast<int64_t>(per_sec) : 1;
+        const int64_t tolerance = interval * (burst - 1);
+
+        int64_t next = next_ns_.load(std::memory_order_relaxed);
+        for (;;) {
+            const int64_t from = next > now ? next : now;
+            if (from - now > tolerance) {
+                suppressed_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (next_ns_.compare_exchange_weak(next, from + interval, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    LogSite(const LogSite&);
+    const LogSite& operator=(const LogSite&);
+
+private:
+    std::atomic<uint64_t> calls_;
+    std::atomic<uint64_t> suppressed_;  // since the last log written
+    std::atomic<int64_t> next_ns_;      // of the token bucket
+};
+
+// the rate limited macros end up here
+template <typename... Args>
+inline void log_site_printf(ENUM_LOG_LEVEL level, uint64_t suppressed, const char* format, Args... args) {
+    LogLine line;
+
+    line.appendf(format, args...);
+
+    if (suppressed > 0) {
+        char num[24];
+        const char* first = log_format_u64(num + sizeof(num), suppressed);
+        line.append(" (", 2);
+        line.append(first, num + sizeof(num) - first);
+        line.append(" suppressed)", 12);
+    }
+
+    LOG_OUT(line.data(), line.size(), level);
+}
+
+//
+// the formatters of the arguments of {}
+//
+
+inline void format_value(LogLine& line, bool value) {
+    if (value) {
+        line.append("true", 4);
+    }
+    else {
+        line.append("false", 5);
+    }
+}
+
+inline void format_value(LogLine& line, char value) {
+    line.append(value);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+format_value(LogLine& line, T value) {
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* begin = log_format_u64(end, value);
+    line.append(begin, end - begin);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+format_value(LogLine& line, T value) {
+    typedef typename std::make_unsigned<T>::type U;
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* begin;
+    if (value < 0) {
+        begin = log_format_u64(end, U(0) - static_cast<U>(value));
+        *--begin = '-';
+    }
+    else {
+        begin = log_format_u64(end, static_cast<U>(value));
+    }
+    line.append(begin, end - begin);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type
+format_value(LogLine& line, T value) {
+    format_value(line, static_cast<typename std::underlying_type<T>::type>(value));
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+format_value(LogLine& line, T value) {
+    char buf[LOG_DOUBLE_BUF_SIZE];
+    line.append(buf, log_format_double(buf, static_cast<double>(value)));
+}
+
+inline void format_value(LogLine& line, const char* value) {
+    if (NULL == value) {
+        line.append("(null)", 6);
+    }
+    else {
+        line.append(value, strlen(value));
+    }
+}
+
+inline void format_value(LogLine& line, char* value) {
+    format_value(line, const_cast<const char*>(value));
+}
+
+inline void format_value(LogLine& line, const std::string& value) {
+    line.append(value.data(), value.size());
+}
+
+template <typename T>
+inline void format_value(LogLine& line, T* value) {
+    line.appendf("%p", static_cast<const void*>(value));
+}
+
+// can format_value() take a T ?
+template <typename T>
+struct is_formattable {
+private:
+    template <typename U>
+    static auto check(int) -> decltype(format_value(std::declval<LogLine&>(), std::declval<const U&>()), std::true_type());
+    template <typename U>
+    static std::false_type check(...);
+public:
+    static const bool value = decltype(check<T>(0))::value;
+};
+
+template <typename... Args>
+struct all_formattable : std::true_type {};
+
+template <typename T, typename... Rest>
+struct all_formattable<T, Rest...> :
+    std::integral_constant<bool, is_formattable<T>::value && all_formattable<Rest...>::value> {};
+
+template <typename T>
+struct identity {
+    typedef T type;
+};
+
+// appends the text up to the next {} and returns where the text goes on after
+// it, or NULL at the end of the format
+inline const char* format_literal(LogLine& line, const char* p, const char* end) {
+    while (p < end) {
+        const char c = *p;
+        if ('{' == c && p + 1 < end && '}' == p[1]) {
+            return p + 2;
+        }
+        if (('{' == c || '}' == c) && p + 1 < end && c == p[1]) {
+            ++p;    // "{{" or "}}"
+        }
+        line.append(c);
+        ++p;
+    }
+    return NULL;
+}
+
+// no argument left: the rest of the format, with any {} kept as it is so that
+// the mismatch shows
+inline void format_to(LogLine& line, const char* p, const char* end) {
+    if (NULL == p) {
+        return;
+    }
+
+    while ((p = format_literal(line, p, end)) != NULL) {
+        line.append("{}", 2);
+    }
+}
+
+template <typename T, typename... Rest>
+inline void format_to(LogLine& line, const char* p, const char* end, const T& value, const Rest&... rest) {
+    if (p != NULL) {
+        p = format_literal(line, p, end);
+    }
+
+    // more arguments than {}: put them at the end to keep them visible
+    if (NULL == p) {
+        line.append(' ');
+    }
+
+    format_value(line, value);
+    format_to(line, p, end, rest...);
+}
+
+} // namespace detail
+
+
+// the format string of the API; a C++20 compiler checks that it has as many {}
+// as the arguments. Before C++20 a mismatch is logged as it is: the arguments
+// without a {} are appended, each after a space, and the {} without an
+// argument are kept in the text
+template <typename... Args>
+class format_string {
+public:
+#if defined(__cpp_consteval)
+    template <size_t N>
+    consteval format_string(const char (&str)[N]): str_(str), len_(N - 1) {
+        size_t num = 0;
+        for (size_t i = 0; i + 1 < N; ++i) {
+            if ((str[i] == '{' || str[i] == '}') && i + 2 < N && str[i + 1] == str[i]) {
+                ++i;
+            }
+            else if (str[i] == '{' && i + 2 < N && str[i + 1] == '}') {
+                ++num;
+                ++i;
+            }
+        }
+        if (num != sizeof...(Args)) {
+            throw "allyes::log: the number of {} in the format doesn't match the number of arguments";
+        }
+    }
+#else
+    template <size_t N>
+    format_string(const char (&str)[N]): str_(str), len_(N - 1) {
+    }
+#endif
+
+    const char* data() const { return str_; }
+    size_t size() const { return len_; }
+
+private:
+    const char* str_;
+    size_t len_;
+};
+
+template <typename... Args>
+inline void write(ENUM_LOG_LEVEL level, typename detail::identity<format_string<Args...> >::type format, const Args&... args) {
+    static_assert(detail::all_formattable<Args...>::value, "allyes::log: can't format the type of an argument");
+
+    if (!LOG_LEVEL_ENABLED(level)) {
+        return;
+    }
+
+    detail::LogLine line;
+    detail::format_to(line, format.data(), format.data() + format.size(), args...);
+    LOG_OUT(line.data(), line.size(), level);
+}
+
+template <typename... Args>
+inline void debug(typename detail::identity<format_string<Args...> >::type format, const Args&... args) {
+    if (LOG_COMPILE_MIN_LEVEL <= 0) {
+        write<Args...>(LOG_LEVEL_DEBUG, format, args...);
+    }
+}
+
+template <typename... Args>
+inline void info(typename detail::identity<format_string<Args...> >::type format, const Args&... args) {
+    if (LOG_COMPILE_MIN_LEVEL <= 1) {
+        write<Args...>(LOG_LEVEL_INFO, format, args...);
+    }
+}
+
+template <typename... Args>
+inline void warning(typename detail::identity<format_string<Args...> >::type format, const Args&... args) {
+    if (LOG_COMPILE_MIN_LEVEL <= 2) {
+        write<Args...>(LOG_LEVEL_WARNING, format, args...);
+    }
+}
+
+template <typename... Args>
+inline void error(typename detail::identity<format_string<Args...> >::type format, const Args&... args) {
+    write<Args...>(LOG_LEVEL_ERROR, format, args...);
+}
+
+
+//
+// interface #12, the logs with fields
+//
+
+// a field of a log, made by kv(); keeps a reference to the value, so it's
+// only good for the call it's made for
+template <typename T>
+struct field {
+    const char* key;
+    const T& value;
+};
+
+template <typename T>
+inline field<T> kv(const char* key, const T& value) {
+    field<T> one = { key, value };
+    return one;
+}
+
+namespace detail {
+
+// the JSON type of a value: numbers and bools as they are, the rest strings
+template <typename T>
+inline char field_type(const T&) {
+    if (std::is_same<T, bool>::value) {
+        return LOG_FIELD_BOOL;
+    }
+    if (std::is_arithmetic<T>::value && !std::is_same<T, char>::value) {
+        return LOG_FIELD_NUMBER;
+    }
+    return LOG_FIELD_STRING;
+}
+
+// NaN and inf are no JSON numbers
+inline char field_type(const float& value) {
+    return value - value == 0 ? LOG_FIELD_NUMBER : LOG_FIELD_STRING;
+}
+
+inline char field_type(const double& value) {
+    return value - value == 0 ? LOG_FIELD_NUMBER : LOG_FIELD_STRING;
+}
+
+inline void format_fields(LogLine&) {
+}
+
+// appends the length, then 'value', then sets the length to what it took
+template <typename T>
+inline void format_field_part(LogLine& line, const T& value) {
+    const size_t len_pos = line.size();
+    uint32_t len = 0;
+    line.append(reinterpret_cast<const char*>(&len), sizeof(len));
+
+    format_value(line, value);
+
+    len = line.size() - len_pos - sizeof(len);
+    line.overwrite(len_pos, reinterpret_cast<const char*>(&len), sizeof(len));
+}
+
+template <typename T, typename... Rest>
+inline void format_fields(LogLine& line, const field<T>& one, const Rest&... rest) {
+    line.append(field_type(one.value));
+    format_field_part(line, one.key);
+    format_field_part(line, one.value);
+    format_fields(line, rest...);
+}
+
+template <typename T>
+struct is_field : std::false_type {};
+
+template <typename T>
+struct is_field<field<T> > : std::integral_constant<bool, is_formattable<T>::value> {};
+
+template <typename... Args>
+struct all_fields : std::true_type {};
+
+template <typename T, typename... Rest>
+struct all_fields<T, Rest...> :
+    std::integral_constant<bool, is_field<T>::value && all_fields<Rest...>::value> {};
+
+} // namespace detail
+
+// 'msg' is written as it is, not as a format
+template <typename... Fields>
+inline void write_kv(ENUM_LOG_LEVEL level, const std::string& msg, const Fields&... fields) {
+    static_assert(detail::all_fields<Fields...>::value, "allyes::log: the fields must be made by kv(), "
+            "of the types {} can format");
+
+    if (!LOG_LEVEL_ENABLED(level)) {
+        return;
+    }
+
+    detail::LogLine line;
+    line.append(msg.data(), msg.size());
+    detail::format_fields(line, fields...);
+    LOG_OUT(line.data(), line.size(), msg.size(), level);
+}
+
+template <typename... Fields>
+inline void write_kv(ENUM_LOG_LEVEL level, const char* msg, const Fields&... fields) {
+    static_assert(detail::all_fields<Fields...>::value, "allyes::log: the fields must be made by kv(), "
+            "of the types {} can format");
+
+    if (!LOG_LEVEL_ENABLED(level)) {
+        return;
+    }
+
+    detail::LogLine line;
+    detail::format_value(line, msg);
+    const size_t text_len = line.size();
+    detail::format_fields(line, fields...);
+    LOG_OUT(line.data(), line.size(), text_len, level);
+}
+
+template <typename... Fields>
+inline void debug_kv(const char* msg, const Fields&... fields) {
+    if (LOG_COMPILE_MIN_LEVEL <= 0) {
+        write_kv(LOG_LEVEL_DEBUG, msg, fields...);
+    }
+}
+
+template <typename... Fields>
+inline void info_kv(const char* msg, const Fields&... fields) {
+    if (LOG_COMPILE_MIN_LEVEL <= 1) {
+        write_kv(LOG_LEVEL_INFO, msg, fields...);
+    }
+}
+
+template <typename... Fields>
+inline void warning_kv(const char* msg, const Fields&... fields) {
+    if (LOG_COMPILE_MIN_LEVEL <= 2) {
+        write_kv(LOG_LEVEL_WARNING, msg, fields...);
+    }
+}
+
+template <typename... Fields>
+inline void error_kv(const char* msg, const Fields&... fields) {
+    write_kv(LOG_LEVEL_ERROR, msg, fields...);
+}
+
+} // namespace log
+} // namespace allyes
+
 #endif /* _LOG_H_ */
@@ -5,15 +5,49 @@
 #include <assert.h>
 #include <iostream>
 #include "allyes-log.h"
+#include "log_time.h"
 
 
 enum ENUM_LOG_TYPE {
     TO_STDERR = 0,
     TO_FILE,
     TO_ROLLING_FILE,
+    TO_MMAP_FILE,       // the file is written through mmap(), see MmapFile
+    TO_URING_FILE,      // the file is written through io_uring, see UringFile
     TO_MAX,
 };
 
+// how FileLogger and RollingFileLogger write the file
+enum ENUM_LOG_FILE_BACKEND {
+    FILE_BACKEND_FSTREAM = 0,   // the std::filebuf of std::fstream, see LogStreamBuf
+    FILE_BACKEND_FD,            // an O_APPEND fd with its own buffer, see AppendFile
+    FILE_BACKEND_URING,         // io_uring, see UringFile; falls back to FILE_BACKEND_FD
+    FILE_BACKEND_MMAP,          // mmap(), see MmapFile
+    FILE_BACKEND_MAX,
+};
+
+// when RollingFileLogger starts a new file, besides rotate_size_mb
+enum ENUM_LOG_ROTATE_INTERVAL {
+    ROTATE_DAILY = 0,   // "day"
+    ROTATE_HOURLY,      // "hour"
+};
+
+// the layout of the lines of a sink
+enum ENUM_LOG_FORMAT {
+    LOG_FORMAT_TEXT = 0,    // "text": [time] LEVEL msg key=value
+    LOG_FORMAT_JSON,        // "json": one JSON object per line, see log_json.h
+};
+
+// what AsyncLogWriter does with a log that doesn't fit in the queue
+enum ENUM_LOG_OVERFLOW_POLICY {
+    OVERFLOW_BLOCK = 0,             // "block": the caller waits for room
+    OVERFLOW_DROP_NEWEST,           // "drop_newest": the new log is dropped
+    OVERFLOW_DROP_LOWEST_LEVEL,     // "drop_lowest_level_first": the queued logs of the lowest
+                                    // level go first; ERRORs are never dropped
+    OVERFLOW_BLOCK_WITH_TIMEOUT,    // "block_with_timeout": waits async_block_timeout_ms at most,
+                                    // then drops the new log
+};
+
 
 // config iterms
 #define TEXT_LOG_DESTINATION        "log_dest"
@@ -22,6 +56,33 @@ enum ENUM_LOG_TYPE {
 #define TEXT_LOG_FILE_BASE_NAME     "file_base_name"
 #define TEXT_LOG_FILE_SUFFIX        "file_suffix"
 #define TEXT_LOG_FLUSH_NUM          "num_logs_to_flush"
+#define TEXT_LOG_TIME_PRECISION     "time_precision"
+#define TEXT_LOG_FORMAT             "log_format"
+#define TEXT_LOG_PATTERN            "log_pattern"
+#define TEXT_LOG_ASYNC              "log_async"
+#define TEXT_LOG_ASYNC_QUEUE_SIZE   "async_queue_size"
+#define TEXT_LOG_ASYNC_QUEUE_BYTES  "async_queue_bytes"
+#define TEXT_LOG_ASYNC_OVERFLOW     "async_overflow"
+#define TEXT_LOG_ASYNC_BLOCK_TIMEOUT_MS "async_block_timeout_ms"
+#define TEXT_LOG_BINARY             "log_binary"
+#define TEXT_LOG_FILE_BACKEND       "file_backend"
+#define TEXT_LOG_FILE_BUFFER_SIZE   "file_buffer_size"
+#define TEXT_LOG_MMAP_CHUNK_SIZE    "mmap_chunk_size"
+#define TEXT_LOG_ROTATE_SIZE_MB     "rotate_size_mb"
+#define TEXT_LOG_ROTATE_INTERVAL    "rotate_interval"
+#define TEXT_LOG_COMPRESS_ROTATED   "compress_rotated"
+#define TEXT_LOG_COMPRESS_LEVEL     "compress_level"
+#define TEXT_LOG_COMPRESS_CPU_PERCENT "compress_cpu_percent"
+#define TEXT_LOG_FLUSH_INTERVAL_MS  "flush_interval_ms"
+#define TEXT_LOG_FLUSH_FSYNC        "flush_fsync"
+#define TEXT_LOG_SINKS              "sinks"
+#define TEXT_LOG_REPEAT_WINDOW_MS   "repeat_window_ms"
+#define TEXT_LOG_METRICS_LATENCY    "metrics_latency"
+#define TEXT_LOG_METRICS_INTERVAL_MS "metrics_interval_ms"
+#define TEXT_LOG_CONFIG_RELOAD      "config_reload"
+#define TEXT_LOG_CRASH_HANDLER      "crash_handler"
+#define TEXT_LOG_CATEGORY_LEVEL     "category_level"    // category_level.<name>
+#define TEXT_LOG_CATEGORY_SINKS     "category_sinks"    // category_sinks.<name>
 
 
 // default values
@@ -31,6 +92,34 @@ const   ENUM_LOG_LEVEL  LOG_DEFAULT_LOGLEVEL = LOG_LEVEL_INFO;
 #define LOG_DEFAULT_FILE_BASENAME   "log"
 #define LOG_DEFAULT_FILE_SUFFIX     ""      // no suffix by default
 #define LOG_DEFAULT_FLUSH_NUM       (1)
+const   ENUM_LOG_TIME_PRECISION LOG_DEFAULT_TIME_PRECISION = LOG_TIME_SEC;
+const   ENUM_LOG_FORMAT LOG_DEFAULT_FORMAT = LOG_FORMAT_TEXT;
+#define LOG_DEFAULT_PATTERN         "[%d] %p %m%n"  // the layout of the text logs, see log_pattern.h
+#define LOG_DEFAULT_ASYNC           (0)     // log on the caller's thread by default
+#define LOG_DEFAULT_ASYNC_QUEUE_SIZE (10000)
+#define LOG_DEFAULT_ASYNC_QUEUE_BYTES (0)   // no byte budget by default
+const   ENUM_LOG_OVERFLOW_POLICY LOG_DEFAULT_ASYNC_OVERFLOW = OVERFLOW_BLOCK;
+#define LOG_DEFAULT_ASYNC_BLOCK_TIMEOUT_MS (100)
+#define LOG_DEFAULT_BINARY          (0)     // text logs by default
+#define LOG_BINARY_FILE_SUFFIX      ".bin"  // appended to file_base_name in binary mode
+const   ENUM_LOG_FILE_BACKEND LOG_DEFAULT_FILE_BACKEND = FILE_BACKEND_FD;
+#define LOG_DEFAULT_FILE_BUFFER_SIZE (64 * 1024)  // bytes, for the fd backend
+#define LOG_DEFAULT_MMAP_CHUNK_SIZE (16 * 1024 * 1024)  // bytes, for file_backend = 3
+#define LOG_URING_BUFFER_NUM        (4)     // the buffers of file_buffer_size in flight at most
+#define LOG_DEFAULT_ROTATE_SIZE_MB  (0)     // no size limit by default
+const   ENUM_LOG_ROTATE_INTERVAL LOG_DEFAULT_ROTATE_INTERVAL = ROTATE_DAILY;
+#define LOG_ROTATE_NEXT_FILE_SUFFIX ".next" // the file opened ahead for the next rotation
+#define LOG_DEFAULT_COMPRESS_ROTATED (0)    // keep the rotated files as they are by default
+#define LOG_DEFAULT_COMPRESS_LEVEL  (6)     // gzip -6
+#define LOG_DEFAULT_COMPRESS_CPU_PERCENT (20)   // of one core
+#define LOG_DEFAULT_FLUSH_INTERVAL_MS (0)   // only num_logs_to_flush by default
+#define LOG_DEFAULT_FLUSH_FSYNC     (0)     // the timer only flushes by default
+#define LOG_DEFAULT_REPEAT_WINDOW_MS (0)    // every copy of a log is written by default
+#define LOG_DEFAULT_METRICS_LATENCY (0)     // the writes and flushes are not timed by default
+#define LOG_DEFAULT_METRICS_INTERVAL_MS (0) // no stats line by default
+#define LOG_DEFAULT_CONFIG_RELOAD   (0)     // the config file is read once by default
+#define LOG_CONFIG_RELOAD_DELAY_MS  (100)   // the editors write a file in more than one go
+#define LOG_DEFAULT_CRASH_HANDLER   (0)     // the signals are left to the app by default
 
 
 // log to the stand error
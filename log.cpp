@@ -1,3 +1,5 @@
+#include <stdarg.h>
+#include <sys/time.h>
 #include <string>
 #include <iostream>
 #include <map>
@@ -8,6 +10,12 @@
 using namespace std;
 
 
+// let everything through until the log system is initialized
+std::atomic<int> g_LogLevelGate(LOG_LEVEL_DEBUG);
+
+// turned on by LOG_SYS_INIT when log_binary = 1
+std::atomic<bool> g_LogBinaryMode(false);
+
 static const char* s_LogLevelNames[LOG_LEVEL_MAX] = {
     "DEBUG",
     "INFO",
@@ -32,7 +40,119 @@ void LOG_OUT(const string& log, ENUM_LOG_LEVEL level) {
     LogSys::getInstance().log(log, level);
 }
 
+void LOG_OUT(const char* log, size_t len, ENUM_LOG_LEVEL level) {
+    LogSys::getInstance().log(log, len, len, level);
+}
+
+void LOG_OUT(const char* log, size_t len, size_t text_len, ENUM_LOG_LEVEL level) {
+    LogSys::getInstance().log(log, len, text_len, level);
+}
+
+void LOG_OUT(const LogCategory* category, const char* log, size_t len, ENUM_LOG_LEVEL level) {
+    LogSys::getInstance().log(category, log, len, level);
+}
+
+void allyes::log::detail::LogLine::appendf(const char* format, ...) {
+    va_list args;
+
+    if (heap_.empty()) {
+        const size_t room = sizeof(buf_) - len_;
+
+        va_start(args, format);
+        const int n = log_vsnprintf(buf_ + len_, room, format, args);
+        va_end(args);
+
+        if (n < 0) {
+            return;
+        }
+        if (static_cast<size_t>(n) < room) {
+            len_ += n;
+            return;
+        }
+        spill();
+    }
+
+    // too long for the stack: format again, right into the heap
+    va_start(args, format);
+    const int n = log_vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (n <= 0) {
+        return;
+    }
+
+    const size_t old_size = heap_.size();
+    heap_.resize(old_size + n + 1);
+    va_start(args, format);
+    log_vsnprintf(&heap_[old_size], n + 1, format, args);
+    va_end(args);
+    heap_.resize(old_size + n);
+}
+
 void LOG_SET_LEVEL(ENUM_LOG_LEVEL level) {
     LogSys::getInstance().setLevel(level);
 }
 
+bool LOG_SET_SINK_LEVEL(const std::string& sink, ENUM_LOG_LEVEL level) {
+    return LogSys::getInstance().setSinkLevel(sink, level);
+}
+
+bool LOG_GET_FLUSH_STATS(LogFlushStats& stats) {
+    return LogSys::getInstance().getFlushStats(stats);
+}
+
+bool LOG_GET_QUEUE_STATS(LogQueueStats& stats) {
+    return LogSys::getInstance().getQueueStats(stats);
+}
+
+bool LOG_GET_METRICS(LogMetrics& metrics) {
+    return LogSys::getInstance().getMetrics(metrics);
+}
+
+LogCategory* LOG_GET_CATEGORY(const string& name) {
+    return LogSys::getInstance().getCategory(name);
+}
+
+void LOG_SET_CATEGORY_LEVEL(const string& name, ENUM_LOG_LEVEL level) {
+    LogSys::getInstance().setCategoryLevel(name, level);
+}
+
+unsigned int log_binary_register_format(const char* format) {
+    return LogSys::getInstance().registerBinaryFormat(format);
+}
+
+void log_binary_begin(LogBinaryBuf& buf, unsigned int format_id, ENUM_LOG_LEVEL level, size_t arg_num) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    const char type = 'L';
+    const uint32_t len = 0;     // filled by log_binary_end()
+    const uint32_t id = format_id;
+    const int64_t sec = now.tv_sec;
+    const int32_t usec = now.tv_usec;
+    const uint8_t lv = level;
+    const uint8_t num = arg_num;
+
+    log_binary_put(buf, &type, sizeof(type));
+    log_binary_put(buf, &len, sizeof(len));
+    log_binary_put(buf, &id, sizeof(id));
+    log_binary_put(buf, &sec, sizeof(sec));
+    log_binary_put(buf, &usec, sizeof(usec));
+    log_binary_put(buf, &lv, sizeof(lv));
+    log_binary_put(buf, &num, sizeof(num));
+}
+
+void log_binary_end(LogBinaryBuf& buf, char* record, unsigned int format_id, ENUM_LOG_LEVEL level) {
+    if (buf.overflow) {
+        char text[128];
+        const int n = snprintf(text, sizeof(text), "(log dropped: longer than %lu bytes, format id %u)",
+                static_cast<unsigned long>(LOG_BINARY_MAX_RECORD_LEN), format_id);
+        LogSys::getInstance().log(text, n, level);
+        return;
+    }
+
+    const uint32_t len = buf.pos - record - 1 - sizeof(uint32_t);
+    memcpy(record + 1, &len, sizeof(len));
+
+    LogSys::getInstance().logBinary(record, buf.pos - record);
+}
@@ -75,6 +75,59 @@ bool LogConfig::getString(const string& stringName, string& _return) const {
 	return false;
 }
 
+bool LogConfig::getList(const string& listName, vector<string>& _return) const {
+	string str;
+	if (!getString(listName, str)) {
+		return false;
+	}
+
+	_return.clear();
+	string::size_type begin = 0;
+	while (begin <= str.size()) {
+		string::size_type end = str.find(',', begin);
+		if (end == string::npos) {
+			end = str.size();
+		}
+
+		const string item = trimString(str.substr(begin, end - begin));
+		if (!item.empty()) {
+			_return.push_back(item);
+		}
+		begin = end + 1;
+	}
+
+	return true;
+}
+
+LogConfig LogConfig::getSection(const string& name) const {
+	LogConfig section;
+
+	for (map<string, string>::const_iterator iter = values_.begin(); iter != values_.end(); ++iter) {
+		if (iter->first.find('.') == string::npos) {
+			section.values_[iter->first] = iter->second;
+		}
+	}
+
+	// the keys of the section win
+	map<string, string> own;
+	getPrefixed(name, own);
+	for (map<string, string>::const_iterator iter = own.begin(); iter != own.end(); ++iter) {
+		section.values_[iter->first] = iter->second;
+	}
+
+	return section;
+}
+
+void LogConfig::getPrefixed(const string& prefix, map<string, string>& _return) const {
+	const string head = prefix + ".";
+
+	_return.clear();
+	for (map<string, string>::const_iterator iter = values_.lower_bound(head);
+			iter != values_.end() && 0 == iter->first.compare(0, head.size(), head); ++iter) {
+		_return[iter->first.substr(head.size())] = iter->second;
+	}
+}
+
 // reads and parses the config data
 bool LogConfig::parseConfig(const string& filename) {
 	queue<string> config_strings;
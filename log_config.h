@@ -19,6 +19,7 @@
 #include <map>
 #include <queue>
 #include <string>
+#include <vector>
 #include <stdexcept>
 
 
@@ -34,6 +35,14 @@ public:
 	bool getUnsignedLongLong(const std::string& intName, unsigned long long& _return) const;
 	bool getFloat(const std::string& floatName, float & _return) const;
 	bool getString(const std::string& stringName, std::string& _return) const;
+	// "a, b, c"; the empty items are skipped
+	bool getList(const std::string& listName, std::vector<std::string>& _return) const;
+
+	// the config of the section 'name': every "<name>.<key> = ..." as
+	// "<key> = ...", on top of the keys out of any section
+	LogConfig getSection(const std::string& name) const;
+	// every "<prefix>.<key> = <value>" as <key> -> <value>, only those
+	void getPrefixed(const std::string& prefix, std::map<std::string, std::string>& _return) const;
 
 private:
 	bool parseStore(std::queue<std::string>& raw_config);
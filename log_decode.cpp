@@ -0,0 +1,462 @@
+/*
+ * log_decode.cpp
+ *
+ *  Note:
+ *  allyes-log-decode: turns the files written in binary mode (log_binary = 1)
+ *  into the same text as a normal log file. See BinaryLogWriter.h for the
+ *  layout of the file.
+ *
+ *  Usage: allyes-log-decode [binary_log_file ...]
+ *  Reads the stdin if no file is given; the text goes to the stdout.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "BinaryLogWriter.h"
+#include "Logger.h"
+
+
+using namespace std;
+
+
+struct BinaryArg {
+    uint8_t type;
+    int64_t i;
+    uint64_t u;
+    double d;
+    string s;
+};
+
+struct DecodeState {
+    map<uint32_t, string> formats;
+    ENUM_LOG_TIME_PRECISION precision;
+};
+
+
+static bool read_exact(FILE* in, void* data, size_t len) {
+    return fread(data, 1, len, in) == len;
+}
+
+static void append_printf(string& out, const char* format, ...) {
+    char buf[512];
+
+    va_list args;
+    va_start(args, format);
+    const int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    if (n < 0) {
+        return;
+    }
+
+    if (static_cast<size_t>(n) < sizeof(buf)) {
+        out.append(buf, n);
+    }
+    else {
+        string big(n + 1, '\0');
+        va_start(args, format);
+        vsnprintf(&big[0], n + 1, format, args);
+        va_end(args);
+        out.append(big.data(), n);
+    }
+}
+
+static bool arg_is_integer(const BinaryArg& arg) {
+    return LOG_BINARY_ARG_INT == arg.type || LOG_BINARY_ARG_UINT == arg.type || LOG_BINARY_ARG_POINTER == arg.type;
+}
+
+static int64_t arg_as_signed(const BinaryArg& arg) {
+    return LOG_BINARY_ARG_INT == arg.type ? arg.i : static_cast<int64_t>(arg.u);
+}
+
+static uint64_t arg_as_unsigned(const BinaryArg& arg) {
+    return LOG_BINARY_ARG_INT == arg.type ? static_cast<uint64_t>(arg.i) : arg.u;
+}
+
+// does what printf() would have done with the format and the arguments
+static void format_binary_log(const string& format, const vector<BinaryArg>& args, string& out) {
+    size_t next_arg = 0;
+    const char* p = format.c_str();
+
+    while (*p) {
+        if (*p != '%') {
+            const char* literal_end = strchr(p, '%');
+            if (NULL == literal_end) {
+                literal_end = p + strlen(p);
+            }
+            out.append(p, literal_end - p);
+            p = literal_end;
+            continue;
+        }
+
+        if ('%' == p[1]) {
+            out.append(1, '%');
+            p += 2;
+            continue;
+        }
+
+        //
+        // %[flags][width][.precision][length]conversion
+        //
+
+        string spec("%");
+        ++p;
+
+        while (*p && strchr("-+ #0'", *p)) {
+            spec.append(1, *p++);
+        }
+
+        for (int part = 0; part < 2; ++part) {
+            if (1 == part) {
+                if (*p != '.') {
+                    break;
+                }
+                spec.append(1, *p++);
+            }
+
+            if ('*' == *p) {
+                ++p;
+                if (next_arg < args.size() && arg_is_integer(args[next_arg])) {
+                    append_printf(spec, "%d", static_cast<int>(arg_as_signed(args[next_arg])));
+                }
+                ++next_arg;
+            }
+            else {
+                while (*p >= '0' && *p <= '9') {
+                    spec.append(1, *p++);
+                }
+            }
+        }
+
+        string length;
+        while (*p && strchr("hlLqjzt", *p)) {
+            length.append(1, *p++);
+        }
+
+        const char conversion = *p;
+        if ('\0' == conversion) {
+            break;
+        }
+        ++p;
+
+        if ('n' == conversion) {
+            ++next_arg;
+            continue;
+        }
+
+        if (next_arg >= args.size()) {
+            out.append("(missing arg)");
+            continue;
+        }
+        const BinaryArg& arg = args[next_arg++];
+
+        switch (conversion) {
+        case 'd':
+        case 'i':
+            if (!arg_is_integer(arg)) {
+                out.append("(bad arg)");
+            }
+            else if (length.empty()) {
+                append_printf(out, (spec + "d").c_str(), static_cast<int>(arg_as_signed(arg)));
+            }
+            else if ("h" == length) {
+                append_printf(out, (spec + "d").c_str(), static_cast<short>(arg_as_signed(arg)));
+            }
+            else if ("hh" == length) {
+                append_printf(out, (spec + "d").c_str(), static_cast<signed char>(arg_as_signed(arg)));
+            }
+            else {
+                append_printf(out, (spec + "lld").c_str(), static_cast<long long>(arg_as_signed(arg)));
+            }
+            break;
+
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            if (!arg_is_integer(arg)) {
+                out.append("(bad arg)");
+            }
+            else if (length.empty()) {
+                append_printf(out, (spec + conversion).c_str(), static_cast<unsigned int>(arg_as_unsigned(arg)));
+            }
+            else if ("h" == length) {
+                append_printf(out, (spec + conversion).c_str(), static_cast<unsigned short>(arg_as_unsigned(arg)));
+            }
+            else if ("hh" == length) {
+                append_printf(out, (spec + conversion).c_str(), static_cast<unsigned char>(arg_as_unsigned(arg)));
+            }
+            else {
+                append_printf(out, (spec + "ll" + conversion).c_str(), static_cast<unsigned long long>(arg_as_unsigned(arg)));
+            }
+            break;
+
+        case 'c':
+            if (!arg_is_integer(arg)) {
+                out.append("(bad arg)");
+            }
+            else {
+                append_printf(out, (spec + "c").c_str(), static_cast<int>(arg_as_signed(arg)));
+            }
+            break;
+
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (arg.type != LOG_BINARY_ARG_DOUBLE) {
+                out.append("(bad arg)");
+            }
+            else {
+                append_printf(out, (spec + conversion).c_str(), arg.d);
+            }
+            break;
+
+        case 's':
+            if (arg.type != LOG_BINARY_ARG_STRING) {
+                out.append("(bad arg)");
+            }
+            else if ("%" == spec) {
+                out.append(arg.s);
+            }
+            else {
+                append_printf(out, (spec + "s").c_str(), arg.s.c_str());
+            }
+            break;
+
+        case 'p':
+            if (!arg_is_integer(arg)) {
+                out.append("(bad arg)");
+            }
+            else {
+                append_printf(out, (spec + "p").c_str(), reinterpret_cast<void*>(static_cast<uintptr_t>(arg_as_unsigned(arg))));
+            }
+            break;
+
+        default:
+            out.append("(bad format)");
+            break;
+        }
+    }
+}
+
+static bool decode_args(const char* data, size_t len, uint8_t arg_num, vector<BinaryArg>& args) {
+    const char* end = data + len;
+
+    args.resize(arg_num);
+    for (uint8_t i = 0; i < arg_num; ++i) {
+        BinaryArg& arg = args[i];
+
+        if (data >= end) {
+            return false;
+        }
+        arg.type = *data++;
+
+        size_t size = 0;
+        switch (arg.type) {
+        case LOG_BINARY_ARG_INT:
+            size = sizeof(arg.i);
+            break;
+        case LOG_BINARY_ARG_UINT:
+        case LOG_BINARY_ARG_POINTER:
+            size = sizeof(arg.u);
+            break;
+        case LOG_BINARY_ARG_DOUBLE:
+            size = sizeof(arg.d);
+            break;
+        case LOG_BINARY_ARG_STRING:
+            size = sizeof(uint32_t);
+            break;
+        default:
+            return false;
+        }
+
+        if (static_cast<size_t>(end - data) < size) {
+            return false;
+        }
+
+        switch (arg.type) {
+        case LOG_BINARY_ARG_INT:
+            memcpy(&arg.i, data, size);
+            break;
+        case LOG_BINARY_ARG_UINT:
+        case LOG_BINARY_ARG_POINTER:
+            memcpy(&arg.u, data, size);
+            break;
+        case LOG_BINARY_ARG_DOUBLE:
+            memcpy(&arg.d, data, size);
+            break;
+        case LOG_BINARY_ARG_STRING: {
+            uint32_t str_len;
+            memcpy(&str_len, data, size);
+            if (static_cast<size_t>(end - data - size) < str_len) {
+                return false;
+            }
+            arg.s.assign(data + size, str_len);
+            size += str_len;
+            break;
+        }
+        }
+
+        data += size;
+    }
+
+    return true;
+}
+
+// returns false if the file is broken
+static bool decode_file(FILE* in, const char* name) {
+    DecodeState state;
+    state.precision = LOG_TIME_SEC;
+    bool has_header = false;
+
+    vector<char> record;
+    vector<BinaryArg> args;
+    string msg;
+    string line;
+
+    char type;
+    while (read_exact(in, &type, sizeof(type))) {
+        switch (type) {
+        case LOG_BINARY_ENTRY_HEADER: {
+            char magic[LOG_BINARY_MAGIC_LEN];
+            uint8_t version, precision;
+            if (!read_exact(in, magic, sizeof(magic)) || memcmp(magic, LOG_BINARY_MAGIC, sizeof(magic)) != 0 ||
+                    !read_exact(in, &version, sizeof(version)) || !read_exact(in, &precision, sizeof(precision))) {
+                fprintf(stderr, "<%s>: bad header\n", name);
+                return false;
+            }
+            if (version != LOG_BINARY_VERSION) {
+                fprintf(stderr, "<%s>: unsupported version %d\n", name, version);
+                return false;
+            }
+
+            // a new session: the ids start over
+            state.formats.clear();
+            state.precision = precision < LOG_TIME_PRECISION_MAX ? ENUM_LOG_TIME_PRECISION(precision) : LOG_TIME_SEC;
+            has_header = true;
+            break;
+        }
+
+        case LOG_BINARY_ENTRY_FORMAT: {
+            uint32_t id, len;
+            if (!read_exact(in, &id, sizeof(id)) || !read_exact(in, &len, sizeof(len))) {
+                fprintf(stderr, "<%s>: truncated format entry\n", name);
+                return false;
+            }
+            string format(len, '\0');
+            if (len > 0 && !read_exact(in, &format[0], len)) {
+                fprintf(stderr, "<%s>: truncated format entry\n", name);
+                return false;
+            }
+            state.formats[id] = format;
+            break;
+        }
+
+        case LOG_BINARY_ENTRY_LOG: {
+            uint32_t len;
+            if (!read_exact(in, &len, sizeof(len))) {
+                fprintf(stderr, "<%s>: truncated log entry\n", name);
+                return false;
+            }
+            record.resize(len);
+            if (len > 0 && !read_exact(in, &record[0], len)) {
+                fprintf(stderr, "<%s>: truncated log entry\n", name);
+                return false;
+            }
+
+            uint32_t id;
+            int64_t sec;
+            int32_t usec;
+            uint8_t level, arg_num;
+            const size_t head_len = sizeof(id) + sizeof(sec) + sizeof(usec) + sizeof(level) + sizeof(arg_num);
+            if (!has_header || len < head_len) {
+                fprintf(stderr, "<%s>: bad log entry\n", name);
+                return false;
+            }
+
+            const char* p = &record[0];
+            memcpy(&id, p, sizeof(id));             p += sizeof(id);
+            memcpy(&sec, p, sizeof(sec));           p += sizeof(sec);
+            memcpy(&usec, p, sizeof(usec));         p += sizeof(usec);
+            memcpy(&level, p, sizeof(level));       p += sizeof(level);
+            memcpy(&arg_num, p, sizeof(arg_num));   p += sizeof(arg_num);
+
+            msg.clear();
+            size_t text_len = string::npos;
+            map<uint32_t, string>::const_iterator format = state.formats.find(id);
+            if (format == state.formats.end()) {
+                append_printf(msg, "(unknown format id %u)", id);
+            }
+            else if (!decode_args(p, len - head_len, arg_num, args)) {
+                append_printf(msg, "(bad arguments for format <%s>)", format->second.c_str());
+            }
+            else if (LOG_BINARY_TEXT_FORMAT_ID == id && 2 == args.size()) {
+                // a text log and its fields
+                msg = args[0].s;
+                text_len = msg.size();
+                msg.append(args[1].s);
+            }
+            else {
+                format_binary_log(format->second, args, msg);
+            }
+            if (string::npos == text_len) {
+                text_len = msg.size();
+            }
+
+            struct timeval when;
+            when.tv_sec = sec;
+            when.tv_usec = usec;
+            generate_final_log(line, msg.data(), msg.size(), text_len, ENUM_LOG_LEVEL(level), when,
+                    state.precision);
+            fwrite(line.data(), 1, line.size(), stdout);
+            break;
+        }
+
+        default:
+            fprintf(stderr, "<%s>: unknown entry type 0x%02x\n", name, static_cast<unsigned char>(type));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        return decode_file(stdin, "stdin") ? 0 : 1;
+    }
+
+    int ret = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "-h") || 0 == strcmp(argv[i], "--help")) {
+            printf("Usage: %s [binary_log_file ...]\n", argv[0]);
+            printf("Decodes the logs written with log_binary = 1 to the stdout; reads the stdin if no file is given.\n");
+            return 0;
+        }
+
+        FILE* in = fopen(argv[i], "rb");
+        if (NULL == in) {
+            fprintf(stderr, "Failed to open <%s>\n", argv[i]);
+            ret = 1;
+            continue;
+        }
+
+        if (!decode_file(in, argv[i])) {
+            ret = 1;
+        }
+        fclose(in);
+    }
+
+    return ret;
+}
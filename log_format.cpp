@@ -0,0 +1,735 @@
+/*
+ * log_format.cpp
+ *
+ *  Note:
+ *  The printf() compatible formatter behind LOG_XXX. The conversions seen in
+ *  almost every log (%d %u %ld %lu %x %s %c %p %f ...) are done here. A
+ *  format with one of the rare ones (%e %g %a, long double, %ls %lc, %p with
+ *  flags or a precision), a positional argument (%1$s) or a conversion
+ *  unknown here is given to the vsnprintf() of libc as a whole; %f of a huge
+ *  number or a precision over 17 is passed to snprintf() alone. Either way
+ *  the result is always what snprintf() gives.
+ *
+ *  Except for a format with %n, which never goes to libc as a whole: its
+ *  rare conversions are passed to snprintf() one by one, and a positional
+ *  or unknown one is kept as text.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <wchar.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <string.h>
+#include <math.h>
+#include <charconv>
+#include <string>
+#include "allyes-log.h"
+
+
+namespace {
+
+// "00" "01" ... "99"
+const char s_DigitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+const char s_LowerHex[] = "0123456789abcdef";
+const char s_UpperHex[] = "0123456789ABCDEF";
+
+const uint64_t s_PowersOf10[] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+};
+const int MAX_FAST_FLOAT_PRECISION = 17;
+
+// writes what fits into the buffer, and counts everything like vsnprintf()
+struct Output {
+    char* buf;
+    size_t size;    // the room of 'buf', including the ending '\0'
+    size_t pos;
+
+    void put(const char* data, size_t len) {
+        if (pos + 1 < size) {
+            const size_t room = size - 1 - pos;
+            memcpy(buf + pos, data, len < room ? len : room);
+        }
+        pos += len;
+    }
+
+    void put(char c) {
+        if (pos + 1 < size) {
+            buf[pos] = c;
+        }
+        pos++;
+    }
+
+    void fill(char c, size_t num) {
+        if (pos + 1 < size) {
+            const size_t room = size - 1 - pos;
+            memset(buf + pos, c, num < room ? num : room);
+        }
+        pos += num;
+    }
+
+    void finish() {
+        if (size > 0) {
+            buf[pos < size ? pos : size - 1] = '\0';
+        }
+    }
+};
+
+struct Spec {
+    bool left;      // '-'
+    bool plus;      // '+'
+    bool space;     // ' '
+    bool alt;       // '#'
+    bool zero;      // '0'
+    int width;
+    int precision;  // -1 if not given
+    char length[3]; // "", "h", "hh", "l", "ll", "j", "z", "t", "L"
+    char conversion;
+};
+
+// writes the decimal digits of 'value' backwards, ending at 'end'
+inline char* format_decimal(char* end, uint64_t value) {
+    while (value >= 100) {
+        const unsigned int i = (value % 100) * 2;
+        value /= 100;
+        end -= 2;
+        end[0] = s_DigitPairs[i];
+        end[1] = s_DigitPairs[i + 1];
+    }
+
+    if (value >= 10) {
+        const unsigned int i = value * 2;
+        end -= 2;
+        end[0] = s_DigitPairs[i];
+        end[1] = s_DigitPairs[i + 1];
+    }
+    else {
+        *--end = '0' + value;
+    }
+
+    return end;
+}
+
+inline char* format_radix(char* end, uint64_t value, char conversion) {
+    if ('o' == conversion) {
+        do {
+            *--end = '0' + (value & 7);
+            value >>= 3;
+        } while (value != 0);
+    }
+    else {
+        const char* digits = 'X' == conversion ? s_UpperHex : s_LowerHex;
+        do {
+            *--end = digits[value & 15];
+            value >>= 4;
+        } while (value != 0);
+    }
+    return end;
+}
+
+// [sign or prefix][zeros][digits] padded to the width
+void put_number(Output& out, const Spec& spec, const char* prefix, size_t prefix_len,
+        size_t zeros, const char* digits, size_t digits_len) {
+    const size_t len = prefix_len + zeros + digits_len;
+    const size_t pad = spec.width > 0 && static_cast<size_t>(spec.width) > len ? spec.width - len : 0;
+
+    // the usual case: "%d", "%lu", "%x"
+    if (0 == pad && 0 == zeros && 0 == prefix_len) {
+        out.put(digits, digits_len);
+        return;
+    }
+
+    if (!spec.left && !spec.zero) {
+        out.fill(' ', pad);
+    }
+    out.put(prefix, prefix_len);
+    if (!spec.left && spec.zero) {
+        out.fill('0', pad);
+    }
+    out.fill('0', zeros);
+    out.put(digits, digits_len);
+    if (spec.left) {
+        out.fill(' ', pad);
+    }
+}
+
+void put_padded(Output& out, const Spec& spec, const char* str, size_t len) {
+    const size_t pad = spec.width > 0 && static_cast<size_t>(spec.width) > len ? spec.width - len : 0;
+    if (0 == pad) {
+        out.put(str, len);
+        return;
+    }
+
+    if (!spec.left) {
+        out.fill(' ', pad);
+    }
+    out.put(str, len);
+    if (spec.left) {
+        out.fill(' ', pad);
+    }
+}
+
+void put_integer(Output& out, Spec spec, uint64_t magnitude, bool negative) {
+    char buf[32];
+    char* const end = buf + sizeof(buf);
+    char* begin = end;
+
+    const char conversion = spec.conversion;
+    const bool is_signed = 'd' == conversion || 'i' == conversion;
+
+    // "%.0d" of 0 has no digit
+    if (magnitude != 0 || spec.precision != 0) {
+        if (is_signed || 'u' == conversion) {
+            begin = format_decimal(end, magnitude);
+        }
+        else {
+            begin = format_radix(end, magnitude, conversion);
+        }
+    }
+    size_t digits_len = end - begin;
+
+    char prefix[2];
+    size_t prefix_len = 0;
+    if (is_signed) {
+        if (negative) {
+            prefix[prefix_len++] = '-';
+        }
+        else if (spec.plus) {
+            prefix[prefix_len++] = '+';
+        }
+        else if (spec.space) {
+            prefix[prefix_len++] = ' ';
+        }
+    }
+    else if (spec.alt) {
+        if (('x' == conversion || 'X' == conversion) && magnitude != 0) {
+            prefix[prefix_len++] = '0';
+            prefix[prefix_len++] = conversion;
+        }
+        else if ('o' == conversion && (0 == digits_len || *begin != '0') &&
+                !(spec.precision > 0 && static_cast<size_t>(spec.precision) > digits_len)) {
+            *--begin = '0';
+            digits_len++;
+        }
+    }
+
+    size_t zeros = 0;
+    if (spec.precision >= 0) {
+        spec.zero = false;  // the precision wins over '0'
+        if (static_cast<size_t>(spec.precision) > digits_len) {
+            zeros = spec.precision - digits_len;
+        }
+    }
+    if (spec.left) {
+        spec.zero = false;
+    }
+
+    put_number(out, spec, prefix, prefix_len, zeros, begin, digits_len);
+}
+
+// %f of a double, exact and rounded half to even like glibc.
+// returns false if the value is out of the fast range.
+bool put_fixed(Output& out, Spec spec, double value) {
+    const int precision = spec.precision < 0 ? 6 : spec.precision;
+    if (precision > MAX_FAST_FLOAT_PRECISION) {
+        return false;
+    }
+
+    const bool negative = signbit(value);
+    const double magnitude = negative ? -value : value;
+
+    char prefix[1];
+    size_t prefix_len = 0;
+    if (negative) {
+        prefix[prefix_len++] = '-';
+    }
+    else if (spec.plus) {
+        prefix[prefix_len++] = '+';
+    }
+    else if (spec.space) {
+        prefix[prefix_len++] = ' ';
+    }
+
+    if (!isfinite(magnitude)) {
+        const bool upper = 'F' == spec.conversion;
+        const char* text = isnan(magnitude) ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+        spec.zero = false;
+        put_number(out, spec, prefix, prefix_len, 0, text, 3);
+        return true;
+    }
+
+    if (magnitude >= 18446744073709551616.0) {   // 2^64
+        return false;
+    }
+
+    // magnitude = mantissa * 2^exponent, exactly
+    int exponent;
+    const double fraction = frexp(magnitude, &exponent);
+    uint64_t mantissa = static_cast<uint64_t>(ldexp(fraction, 53));
+    exponent -= 53;
+
+    uint64_t int_part;
+    uint64_t frac_digits = 0;     // the fraction scaled by 10^precision
+    const uint64_t scale = s_PowersOf10[precision];
+
+    if (exponent >= 0) {
+        int_part = mantissa << exponent;
+    }
+    else {
+        const int shift = -exponent;
+        unsigned __int128 frac;
+        if (shift >= 64) {
+            int_part = 0;
+            frac = mantissa;
+        }
+        else {
+            int_part = mantissa >> shift;
+            frac = mantissa & ((1ULL << shift) - 1);
+        }
+
+        if (shift >= 128) {
+            // less than 2^-75, far below half of the last digit
+            frac_digits = 0;
+        }
+        else {
+            const unsigned __int128 scaled = frac * scale;
+            unsigned __int128 quotient = scaled >> shift;
+            const unsigned __int128 remainder = scaled - (quotient << shift);
+            const unsigned __int128 half = static_cast<unsigned __int128>(1) << (shift - 1);
+
+            // the last digit printed decides the tie, for %.0f it's in the integer part
+            const bool odd = (0 == precision ? int_part : static_cast<uint64_t>(quotient)) & 1;
+            if (remainder > half || (remainder == half && odd)) {
+                quotient++;
+            }
+            if (quotient >= scale) {
+                quotient -= scale;
+                int_part++;
+                if (0 == int_part) {
+                    return false;   // 2^64 after rounding
+                }
+            }
+            frac_digits = static_cast<uint64_t>(quotient);
+        }
+    }
+
+    char buf[48];
+    char* const end = buf + sizeof(buf);
+    char* begin = end;
+
+    if (precision > 0) {
+        char* const frac_end = end;
+        begin = format_decimal(end, frac_digits);
+        while (frac_end - begin < precision) {
+            *--begin = '0';
+        }
+        *--begin = '.';
+    }
+    else if (spec.alt) {
+        *--begin = '.';
+    }
+    begin = format_decimal(begin, int_part);
+
+    if (spec.left) {
+        spec.zero = false;
+    }
+    put_number(out, spec, prefix, prefix_len, 0, begin, end - begin);
+    return true;
+}
+
+// a conversion the fast paths don't do: let libc do it
+template <typename T>
+void put_by_libc(Output& out, const Spec& spec, T value) {
+    char format[32];
+    char* p = format;
+    *p++ = '%';
+    if (spec.left)  *p++ = '-';
+    if (spec.plus)  *p++ = '+';
+    if (spec.space) *p++ = ' ';
+    if (spec.alt)   *p++ = '#';
+    if (spec.zero)  *p++ = '0';
+    p += snprintf(p, format + sizeof(format) - p, "%d", spec.width);
+    if (spec.precision >= 0) {
+        p += snprintf(p, format + sizeof(format) - p, ".%d", spec.precision);
+    }
+    for (const char* l = spec.length; *l; ++l) {
+        *p++ = *l;
+    }
+    *p++ = spec.conversion;
+    *p = '\0';
+
+    char buf[512];
+    const int n = snprintf(buf, sizeof(buf), format, value);
+    if (n < 0) {
+        return;
+    }
+    if (static_cast<size_t>(n) < sizeof(buf)) {
+        out.put(buf, n);
+    }
+    else {
+        std::string big(n + 1, '\0');
+        snprintf(&big[0], big.size(), format, value);
+        out.put(big.data(), n);
+    }
+}
+
+inline bool is_length(const Spec& spec, char c) {
+    return spec.length[0] == c && '\0' == spec.length[1];
+}
+
+inline bool is_length(const Spec& spec, char c1, char c2) {
+    return spec.length[0] == c1 && spec.length[1] == c2;
+}
+
+inline bool is_length_char(char c) {
+    switch (c) {
+    case 'h': case 'l': case 'L': case 'q': case 'j': case 'z': case 't':
+        return true;
+    default:
+        return false;
+    }
+}
+
+// reads "%...x" after the '%'; returns where the format goes on, or NULL if
+// the spec is broken
+const char* parse_spec(const char* p, Spec& spec, va_list& args) {
+    spec.left = spec.plus = spec.space = spec.alt = spec.zero = false;
+    spec.width = 0;
+    spec.precision = -1;
+
+    for (;; ++p) {
+        switch (*p) {
+        case '-': spec.left = true; continue;
+        case '+': spec.plus = true; continue;
+        case ' ': spec.space = true; continue;
+        case '#': spec.alt = true; continue;
+        case '0': spec.zero = true; continue;
+        default: break;
+        }
+        break;
+    }
+
+    if ('*' == *p) {
+        spec.width = va_arg(args, int);
+        if (spec.width < 0) {
+            spec.left = true;
+            spec.width = -spec.width;
+        }
+        ++p;
+    }
+    else {
+        while (*p >= '0' && *p <= '9') {
+            spec.width = spec.width * 10 + (*p++ - '0');
+        }
+    }
+
+    if ('.' == *p) {
+        ++p;
+        if ('*' == *p) {
+            spec.precision = va_arg(args, int);
+            if (spec.precision < 0) {
+                spec.precision = -1;
+            }
+            ++p;
+        }
+        else {
+            spec.precision = 0;
+            while (*p >= '0' && *p <= '9') {
+                spec.precision = spec.precision * 10 + (*p++ - '0');
+            }
+        }
+    }
+
+    size_t len = 0;
+    while (len < 2 && is_length_char(*p)) {
+        spec.length[len++] = ('q' == *p) ? 'l' : *p;
+        if ('q' == *p) {
+            spec.length[len++] = 'l';
+        }
+        ++p;
+    }
+    spec.length[len] = '\0';
+
+    if ('\0' == *p) {
+        return NULL;
+    }
+    spec.conversion = *p++;
+    return p;
+}
+
+// returns false if the conversion is unknown here, and no argument was taken
+bool convert(Output& out, Spec& spec, va_list& args, int saved_errno) {
+    switch (spec.conversion) {
+    case 'd':
+    case 'i': {
+        long long value;
+        if (is_length(spec, 'l', 'l'))      value = va_arg(args, long long);
+        else if (is_length(spec, 'l'))      value = va_arg(args, long);
+        else if (is_length(spec, 'h', 'h')) value = static_cast<signed char>(va_arg(args, int));
+        else if (is_length(spec, 'h'))      value = static_cast<short>(va_arg(args, int));
+        else if (is_length(spec, 'j'))      value = va_arg(args, intmax_t);
+        else if (is_length(spec, 'z'))      value = va_arg(args, ssize_t);
+        else if (is_length(spec, 't'))      value = va_arg(args, ptrdiff_t);
+        else                                value = va_arg(args, int);
+
+        const bool negative = value < 0;
+        const uint64_t magnitude = negative ? 0ULL - static_cast<uint64_t>(value) : value;
+        put_integer(out, spec, magnitude, negative);
+        break;
+    }
+
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X': {
+        unsigned long long value;
+        if (is_length(spec, 'l', 'l'))      value = va_arg(args, unsigned long long);
+        else if (is_length(spec, 'l'))      value = va_arg(args, unsigned long);
+        else if (is_length(spec, 'h', 'h')) value = static_cast<unsigned char>(va_arg(args, unsigned int));
+        else if (is_length(spec, 'h'))      value = static_cast<unsigned short>(va_arg(args, unsigned int));
+        else if (is_length(spec, 'j'))      value = va_arg(args, uintmax_t);
+        else if (is_length(spec, 'z'))      value = va_arg(args, size_t);
+        else if (is_length(spec, 't'))      value = va_arg(args, ptrdiff_t);
+        else                                value = va_arg(args, unsigned int);
+
+        put_integer(out, spec, value, false);
+        break;
+    }
+
+    case 'c': {
+        if (is_length(spec, 'l')) {
+            put_by_libc(out, spec, va_arg(args, wint_t));
+            break;
+        }
+        const char c = static_cast<char>(va_arg(args, int));
+        put_padded(out, spec, &c, 1);
+        break;
+    }
+
+    case 's': {
+        if (is_length(spec, 'l')) {
+            put_by_libc(out, spec, va_arg(args, const wchar_t*));
+            break;
+        }
+        const char* str = va_arg(args, const char*);
+        if (NULL == str) {
+            // what glibc does
+            str = (spec.precision < 0 || spec.precision >= 6) ? "(null)" : "";
+        }
+        const size_t len = spec.precision < 0 ? strlen(str) : strnlen(str, spec.precision);
+        put_padded(out, spec, str, len);
+        break;
+    }
+
+    case 'p': {
+        const void* ptr = va_arg(args, const void*);
+        if (spec.plus || spec.space || spec.zero || spec.precision >= 0) {
+            put_by_libc(out, spec, ptr);
+        }
+        else if (NULL == ptr) {
+            put_padded(out, spec, "(nil)", 5);
+        }
+        else {
+            char buf[24];
+            char* const end = buf + sizeof(buf);
+            char* begin = format_radix(end, reinterpret_cast<uintptr_t>(ptr), 'x');
+            *--begin = 'x';
+            *--begin = '0';
+            put_padded(out, spec, begin, end - begin);
+        }
+        break;
+    }
+
+    case 'f':
+    case 'F':
+        if (is_length(spec, 'L')) {
+            put_by_libc(out, spec, va_arg(args, long double));
+        }
+        else {
+            const double value = va_arg(args, double);
+            if (!put_fixed(out, spec, value)) {
+                put_by_libc(out, spec, value);
+            }
+        }
+        break;
+
+    // only when the whole format can't go to libc, see log_vsnprintf()
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        if (is_length(spec, 'L')) {
+            put_by_libc(out, spec, va_arg(args, long double));
+        }
+        else {
+            put_by_libc(out, spec, va_arg(args, double));
+        }
+        break;
+
+    case 'm': {
+        const char* text = strerror(saved_errno);
+        put_padded(out, spec, text, strlen(text));
+        break;
+    }
+
+    case 'n':
+        // never write through the arguments of a log
+        va_arg(args, void*);
+        break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+// the conversions left to libc: the rare ones, and those convert() doesn't
+// do as printf() does
+inline bool is_libc_conversion(const Spec& spec) {
+    switch (spec.conversion) {
+    case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        return true;
+    case 'f': case 'F':
+        return is_length(spec, 'L');
+    case 'c': case 's':
+        return is_length(spec, 'l');    // wint_t, wchar_t*
+    case 'p':
+        return spec.plus || spec.space || spec.zero || spec.precision >= 0;
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'm': case 'n':
+        return false;
+    default:
+        // the '$' of "%1$s", or unknown
+        return true;
+    }
+}
+
+// a %n anywhere in the format, which libc would write through
+bool has_conversion_n(const char* p) {
+    while ((p = strchr(p, '%')) != NULL) {
+        ++p;
+        if ('%' == *p) {
+            ++p;
+            continue;
+        }
+        while (('0' <= *p && *p <= '9') || '-' == *p || '+' == *p || ' ' == *p || '#' == *p
+                || '*' == *p || '.' == *p || '$' == *p || is_length_char(*p)) {
+            ++p;
+        }
+        if ('n' == *p) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+
+int log_vsnprintf(char* buf, size_t size, const char* format, va_list args) {
+    const int saved_errno = errno;
+
+    Output out = { buf, size, 0 };
+    const char* p = format;
+
+    va_list ap;
+    va_copy(ap, args);
+
+    while (*p) {
+        // copy the text up to the next conversion at once; a format without
+        // any conversion is just one memcpy()
+        const char* percent = strchr(p, '%');
+        if (NULL == percent) {
+            out.put(p, strlen(p));
+            break;
+        }
+        out.put(p, percent - p);
+
+        if ('%' == percent[1]) {
+            out.put('%');
+            p = percent + 2;
+            continue;
+        }
+
+        Spec spec;
+        const char* next = parse_spec(percent + 1, spec, ap);
+        if (NULL == next) {
+            // broken at the end of the format: keep it as it is
+            out.put(percent, strlen(percent));
+            break;
+        }
+
+        // one call to libc for the whole format, rather than one per
+        // conversion from here on; 'args' is still at the first argument
+        if (is_libc_conversion(spec) && !has_conversion_n(format)) {
+            va_end(ap);
+            errno = saved_errno;    // for %m
+            return vsnprintf(buf, size, format, args);
+        }
+
+        if (!convert(out, spec, ap, saved_errno)) {
+            // as libc prints it
+            out.put(percent, next - percent);
+        }
+        p = next;
+    }
+
+    va_end(ap);
+
+    out.finish();
+    return static_cast<int>(out.pos);
+}
+
+int log_snprintf(char* buf, size_t size, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int n = log_vsnprintf(buf, size, format, args);
+    va_end(args);
+    return n;
+}
+
+char* log_format_u64(char* end, uint64_t value) {
+    return format_decimal(end, value);
+}
+
+size_t log_format_double(char* buf, double value) {
+    // the shortest text that reads back as the same double
+    const std::to_chars_result result = std::to_chars(buf, buf + LOG_DOUBLE_BUF_SIZE - 1, value);
+    if (result.ec != std::errc()) {
+        return snprintf(buf, LOG_DOUBLE_BUF_SIZE, "%.17g", value);
+    }
+    *result.ptr = '\0';
+    return result.ptr - buf;
+}
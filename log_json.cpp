@@ -0,0 +1,167 @@
+/*
+ * log_json.cpp
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include "log_json.h"
+
+
+using namespace std;
+
+
+namespace {
+
+// what a byte becomes inside a JSON string: 0 for itself, 'u' for \u00XX,
+// else the letter after the '\'
+struct JsonEscapeTable {
+    JsonEscapeTable() {
+        memset(escape, 0, sizeof(escape));
+        for (int c = 0; c < 0x20; ++c) {
+            escape[c] = 'u';
+        }
+        escape[static_cast<unsigned char>('\b')] = 'b';
+        escape[static_cast<unsigned char>('\f')] = 'f';
+        escape[static_cast<unsigned char>('\n')] = 'n';
+        escape[static_cast<unsigned char>('\r')] = 'r';
+        escape[static_cast<unsigned char>('\t')] = 't';
+        escape[static_cast<unsigned char>('"')] = '"';
+        escape[static_cast<unsigned char>('\\')] = '\\';
+    }
+
+    char escape[256];
+};
+
+const JsonEscapeTable s_JsonEscapeTable;
+
+const uint64_t ONES = 0x0101010101010101ULL;
+const uint64_t HIGHS = 0x8080808080808080ULL;
+
+// the first byte from 'p' that needs escaping, or 'end'
+const char* find_json_escape(const char* p, const char* end) {
+    // 8 bytes at a time: any < 0x20, '"' or '\' ? The "has a byte less than
+    // n" trick, on the bytes and on the bytes XORed with '"' and '\'; the
+    // bytes >= 0x80 are masked out by the complements
+    while (end - p >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        const uint64_t quote = word ^ (ONES * '"');
+        const uint64_t backslash = word ^ (ONES * '\\');
+        const uint64_t hits = ((word - ONES * 0x20) & ~word)
+                | ((quote - ONES) & ~quote)
+                | ((backslash - ONES) & ~backslash);
+        if ((hits & HIGHS) != 0) {
+            break;
+        }
+        p += 8;
+    }
+
+    while (p < end && 0 == s_JsonEscapeTable.escape[static_cast<unsigned char>(*p)]) {
+        ++p;
+    }
+    return p;
+}
+
+}
+
+
+// reads <length> <bytes> at 'pos'; false if it goes past 'len'
+static bool read_field_part(const char* msg, size_t len, size_t& pos, const char*& part, size_t& part_len) {
+    uint32_t n;
+    if (len - pos < sizeof(n)) {
+        return false;
+    }
+    memcpy(&n, msg + pos, sizeof(n));
+    pos += sizeof(n);
+
+    if (len - pos < n) {
+        return false;
+    }
+    part = msg + pos;
+    part_len = n;
+    pos += n;
+    return true;
+}
+
+bool next_log_field(const char* msg, size_t len, size_t& pos, LogField& field) {
+    // <type> <key length> <key> <value length> <value>
+    if (pos >= len) {
+        return false;
+    }
+
+    size_t next = pos + 1;
+    field.type = msg[pos];
+    if (!read_field_part(msg, len, next, field.key, field.key_len) ||
+            !read_field_part(msg, len, next, field.value, field.value_len)) {
+        return false;
+    }
+
+    pos = next;
+    return true;
+}
+
+void append_json_escaped(string& out, const char* str, size_t len) {
+    static const char HEX[] = "0123456789abcdef";
+    const char* const end = str + len;
+
+    for (;;) {
+        const char* p = find_json_escape(str, end);
+        out.append(str, p - str);
+        if (p == end) {
+            break;
+        }
+
+        const unsigned char c = *p;
+        const char escape = s_JsonEscapeTable.escape[c];
+        if ('u' == escape) {
+            const char unicode[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xf] };
+            out.append(unicode, sizeof(unicode));
+        }
+        else {
+            const char pair[2] = { '\\', escape };
+            out.append(pair, sizeof(pair));
+        }
+        str = p + 1;
+    }
+}
+
+void generate_json_log(string& out, const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level,
+        const struct timeval& when, ENUM_LOG_TIME_PRECISION precision) {
+    // {"time":"...","level":"...","msg":" at once
+    char head[LOG_TIME_BUF_SIZE + 64];
+    char* p = head;
+    memcpy(p, "{\"time\":\"", 9);
+    p += 9;
+    p += format_log_time_iso(when, precision, p);
+    memcpy(p, "\",\"level\":\"", 11);
+    p += 11;
+    const char* level_txt = get_log_level_txt(level);
+    const size_t level_len = strlen(level_txt);
+    memcpy(p, level_txt, level_len);
+    p += level_len;
+    memcpy(p, "\",\"msg\":\"", 9);
+    p += 9;
+
+    out.assign(head, p - head);
+    append_json_escaped(out, msg, text_len);
+    out.append(1, '"');
+
+    size_t pos = text_len;
+    LogField field;
+    while (next_log_field(msg, len, pos, field)) {
+        out.append(",\"", 2);
+        append_json_escaped(out, field.key, field.key_len);
+        out.append("\":", 2);
+
+        if (LOG_FIELD_STRING == field.type) {
+            out.append(1, '"');
+            append_json_escaped(out, field.value, field.value_len);
+            out.append(1, '"');
+        }
+        else {
+            out.append(field.value, field.value_len);
+        }
+    }
+
+    out.append("}\n", 2);
+}
@@ -0,0 +1,45 @@
+/*
+ * log_json.h
+ *
+ *  Note:
+ *  The fields of a log (LOG_XXX_KV) and the layout of log_format = json, one
+ *  object per line:
+ *      {"time":"2012-08-23T10:11:12.123+08:00","level":"INFO","msg":"done","user":42}
+ *
+ *  The fields travel behind the text of the log, see LOG_FIELD_STRING in
+ *  allyes-log.h. The escaping of the strings skips 8 bytes at a time while
+ *  none of them needs it, and looks the others up in a table.
+ */
+
+#ifndef LOG_JSON_H_
+#define LOG_JSON_H_
+
+#include <string>
+#include <sys/time.h>
+
+#include "allyes-log.h"
+#include "log_time.h"
+
+
+// one field of a log
+struct LogField {
+    char type;              // LOG_FIELD_STRING, _NUMBER or _BOOL
+    const char* key;
+    size_t key_len;
+    const char* value;
+    size_t value_len;
+};
+
+// reads the field at 'pos' of the 'len' bytes of a log, and moves 'pos' past
+// it; false at the end. 'pos' starts at the length of its text
+bool next_log_field(const char* msg, size_t len, size_t& pos, LogField& field);
+
+// appends 'str' to 'out' as the inside of a JSON string
+void append_json_escaped(std::string& out, const char* str, size_t len);
+
+// the line of log_format = json, of a log whose first 'text_len' bytes are
+// its text; 'out' is overwritten
+void generate_json_log(std::string& out, const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level,
+        const struct timeval& when, ENUM_LOG_TIME_PRECISION precision);
+
+#endif /* LOG_JSON_H_ */
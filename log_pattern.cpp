@@ -0,0 +1,335 @@
+/*
+ * log_pattern.cpp
+ */
+
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include "log_pattern.h"
+#include "log_json.h"
+
+
+using namespace std;
+
+
+namespace {
+
+__thread pid_t s_ThreadId = 0;
+
+// the forking thread is the only one of the child, with another id
+void reset_thread_id() {
+    s_ThreadId = 0;
+}
+
+struct ThreadIdForkHandler {
+    ThreadIdForkHandler() {
+        pthread_atfork(NULL, NULL, reset_thread_id);
+    }
+};
+
+const ThreadIdForkHandler s_ThreadIdForkHandler;
+
+std::atomic<unsigned long> s_NextPatternId(1);
+
+// the longest text of a %d{f}
+const size_t STRFTIME_BUF_SIZE = 64;
+
+// the text of a %d{f} for one second, per thread
+struct StrftimeCache {
+    unsigned long id;       // of the pattern, 0 if empty
+    size_t index;           // of the %d{f} in it
+    time_t sec;
+    char text[STRFTIME_BUF_SIZE];
+    size_t len;
+};
+
+const size_t STRFTIME_CACHE_SIZE = 4;
+__thread StrftimeCache s_StrftimeCache[STRFTIME_CACHE_SIZE];
+
+// big enough for any pid_t, and for a level or a fraction of a second
+const size_t THREAD_ID_BUF_SIZE = 16;
+
+size_t format_thread_id(pid_t tid, char* buf) {
+    char digits[THREAD_ID_BUF_SIZE];
+    size_t n = 0;
+    unsigned long value = static_cast<unsigned long>(tid);
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0 && n < sizeof(digits));
+
+    for (size_t i = 0; i < n; ++i) {
+        buf[i] = digits[n - 1 - i];
+    }
+    return n;
+}
+
+}
+
+
+pid_t get_log_thread_id() {
+    if (0 == s_ThreadId) {
+        s_ThreadId = static_cast<pid_t>(syscall(SYS_gettid));
+    }
+    return s_ThreadId;
+}
+
+
+LogPattern::LogPattern():
+    id_(0),
+    need_thread_id_(false) {
+    parse(LOG_DEFAULT_PATTERN);
+}
+
+LogPattern::~LogPattern() {
+}
+
+bool LogPattern::compile(const std::string& pattern) {
+    LogPattern compiled;
+    if (!compiled.parse(pattern)) {
+        return false;
+    }
+
+    *this = compiled;
+    return true;
+}
+
+bool LogPattern::parse(const std::string& pattern) {
+    text_ = pattern;
+    ops_.clear();
+    literals_.clear();
+    time_formats_.clear();
+    id_ = s_NextPatternId.fetch_add(1);
+    need_thread_id_ = false;
+
+    string literal;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%') {
+            literal += pattern[i];
+            continue;
+        }
+
+        if (i + 1 >= pattern.size()) {
+            LOG_TO_STDERR("Bad log_pattern <%s>: a '%%' at the end", pattern.c_str());
+            return false;
+        }
+
+        const char conversion = pattern[++i];
+        if ('%' == conversion || 'n' == conversion) {
+            literal += '%' == conversion ? '%' : '\n';
+            continue;
+        }
+
+        addLiteral(literal);
+        literal.clear();
+
+        switch (conversion) {
+        case 'd':
+            if (i + 1 < pattern.size() && '{' == pattern[i + 1]) {
+                const size_t end = pattern.find('}', i + 2);
+                if (string::npos == end || end == i + 2) {
+                    LOG_TO_STDERR("Bad log_pattern <%s>: a %%d{ without a format or its '}'", pattern.c_str());
+                    return false;
+                }
+                if (!parseTime(pattern.substr(i + 2, end - i - 2))) {
+                    LOG_TO_STDERR("Bad log_pattern <%s>: the format of %%d{} is too long", pattern.c_str());
+                    return false;
+                }
+                i = end;
+            }
+            else {
+                addOp(OP_TIME, 0, 0);
+            }
+            break;
+
+        case 'p':
+            addOp(OP_LEVEL, 0, 0);
+            break;
+
+        case 't':
+            addOp(OP_THREAD, 0, 0);
+            need_thread_id_ = true;
+            break;
+
+        case 'm':
+            addOp(OP_MESSAGE, 0, 0);
+            break;
+
+        default:
+            LOG_TO_STDERR("Bad log_pattern <%s>: unknown %%%c", pattern.c_str(), conversion);
+            return false;
+        }
+    }
+
+    addLiteral(literal);
+    return true;
+}
+
+// the strftime() parts of 'format', split around its %ms and %us
+bool LogPattern::parseTime(const std::string& format) {
+    string part;
+    for (size_t i = 0; i <= format.size(); ++i) {
+        const bool at_end = (i == format.size());
+        const bool fraction = !at_end
+                && (0 == format.compare(i, 3, "%ms") || 0 == format.compare(i, 3, "%us"));
+
+        if (!at_end && !fraction) {
+            // "%%" is left to strftime(), but mustn't start a %ms
+            if ('%' == format[i] && i + 1 < format.size()) {
+                part += format[i++];
+            }
+            part += format[i];
+            continue;
+        }
+
+        if (!part.empty()) {
+            // strftime() gives 0 for a text longer than STRFTIME_BUF_SIZE
+            char text[STRFTIME_BUF_SIZE];
+            const time_t now = time(NULL);
+            struct tm tm;
+            localtime_r(&now, &tm);
+            if (0 == strftime(text, sizeof(text), part.c_str(), &tm)) {
+                return false;
+            }
+
+            addOp(OP_STRFTIME, time_formats_.size(), 0);
+            time_formats_.push_back(part);
+            part.clear();
+        }
+
+        if (fraction) {
+            addOp('m' == format[i + 1] ? OP_MSEC : OP_USEC, 0, 0);
+            i += 2;
+        }
+    }
+
+    return true;
+}
+
+void LogPattern::addLiteral(const std::string& text) {
+    if (!text.empty()) {
+        addOp(OP_LITERAL, literals_.size(), text.size());
+        literals_ += text;
+    }
+}
+
+void LogPattern::addOp(ENUM_OP_TYPE type, size_t offset, size_t len) {
+    const Op op = { type, offset, len };
+    ops_.push_back(op);
+}
+
+void LogPattern::format(std::string& out, const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level,
+        const struct timeval& when, ENUM_LOG_TIME_PRECISION precision, pid_t tid) const {
+    // the short parts are gathered here, and appended to 'out' at once
+    // before the message and at the end
+    char stage[256];
+    char* p = stage;
+    char* const stage_end = stage + sizeof(stage);
+
+    out.clear();
+
+    const Op* const end = ops_.data() + ops_.size();
+    for (const Op* op = ops_.data(); op != end; ++op) {
+        switch (op->type) {
+        case OP_LITERAL:
+            if (static_cast<size_t>(stage_end - p) < op->len) {
+                out.append(stage, p - stage);
+                p = stage;
+                if (op->len > sizeof(stage)) {
+                    out.append(literals_.data() + op->offset, op->len);
+                    break;
+                }
+            }
+            memcpy(p, literals_.data() + op->offset, op->len);
+            p += op->len;
+            break;
+
+        case OP_TIME:
+            if (static_cast<size_t>(stage_end - p) < LOG_TIME_BUF_SIZE) {
+                out.append(stage, p - stage);
+                p = stage;
+            }
+            p += format_log_time(when, precision, p);
+            break;
+
+        case OP_STRFTIME:
+            if (static_cast<size_t>(stage_end - p) < STRFTIME_BUF_SIZE) {
+                out.append(stage, p - stage);
+                p = stage;
+            }
+            p += formatStrftime(op - ops_.data(), when.tv_sec, p);
+            break;
+
+        case OP_MSEC:
+        case OP_USEC:
+        case OP_LEVEL:
+        case OP_THREAD:
+            if (static_cast<size_t>(stage_end - p) < THREAD_ID_BUF_SIZE) {
+                out.append(stage, p - stage);
+                p = stage;
+            }
+
+            if (OP_MSEC == op->type) {
+                p = write_time_fraction(p, when.tv_usec / 1000, 3);
+            }
+            else if (OP_USEC == op->type) {
+                p = write_time_fraction(p, when.tv_usec, 6);
+            }
+            else if (OP_LEVEL == op->type) {
+                const char* level_txt = get_log_level_txt(level);
+                const size_t level_len = strlen(level_txt);
+                memcpy(p, level_txt, level_len);
+                p += level_len;
+            }
+            else {
+                p += format_thread_id(tid != 0 ? tid : get_log_thread_id(), p);
+            }
+            break;
+
+        case OP_MESSAGE: {
+            out.append(stage, p - stage);
+            p = stage;
+
+            out.append(msg, text_len);
+
+            size_t pos = text_len;
+            LogField field;
+            while (next_log_field(msg, len, pos, field)) {
+                out.append(1, ' ').append(field.key, field.key_len);
+                out.append(1, '=').append(field.value, field.value_len);
+            }
+            break;
+        }
+        }
+    }
+
+    out.append(stage, p - stage);
+}
+
+// the text of the %d{f} of ops_[index] for 'sec', through the cache
+size_t LogPattern::formatStrftime(size_t index, time_t sec, char* buf) const {
+    StrftimeCache& cache = s_StrftimeCache[(id_ + index) % STRFTIME_CACHE_SIZE];
+
+    if (cache.id != id_ || cache.index != index || cache.sec != sec) {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        cache.len = strftime(cache.text, sizeof(cache.text), time_formats_[ops_[index].offset].c_str(), &tm);
+        cache.id = id_;
+        cache.index = index;
+        cache.sec = sec;
+    }
+
+    memcpy(buf, cache.text, cache.len);
+    return cache.len;
+}
+
+const std::string& LogPattern::getText() const {
+    return text_;
+}
+
+bool LogPattern::needThreadId() const {
+    return need_thread_id_;
+}
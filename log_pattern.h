@@ -0,0 +1,94 @@
+/*
+ * log_pattern.h
+ *
+ *  Note:
+ *  The layout of the lines of log_format = text, given by log_pattern, e.g.
+ *      log_pattern = %d{%H:%M:%S.%us} %p [%t] %m%n
+ *
+ *      %d      the time stamp with time_precision: Thu Aug 23 10:11:12 2012
+ *      %d{f}   the time in the strftime() format 'f', in which %ms and %us
+ *              are the milliseconds and the microseconds
+ *      %p      the level: INFO
+ *      %t      the id of the thread that made the log (gettid)
+ *      %m      the message, with " key=value" for each of its fields
+ *      %n      '\n'
+ *      %%      '%'
+ *
+ *  The default, "[%d] %p %m%n", is the layout of the logs without it.
+ *
+ *  A pattern is compiled once, when the logger is configured, into a flat
+ *  array of ops run in turn for every log; what the pattern doesn't use,
+ *  such as the thread id, isn't worked out at all. The text of a %d{f} only
+ *  changes once per second, so it is cached per thread.
+ */
+
+#ifndef LOG_PATTERN_H_
+#define LOG_PATTERN_H_
+
+#include <string>
+#include <vector>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "common.h"
+#include "log_time.h"
+
+
+// the id of the calling thread, for %t
+pid_t get_log_thread_id();
+
+
+class LogPattern {
+public:
+    // the default pattern
+    LogPattern();
+    virtual ~LogPattern();
+
+    // false, and unchanged, for a bad pattern
+    bool compile(const std::string& pattern);
+
+    // the line of a log into 'out', which is overwritten. The first
+    // 'text_len' bytes of 'msg' are its text, the rest its fields (see
+    // LOG_OUT). 'tid' is the thread that made the log, 0 for the calling one
+    void format(std::string& out, const char* msg, size_t len, size_t text_len, ENUM_LOG_LEVEL level,
+            const struct timeval& when, ENUM_LOG_TIME_PRECISION precision, pid_t tid) const;
+
+    const std::string& getText() const;
+    // true if it has a %t
+    bool needThreadId() const;
+
+private:
+    enum ENUM_OP_TYPE {
+        OP_LITERAL = 0,     // the bytes [offset, offset + len) of literals_
+        OP_TIME,            // %d
+        OP_STRFTIME,        // the strftime() format time_formats_[offset] of a %d{f}
+        OP_MSEC,            // %ms of a %d{f}
+        OP_USEC,            // %us of a %d{f}
+        OP_LEVEL,           // %p
+        OP_THREAD,          // %t
+        OP_MESSAGE,         // %m
+    };
+
+    struct Op {
+        ENUM_OP_TYPE type;
+        size_t offset;
+        size_t len;
+    };
+
+    // replaces what it has
+    bool parse(const std::string& pattern);
+    bool parseTime(const std::string& format);
+    void addLiteral(const std::string& text);
+    void addOp(ENUM_OP_TYPE type, size_t offset, size_t len);
+    size_t formatStrftime(size_t index, time_t sec, char* buf) const;
+
+private:
+    std::string text_;
+    std::vector<Op> ops_;
+    std::string literals_;
+    std::vector<std::string> time_formats_;
+    unsigned long id_;      // tells the ones cached per thread apart
+    bool need_thread_id_;
+};
+
+#endif /* LOG_PATTERN_H_ */
@@ -0,0 +1,121 @@
+/*
+ * log_time.cpp
+ */
+
+#include <time.h>
+#include <string.h>
+#include "log_time.h"
+
+
+namespace {
+
+// what ctime_r() gives for one second, split around the place of the fraction:
+// "Thu Aug 23 10:11:12" and " 2012"
+struct TimeCache {
+    time_t sec;
+    char head[24];
+    size_t head_len;
+    char tail[16];
+    size_t tail_len;
+};
+
+__thread TimeCache s_TimeCache = { -1, "", 0, "", 0 };
+__thread TimeCache s_IsoTimeCache = { -1, "", 0, "", 0 };
+
+void refresh_time_cache(TimeCache& cache, time_t sec) {
+    char text[26];
+    ctime_r(&sec, text);
+
+    // "Thu Aug 23 10:11:12 2012\n"
+    const size_t head_len = 19;
+    size_t len = strlen(text);
+    if (len > 0 && text[len - 1] == '\n') {
+        text[--len] = '\0';
+    }
+
+    if (len < head_len) {
+        // should never happen; no fraction then
+        memcpy(cache.head, text, len);
+        cache.head_len = len;
+        cache.tail_len = 0;
+    }
+    else {
+        memcpy(cache.head, text, head_len);
+        cache.head_len = head_len;
+        cache.tail_len = len - head_len;
+        memcpy(cache.tail, text + head_len, cache.tail_len);
+    }
+
+    cache.sec = sec;
+}
+
+// "2012-08-23T10:11:12" and "+08:00"
+void refresh_iso_time_cache(TimeCache& cache, time_t sec) {
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    cache.head_len = strftime(cache.head, sizeof(cache.head), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    long offset = tm.tm_gmtoff / 60;    // minutes
+    char sign = '+';
+    if (offset < 0) {
+        sign = '-';
+        offset = -offset;
+    }
+    cache.tail[0] = sign;
+    cache.tail[1] = '0' + offset / 600 % 10;
+    cache.tail[2] = '0' + offset / 60 % 10;
+    cache.tail[3] = ':';
+    cache.tail[4] = '0' + offset % 60 / 10;
+    cache.tail[5] = '0' + offset % 10;
+    cache.tail_len = 6;
+
+    cache.sec = sec;
+}
+
+// the head of the cache, the fraction, then the tail
+size_t format_cached_time(const TimeCache& cache, const struct timeval& when, ENUM_LOG_TIME_PRECISION precision,
+        char* buf) {
+    char* p = buf;
+    memcpy(p, cache.head, cache.head_len);
+    p += cache.head_len;
+
+    switch (precision) {
+    case LOG_TIME_MSEC:
+        *p++ = '.';
+        p = write_time_fraction(p, when.tv_usec / 1000, 3);
+        break;
+
+    case LOG_TIME_USEC:
+        *p++ = '.';
+        p = write_time_fraction(p, when.tv_usec, 6);
+        break;
+
+    default:
+        break;
+    }
+
+    memcpy(p, cache.tail, cache.tail_len);
+    p += cache.tail_len;
+    *p = '\0';
+
+    return p - buf;
+}
+
+}
+
+
+size_t format_log_time(const struct timeval& when, ENUM_LOG_TIME_PRECISION precision, char* buf) {
+    TimeCache& cache = s_TimeCache;
+    if (cache.sec != when.tv_sec) {
+        refresh_time_cache(cache, when.tv_sec);
+    }
+    return format_cached_time(cache, when, precision, buf);
+}
+
+size_t format_log_time_iso(const struct timeval& when, ENUM_LOG_TIME_PRECISION precision, char* buf) {
+    TimeCache& cache = s_IsoTimeCache;
+    if (cache.sec != when.tv_sec) {
+        refresh_iso_time_cache(cache, when.tv_sec);
+    }
+    return format_cached_time(cache, when, precision, buf);
+}
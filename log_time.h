@@ -0,0 +1,51 @@
+/*
+ * log_time.h
+ *
+ *  Note:
+ *  The time stamp of every log, in the layout of ctime() without the '\n':
+ *      Thu Aug 23 10:11:12 2012
+ *  and with the milliseconds or microseconds appended to the seconds if asked:
+ *      Thu Aug 23 10:11:12.123 2012
+ *      Thu Aug 23 10:11:12.123456 2012
+ *
+ *  or, for log_format = json, in ISO 8601 with the offset from UTC:
+ *      2012-08-23T10:11:12.123+08:00
+ *
+ *  The date and time part only changes once per second, so it is cached per
+ *  thread and only the fraction is formatted for every log.
+ */
+
+#ifndef LOG_TIME_H_
+#define LOG_TIME_H_
+
+#include <stddef.h>
+#include <sys/time.h>
+
+
+enum ENUM_LOG_TIME_PRECISION {
+    LOG_TIME_SEC = 0,
+    LOG_TIME_MSEC,
+    LOG_TIME_USEC,
+    LOG_TIME_PRECISION_MAX,
+};
+
+// big enough for any time stamp, including the ending '\0'
+const size_t LOG_TIME_BUF_SIZE = 40;
+
+// writes the time stamp of 'when' into 'buf', which must have at least
+// LOG_TIME_BUF_SIZE bytes. returns the length, not including the ending '\0'.
+size_t format_log_time(const struct timeval& when, ENUM_LOG_TIME_PRECISION precision, char* buf);
+// the same in ISO 8601
+size_t format_log_time_iso(const struct timeval& when, ENUM_LOG_TIME_PRECISION precision, char* buf);
+
+// writes 'width' decimal digits of 'value', with leading zeros; returns the
+// end of them
+inline char* write_time_fraction(char* p, unsigned long value, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        p[i] = '0' + value % 10;
+        value /= 10;
+    }
+    return p + width;
+}
+
+#endif /* LOG_TIME_H_ */
@@ -0,0 +1,88 @@
+/*
+ * alloc_test.cpp
+ *
+ *  Counts the heap allocations made by LOG_XXX once the log system is warmed
+ *  up. Writing a normal log to a file should not allocate at all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <new>
+#include <string>
+#include <fstream>
+#include "../output/allyes-log.h"
+
+
+using namespace std;
+
+
+static volatile bool s_counting = false;
+static volatile unsigned long s_alloc_num = 0;
+
+void* operator new(size_t size) {
+    if (s_counting) {
+        s_alloc_num++;
+    }
+
+    void* p = malloc(size == 0 ? 1 : size);
+    if (NULL == p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+
+static bool write_config(const string& file_name, int log_dest) {
+    ofstream conf(file_name.c_str());
+    conf << "log_dest = " << log_dest << "\n"
+         << "log_level = 0\n"
+         << "num_logs_to_flush = 100\n"
+         << "time_precision = 2\n"
+         << "file_path = log/\n"
+         << "file_base_name = alloc_test\n";
+    return conf.good();
+}
+
+int main(int argc, char **argv) {
+    const string conf_file = "alloc_test.conf";
+    if (!write_config(conf_file, 1) || !LOG_SYS_INIT(conf_file)) {
+        fprintf(stderr, "Failed to initialize the log system\n");
+        return 1;
+    }
+    unlink(conf_file.c_str());
+
+    const int warm_up_num = 1000;
+    const int log_num = 100000;
+    const string name("alloc_test");
+
+    for (int i = 0; i < warm_up_num; ++i) {
+        LOG_INFO("warm up %d: %s took %lu us, ratio %f", i, name.c_str(), 12345UL, 0.5);
+        LOG_DEBUG("warm up %d", i);
+    }
+
+    s_counting = true;
+    for (int i = 0; i < log_num; ++i) {
+        LOG_INFO("log %d: %s took %lu us, ratio %f", i, name.c_str(), 12345UL, 0.5);
+        LOG_DEBUG("log %d", i);
+        LOG_ERROR("no argument");
+    }
+    s_counting = false;
+
+    printf("%lu allocations for %d logs\n", s_alloc_num, log_num * 3);
+    if (s_alloc_num != 0) {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
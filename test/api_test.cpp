@@ -0,0 +1,52 @@
+/*
+ * api_test.cpp
+ *
+ *  Checks what the type-safe API (interface #6) makes of its formats, in
+ *  particular a number of {} that doesn't match the arguments, which only a
+ *  C++20 compiler rejects; this file is built as C++11.
+ */
+
+#include <stdio.h>
+#include <string>
+#include "../output/allyes-log.h"
+
+
+using namespace std;
+
+
+static int s_failed = 0;
+
+template <typename... Args>
+static void expect(const string& expected, const char* format, const Args&... args) {
+    allyes::log::detail::LogLine line;
+    allyes::log::detail::format_to(line, format, format + strlen(format), args...);
+
+    const string actual(line.data(), line.size());
+    if (actual != expected) {
+        fprintf(stderr, "FAILED: \"%s\" gave \"%s\", expected \"%s\"\n", format, actual.c_str(), expected.c_str());
+        s_failed++;
+    }
+}
+
+int main(int argc, char **argv) {
+    expect("no argument", "no argument");
+    expect("a 1 b two c", "a {} b {} c", 1, "two");
+    expect("{} and {1}", "{{}} and {{{}}}", 1);
+    expect("bool true, char x, double 0.5", "bool {}, char {}, double {}", true, 'x', 0.5);
+
+    // more arguments than {}
+    expect("x 1 2", "x {}", 1, 2);
+    expect("x 1 2 three", "x", 1, 2, string("three"));
+
+    // fewer arguments than {}
+    expect("a 1 b {} c", "a {} b {} c", 1);
+    expect("{} and {}", "{} and {}");
+    expect("{1} {}", "{{{}}} {}", 1);
+
+    if (s_failed > 0) {
+        fprintf(stderr, "%d case(s) failed\n", s_failed);
+        return 1;
+    }
+    printf("All the API cases passed\n");
+    return 0;
+}
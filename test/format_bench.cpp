@@ -0,0 +1,183 @@
+/*
+ * format_bench.cpp
+ *
+ *  Checks that log_snprintf(), the formatter of LOG_XXX, gives exactly what
+ *  snprintf() gives, then compares their speed on the kind of formats our
+ *  services log.
+ *
+ *  Usage: formatBench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <wchar.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include "../output/allyes-log.h"
+
+
+using namespace std;
+
+
+static int s_failed = 0;
+
+#define CHECK_FORMAT(format, ...)                                               \
+{                                                                               \
+    char expected[512], actual[512];                                            \
+    const int n1 = snprintf(expected, sizeof(expected), format, ##__VA_ARGS__);  \
+    const int n2 = log_snprintf(actual, sizeof(actual), format, ##__VA_ARGS__);  \
+    if (n1 != n2 || strcmp(expected, actual) != 0) {                            \
+        printf("MISMATCH <%s>: snprintf <%s> %d, log_snprintf <%s> %d\n",       \
+                format, expected, n1, actual, n2);                              \
+        s_failed++;                                                             \
+    }                                                                           \
+}
+
+static void check_fixed_cases() {
+    CHECK_FORMAT("enter main()");
+    CHECK_FORMAT("100%% done");
+    CHECK_FORMAT("%d %i %u %ld %lu %lld %llu", 0, -1, 4294967295u, -2147483649L, 18446744073709551615UL, -9223372036854775807LL - 1, 12ULL);
+    CHECK_FORMAT("%hd %hu %hhd %hhu %zd %zu %jd %td", 70000, 70000, 300, 300, (ssize_t)-5, (size_t)5, (intmax_t)-6, (ptrdiff_t)7);
+    CHECK_FORMAT("[%5d] [%-5d] [%05d] [%+d] [% d] [%.3d] [%8.3d] [%-8.3d]", 42, 42, -42, 42, 42, 7, -7, 7);
+    CHECK_FORMAT("[%.0d] [%5.0d] [%+.0d] [%x] [%#x] [%#X] [%#o] [%#o] [%#.0o] [%#.5o]", 0, 0, 0, 0, 0, 255, 0, 8, 0, 8);
+    CHECK_FORMAT("[%x] [%X] [%08x] [%#010x] [%lx] [%o] [%#lo]", 0xdeadbeef, 0xabcu, 0x1f, 0x1f, 0xffffffffffUL, 511, 511UL);
+    CHECK_FORMAT("[%*d] [%-*d] [%*d] [%.*d] [%.*d]", 6, 1, 6, 2, -6, 3, 4, 5, -1, 6);
+    CHECK_FORMAT("[%c] [%3c] [%-3c]", 'a', 'b', 'c');
+    const char* null_str = getenv("LOG_FORMAT_BENCH_NO_SUCH_VARIABLE");
+    CHECK_FORMAT("[%s] [%10s] [%-10s] [%.2s] [%10.2s] [%s] [%.3s] [%.*s]", "abc", "abc", "abc", "abc", "abc", null_str, null_str, 3, "abcdef");
+    CHECK_FORMAT("[%p] [%p] [%20p] [%-20p]", (void*)0x1234, (void*)NULL, (void*)0xabc, (void*)0xabc);
+    CHECK_FORMAT("[%f] [%.0f] [%.1f] [%.2f] [%.3f] [%#.0f]", 3.14159, 2.5, 0.05, 0.125, 1.0005, 3.0);
+    CHECK_FORMAT("[%f] [%f] [%f] [%f] [%F] [%f] [%f]", 0.0, -0.0, 1e-300, 123456789.123456789, 1e19, INFINITY, -INFINITY);
+    CHECK_FORMAT("[%f] [%F] [%5.1f] [%-8.2f] [%08.2f] [%+f] [% f] [%+08.3f]", NAN, -NAN, 9.99, 1.5, -1.5, 2.0, 2.0, -0.0005);
+    CHECK_FORMAT("[%.17f] [%.18f] [%f] [%.10f] [%f]", 0.1, 0.1, 1e20, 1.0 / 3, 18446744073709549568.0);
+    CHECK_FORMAT("[%e] [%E] [%g] [%G] [%.3g] [%a] [%Lf] [%Le]", 12345.678, 0.000123, 0.0001, 1e20, 3.14159, 1.0, 2.5L, 2.5L);
+
+    // given to libc as a whole
+    CHECK_FORMAT("[%ls] [%8ls] [%.2ls] [%lc] [%-3lc]", L"wide", L"wide", L"wide", (wint_t)L'w', (wint_t)L'x');
+    CHECK_FORMAT("[%2$s %1$d] [%1$5d] [%2$.1s]", 5, "pos");
+    // not literals, which -Wformat warns of
+    const char* pointer_flags = "[%+p] [% p] [%020p] [%.20p] [%+p] [%-+10p]";
+    CHECK_FORMAT(pointer_flags, (void*)0x1234, (void*)0x1234, (void*)0x1234, (void*)0x1234, (void*)NULL, (void*)0xabc);
+    const char* unknown = "[%y] [%5y] [%d]";
+    CHECK_FORMAT(unknown, 42);
+
+    // %n: never to libc as a whole, the rest comes out the same
+    int written = 0;
+    const char* pointer_flags_n = "[%ls] [%lc] [%d]%n [%+p] [%.3g]";
+    CHECK_FORMAT(pointer_flags_n, L"wide", (wint_t)L'w', 7, &written, (void*)0x1234, 3.14159);
+    const char* unknown_n = "[%y] [%d]%n";
+    CHECK_FORMAT(unknown_n, 42, &written);
+
+    // too small buffers
+    char small[8];
+    const int n = log_snprintf(small, sizeof(small), "%s-%d", "abcdef", 12345);
+    if (n != 12 || strcmp(small, "abcdef-")) {
+        printf("MISMATCH: truncated to <%s> %d\n", small, n);
+        s_failed++;
+    }
+    if (log_snprintf(NULL, 0, "%d", 123456) != 6) {
+        printf("MISMATCH: the length without a buffer\n");
+        s_failed++;
+    }
+}
+
+static void check_random_cases(int num) {
+    srand(12345);
+
+    for (int i = 0; i < num; ++i) {
+        // doubles of every magnitude, with every fast precision
+        const double mantissa = static_cast<double>(rand()) / RAND_MAX;
+        const double value = ldexp(mantissa, rand() % 140 - 70) * (rand() % 2 ? 1 : -1);
+        const int precision = rand() % 18;
+        CHECK_FORMAT("%.*f", precision, value);
+
+        // the ties: k / 2^n
+        const double tie = ldexp(static_cast<double>(rand() % 100000), -(rand() % 20));
+        const int tie_precision = rand() % 8;
+        CHECK_FORMAT("%.*f", tie_precision, tie);
+
+        const long long integer = (static_cast<long long>(rand()) << 32) ^ rand();
+        CHECK_FORMAT("%lld %llx %llo %+12lld %-20llu", integer, integer, integer, integer, integer);
+    }
+}
+
+
+//
+// the benchmark
+//
+
+template <typename F>
+static double time_per_call(int iterations, F f) {
+    const chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        f(i);
+    }
+    const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - begin).count() / iterations;
+}
+
+// both through a va_list, so neither can be folded by the compiler
+static int __attribute__((noinline)) libc_format(char* buf, size_t size, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int n = vsnprintf(buf, size, format, args);
+    va_end(args);
+    return n;
+}
+
+static int __attribute__((noinline)) log_format(char* buf, size_t size, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int n = log_vsnprintf(buf, size, format, args);
+    va_end(args);
+    return n;
+}
+
+#define BENCH(name, format, ...)                                                    \
+{                                                                                   \
+    char buf[512];                                                                  \
+    volatile int sink = 0;                                                          \
+    const double t_libc = time_per_call(iterations, [&](int i) {                    \
+        sink += libc_format(buf, sizeof(buf), format, ##__VA_ARGS__);                \
+    });                                                                             \
+    const double t_log = time_per_call(iterations, [&](int i) {                     \
+        sink += log_format(buf, sizeof(buf), format, ##__VA_ARGS__);                 \
+    });                                                                             \
+    printf("%-28s %10.1f %10.1f %8.2fx\n", name, t_libc, t_log, t_libc / t_log);    \
+}
+
+static void run_benchmark(int iterations) {
+    const string host("10.1.2.3");
+    const char* user = "someone@example.com";
+
+    printf("%-28s %10s %10s %9s\n", "format (ns per call)", "snprintf", "log_fmt", "speedup");
+    BENCH("no argument", "enter main()");
+    BENCH("%d", "log %d", i);
+    BENCH("%lu", "processed %lu records", static_cast<unsigned long>(i) * 1000003UL);
+    BENCH("%s", "connect to %s", host.c_str());
+    BENCH("%f", "ratio %f", i * 0.001);
+    BENCH("%d %s %lu", "request %d from %s took %lu us", i, user, static_cast<unsigned long>(i) * 7);
+    BENCH("%s:%d %x", "peer %s:%d flags %x", host.c_str(), 8080, i);
+    BENCH("%.2f%% %5d", "cpu %.2f%% threads %5d", i * 0.37, i & 0xff);
+    BENCH("%ld %ld %ld %ld", "q=%ld p50=%ld p99=%ld max=%ld", static_cast<long>(i), 120L, 870L, 12000L);
+    BENCH("%g (libc path)", "value %g", i * 0.5);
+}
+
+int main(int argc, char **argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    check_fixed_cases();
+    check_random_cases(100000);
+    if (s_failed > 0) {
+        printf("FAILED: %d mismatches\n", s_failed);
+        return 1;
+    }
+    printf("log_snprintf() matches snprintf()\n");
+
+    run_benchmark(iterations);
+    return 0;
+}
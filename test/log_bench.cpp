@@ -0,0 +1,330 @@
+/*
+ * log_bench.cpp
+ *
+ *  The throughput and the per-call latency of LOG_INFO from 1 to N threads,
+ *  for every log_dest, num_logs_to_flush and message size asked for. Every
+ *  case runs in a process of its own, since the log system is initialized
+ *  once per process.
+ *
+ *  The results go to stdout as a table, and to a tab separated file with one
+ *  line per case, in a fixed order, to be diffed between versions:
+ *
+ *      log_dest threads num_logs_to_flush msg_size records_per_s mb_per_s
+ *      p50_ns p99_ns p999_ns max_ns
+ *
+ *  MB/s counts the bytes the sinks wrote, see LOG_GET_METRICS. Only the
+ *  public interface is used, so the same binary can be run against another
+ *  build of liballyes-log.so (LD_LIBRARY_PATH).
+ *
+ *  Usage: logBench [-t max_threads] [-n logs_per_thread] [-d log_dests]
+ *                  [-f flush_nums] [-s msg_sizes] [-o result_file]
+ *  The lists are comma separated; threads go 1, 2, 4 ... up to max_threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <boost/bind/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/filesystem.hpp>
+#include "../output/allyes-log.h"
+
+
+using namespace std;
+
+
+static const char* const BENCH_LOG_PATH = "log_bench_log/";
+static const char* const BENCH_CONFIG_FILE = "log_bench.conf";
+static const int WARM_UP_LOGS = 1000;   // per thread, not timed
+
+static const int DEF_MAX_THREADS = 4;
+static const int DEF_LOGS_PER_THREAD = 20000;
+static const char* const DEF_LOG_DESTS = "0,1,2,3,4";
+static const char* const DEF_FLUSH_NUMS = "1,100,10000";
+static const char* const DEF_MSG_SIZES = "32,256,1024";
+static const char* const DEF_RESULT_FILE = "bench_result.tsv";
+
+
+struct BenchCase {
+    int log_dest;
+    int threads;
+    int flush_num;
+    int msg_size;
+};
+
+// what a thread did
+struct ThreadRun {
+    chrono::steady_clock::time_point begin;
+    chrono::steady_clock::time_point end;
+    vector<uint32_t> latencies;     // ns
+};
+
+// what a case gives back to the parent through a pipe
+struct BenchResult {
+    double records_per_s;
+    double mb_per_s;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+};
+
+
+static vector<int> parse_list(const char* text) {
+    vector<int> values;
+    string item;
+    for (const char* p = text; ; ++p) {
+        if ('\0' == *p || ',' == *p) {
+            if (!item.empty()) {
+                values.push_back(atoi(item.c_str()));
+            }
+            item.clear();
+            if ('\0' == *p) {
+                break;
+            }
+        }
+        else {
+            item += *p;
+        }
+    }
+    return values;
+}
+
+static bool write_config(const BenchCase& bench_case) {
+    ofstream conf(BENCH_CONFIG_FILE);
+    conf << "log_dest = " << bench_case.log_dest << "\n"
+         << "log_level = 1\n"
+         << "num_logs_to_flush = " << bench_case.flush_num << "\n"
+         << "file_path = " << BENCH_LOG_PATH << "\n"
+         << "file_base_name = log_bench\n";
+    return conf.good();
+}
+
+// logs 'logs' times, keeping the time of every call
+static void run_thread(boost::barrier* start, const string* payload, int logs, ThreadRun* run) {
+    for (int i = 0; i < WARM_UP_LOGS; ++i) {
+        LOG_INFO("warm up %d %s", i, payload->c_str());
+    }
+
+    run->latencies.reserve(logs);
+    start->wait();
+
+    run->begin = chrono::steady_clock::now();
+    for (int i = 0; i < logs; ++i) {
+        const chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        LOG_INFO("req %06d %s", i, payload->c_str());
+        const chrono::nanoseconds spent = chrono::steady_clock::now() - begin;
+        run->latencies.push_back(static_cast<uint32_t>(min<int64_t>(spent.count(), UINT32_MAX)));
+    }
+    run->end = chrono::steady_clock::now();
+}
+
+// in the child process
+static bool run_case(const BenchCase& bench_case, int logs, BenchResult& result) {
+    if (!write_config(bench_case) || !LOG_SYS_INIT(BENCH_CONFIG_FILE)) {
+        return false;
+    }
+    unlink(BENCH_CONFIG_FILE);
+
+    // "req 000000 " is 11 bytes of the message
+    const string payload(max(bench_case.msg_size - 11, 0), 'x');
+    vector<ThreadRun> runs(bench_case.threads);
+    boost::barrier start(bench_case.threads + 1);
+    boost::thread_group threads;
+
+    for (int i = 0; i < bench_case.threads; ++i) {
+        threads.create_thread(boost::bind(run_thread, &start, &payload, logs, &runs[i]));
+    }
+
+    LogMetrics before;
+    LOG_GET_METRICS(before);
+    start.wait();
+    threads.join_all();
+    LogMetrics after;
+    LOG_GET_METRICS(after);
+
+    // from the first thread to start to the last one to end
+    chrono::steady_clock::time_point begin = runs[0].begin, end = runs[0].end;
+    vector<uint32_t> all;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        begin = min(begin, runs[i].begin);
+        end = max(end, runs[i].end);
+        all.insert(all.end(), runs[i].latencies.begin(), runs[i].latencies.end());
+    }
+    sort(all.begin(), all.end());
+    const chrono::duration<double> spent = end - begin;
+
+    result.records_per_s = all.size() / spent.count();
+    result.mb_per_s = (after.bytes - before.bytes) / spent.count() / (1024 * 1024);
+    result.p50_ns = all[all.size() * 50 / 100];
+    result.p99_ns = all[all.size() * 99 / 100];
+    result.p999_ns = all[all.size() * 999 / 1000];
+    result.max_ns = all.back();
+    return true;
+}
+
+// forks a child for the case; false on failure
+static bool bench_case(const BenchCase& bench_case, int logs, BenchResult& result) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+
+    // or the child writes out what's buffered once more at its exit()
+    fflush(NULL);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+
+    if (0 == pid) {
+        close(fds[0]);
+
+        // the logs of log_dest = 0 and the messages of the log system
+        const int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDERR_FILENO);
+            close(null_fd);
+        }
+
+        BenchResult child_result;
+        const bool ok = run_case(bench_case, logs, child_result);
+        const ssize_t n = ok ? write(fds[1], &child_result, sizeof(child_result)) : 0;
+        close(fds[1]);
+        exit(sizeof(child_result) == n ? 0 : 1);
+    }
+
+    close(fds[1]);
+    const bool ok = read(fds[0], &result, sizeof(result)) == sizeof(result);
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    // the logs written are of no use, and would slow down the next case
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(BENCH_LOG_PATH, ec);
+    return ok;
+}
+
+static void print_usage(const char* name) {
+    printf("Usage: %s [-t max_threads] [-n logs_per_thread] [-d log_dests] [-f flush_nums] [-s msg_sizes] "
+            "[-o result_file]\n", name);
+    printf("  defaults: -t %d -n %d -d %s -f %s -s %s -o %s\n", DEF_MAX_THREADS, DEF_LOGS_PER_THREAD,
+            DEF_LOG_DESTS, DEF_FLUSH_NUMS, DEF_MSG_SIZES, DEF_RESULT_FILE);
+}
+
+int main(int argc, char **argv) {
+    int max_threads = DEF_MAX_THREADS;
+    int logs = DEF_LOGS_PER_THREAD;
+    vector<int> dests = parse_list(DEF_LOG_DESTS);
+    vector<int> flush_nums = parse_list(DEF_FLUSH_NUMS);
+    vector<int> sizes = parse_list(DEF_MSG_SIZES);
+    string result_file = DEF_RESULT_FILE;
+
+    int next_option;
+    const char* const short_options = "ht:n:d:f:s:o:";
+    const struct option long_options[] = {
+        { "help", 0, NULL, 'h' },
+        { "threads", 1, NULL, 't' },
+        { "logs", 1, NULL, 'n' },
+        { "log_dests", 1, NULL, 'd' },
+        { "flush_nums", 1, NULL, 'f' },
+        { "msg_sizes", 1, NULL, 's' },
+        { "output", 1, NULL, 'o' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    while (0 < (next_option = getopt_long(argc, argv, short_options, long_options, NULL))) {
+        switch (next_option) {
+            case 't':
+                max_threads = atoi(optarg);
+                break;
+
+            case 'n':
+                logs = atoi(optarg);
+                break;
+
+            case 'd':
+                dests = parse_list(optarg);
+                break;
+
+            case 'f':
+                flush_nums = parse_list(optarg);
+                break;
+
+            case 's':
+                sizes = parse_list(optarg);
+                break;
+
+            case 'o':
+                result_file = optarg;
+                break;
+
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (max_threads < 1 || logs < 1 || dests.empty() || flush_nums.empty() || sizes.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    FILE* out = fopen(result_file.c_str(), "w");
+    if (NULL == out) {
+        printf("FAILED to open <%s>\n", result_file.c_str());
+        return 1;
+    }
+    fprintf(out, "log_dest\tthreads\tnum_logs_to_flush\tmsg_size\trecords_per_s\tmb_per_s\t"
+            "p50_ns\tp99_ns\tp999_ns\tmax_ns\n");
+
+    printf("%4s %7s %6s %6s %12s %9s %8s %8s %8s %10s\n",
+            "dest", "threads", "flush", "size", "records/s", "MB/s", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+
+    int failed = 0;
+    for (size_t d = 0; d < dests.size(); ++d) {
+        for (size_t f = 0; f < flush_nums.size(); ++f) {
+            for (size_t s = 0; s < sizes.size(); ++s) {
+                for (int threads = 1; threads <= max_threads; threads *= 2) {
+                    const BenchCase one = { dests[d], threads, flush_nums[f], sizes[s] };
+                    BenchResult result;
+                    if (!bench_case(one, logs, result)) {
+                        printf("%4d %7d %6d %6d FAILED\n", one.log_dest, one.threads, one.flush_num, one.msg_size);
+                        failed++;
+                        continue;
+                    }
+
+                    printf("%4d %7d %6d %6d %12.0f %9.1f %8llu %8llu %8llu %10llu\n",
+                            one.log_dest, one.threads, one.flush_num, one.msg_size,
+                            result.records_per_s, result.mb_per_s,
+                            (unsigned long long)result.p50_ns, (unsigned long long)result.p99_ns,
+                            (unsigned long long)result.p999_ns, (unsigned long long)result.max_ns);
+                    fprintf(out, "%d\t%d\t%d\t%d\t%.0f\t%.2f\t%llu\t%llu\t%llu\t%llu\n",
+                            one.log_dest, one.threads, one.flush_num, one.msg_size,
+                            result.records_per_s, result.mb_per_s,
+                            (unsigned long long)result.p50_ns, (unsigned long long)result.p99_ns,
+                            (unsigned long long)result.p999_ns, (unsigned long long)result.max_ns);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    fclose(out);
+    printf("Results written to <%s>\n", result_file.c_str());
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * rolling_bench.cpp
+ *
+ *  The cost of a log written to the rolling file (log_dest = 2), next to the
+ *  plain file (log_dest = 1) it writes the same way. Every run of a sink is a
+ *  process of its own, since the log system is initialized once per process;
+ *  the sinks take turns, and the best run of each counts.
+ *
+ *  Only the public interface is used, so the same binary can be run against
+ *  another build of liballyes-log.so (LD_LIBRARY_PATH) to compare versions.
+ *
+ *  Usage: rollingBench [logs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include "../output/allyes-log.h"
+
+
+using namespace std;
+
+
+static const char* const BENCH_LOG_PATH = "rolling_bench_log/";
+static const int ROUND_NUM = 5;     // in a process, the best one counts
+static const int PASS_NUM = 6;      // processes per sink, taking turns
+
+
+static bool write_config(const string& file_name, int log_dest) {
+    ofstream conf(file_name.c_str());
+    conf << "log_dest = " << log_dest << "\n"
+         << "log_level = 1\n"
+         << "num_logs_to_flush = 100\n"
+         << "file_path = " << BENCH_LOG_PATH << "\n"
+         << "file_base_name = rolling_bench_" << log_dest << "\n";
+    return conf.good();
+}
+
+// the best ns per log of a few rounds
+static double time_logs(int logs) {
+    const string host("10.1.2.3");
+    double best = 0;
+
+    for (int round = 0; round < ROUND_NUM; ++round) {
+        const chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        for (int i = 0; i < logs; ++i) {
+            LOG_INFO("request %d from %s took %lu us", i, host.c_str(), 12345UL);
+        }
+        const chrono::duration<double, nano> spent = chrono::steady_clock::now() - begin;
+
+        const double ns = spent.count() / logs;
+        if (0 == round || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+// runs the sink in a child process; returns the ns per log, or a negative
+// number on failure
+static double bench_sink(int log_dest, int logs) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+
+    if (0 == pid) {
+        close(fds[0]);
+
+        char conf_file[64];
+        snprintf(conf_file, sizeof(conf_file), "rolling_bench_%d.conf", log_dest);
+        double ns = -1;
+        if (write_config(conf_file, log_dest) && LOG_SYS_INIT(conf_file)) {
+            unlink(conf_file);
+            ns = time_logs(logs);
+        }
+
+        const ssize_t n = write(fds[1], &ns, sizeof(ns));
+        close(fds[1]);
+        exit(sizeof(ns) == n ? 0 : 1);
+    }
+
+    close(fds[1]);
+    double ns = -1;
+    if (read(fds[0], &ns, sizeof(ns)) != sizeof(ns)) {
+        ns = -1;
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return ns;
+}
+
+int main(int argc, char **argv) {
+    const int logs = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (logs < 1) {
+        fprintf(stderr, "Usage: %s [logs]\n", argv[0]);
+        return 1;
+    }
+
+    double file_ns = 0, rolling_ns = 0;
+    for (int pass = 0; pass < PASS_NUM; ++pass) {
+        const double file = bench_sink(1, logs);
+        const double rolling = bench_sink(2, logs);
+        if (file < 0 || rolling < 0) {
+            printf("FAILED to run the benchmark\n");
+            return 1;
+        }
+
+        if (0 == pass || file < file_ns) {
+            file_ns = file;
+        }
+        if (0 == pass || rolling < rolling_ns) {
+            rolling_ns = rolling;
+        }
+    }
+
+    // the logs written are of no use
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(BENCH_LOG_PATH, ec);
+
+    printf("%-28s %10s\n", "sink (ns per log)", "ns");
+    printf("%-28s %10.1f\n", "file (log_dest = 1)", file_ns);
+    printf("%-28s %10.1f\n", "rolling file (log_dest = 2)", rolling_ns);
+    printf("%-28s %+10.1f\n", "rolling over file", rolling_ns - file_ns);
+    return 0;
+}
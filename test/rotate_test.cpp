@@ -0,0 +1,155 @@
+/*
+ * rotate_test.cpp
+ *
+ *  Checks that no log is lost when the rolling file (log_dest = 2) is rotated
+ *  by size several times a day with compress_rotated = 1: a rotated file
+ *  takes the name of one already compressed, e.g. "<name>.2012-08-23" once
+ *  "<name>.2012-08-23.gz" is there, both in a process and after a restart.
+ *  Every run is a process of its own, since the log system is initialized
+ *  once per process; the lines are then counted across all the files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <zlib.h>
+#include <string>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include "../output/allyes-log.h"
+
+
+using namespace std;
+
+
+static const char* const TEST_LOG_PATH = "rotate_test_log/";
+static const char* const TEST_BASE_NAME = "rotate_test";
+static const char* const TEST_CONF_FILE = "rotate_test.conf";
+static const int RUN_NUM = 2;           // processes, one after the other
+static const int BURST_NUM = 3;         // per process, a rotation in each
+static const int BURST_LOGS = 6000;     // of about 240 bytes, 1.4 MB
+
+
+static bool write_config() {
+    ofstream conf(TEST_CONF_FILE);
+    conf << "log_dest = 2\n"
+         << "log_level = 1\n"
+         << "num_logs_to_flush = 100\n"
+         << "rotate_size_mb = 1\n"
+         << "compress_rotated = 1\n"
+         << "compress_level = 1\n"
+         << "compress_cpu_percent = 100\n"
+         << "file_path = " << TEST_LOG_PATH << "\n"
+         << "file_base_name = " << TEST_BASE_NAME << "\n";
+    return conf.good();
+}
+
+// whether a rotated file is still waiting to be compressed
+static bool is_compressing() {
+    const string prefix = string(TEST_BASE_NAME) + ".";
+    const string next = string(TEST_BASE_NAME) + ".next";
+
+    boost::filesystem::directory_iterator end;
+    for (boost::filesystem::directory_iterator it(TEST_LOG_PATH); it != end; ++it) {
+        const string name = it->path().filename().string();
+        if (0 == name.compare(0, prefix.size(), prefix) && name != next &&
+                (name.size() < 3 || name.compare(name.size() - 3, 3, ".gz") != 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void run_bursts(int run) {
+    const string padding(200, 'x');
+
+    for (int burst = 0; burst < BURST_NUM; ++burst) {
+        for (int i = 0; i < BURST_LOGS; ++i) {
+            LOG_INFO("run %d burst %d log %d %s", run, burst, i, padding.c_str());
+        }
+
+        // the next rotation then reuses the name just compressed
+        for (int i = 0; i < 300 && is_compressing(); ++i) {
+            usleep(100 * 1000);
+        }
+    }
+}
+
+// lines in the file, compressed or not, as gzread() reads both
+static long count_lines(const string& file_name) {
+    gzFile gz = gzopen(file_name.c_str(), "rb");
+    if (NULL == gz) {
+        return -1;
+    }
+
+    long lines = 0;
+    char buf[64 * 1024];
+    int n = 0;
+    while ((n = gzread(gz, buf, sizeof(buf))) > 0) {
+        for (int i = 0; i < n; ++i) {
+            if ('\n' == buf[i]) {
+                lines++;
+            }
+        }
+    }
+    gzclose(gz);
+    return n < 0 ? -1 : lines;
+}
+
+int main(int argc, char **argv) {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(TEST_LOG_PATH, ec);
+
+    if (!write_config()) {
+        printf("FAILED to write %s\n", TEST_CONF_FILE);
+        return 1;
+    }
+
+    for (int run = 0; run < RUN_NUM; ++run) {
+        const pid_t pid = fork();
+        if (pid < 0) {
+            printf("FAILED to fork\n");
+            return 1;
+        }
+
+        if (0 == pid) {
+            if (!LOG_SYS_INIT(TEST_CONF_FILE)) {
+                exit(1);
+            }
+            run_bursts(run);
+            exit(0);
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("FAILED to run the logs of run %d\n", run);
+            return 1;
+        }
+    }
+    unlink(TEST_CONF_FILE);
+
+    long lines = 0;
+    int files = 0;
+    boost::filesystem::directory_iterator end;
+    for (boost::filesystem::directory_iterator it(TEST_LOG_PATH); it != end; ++it) {
+        const long n = count_lines(it->path().string());
+        if (n < 0) {
+            printf("FAILED to read %s\n", it->path().string().c_str());
+            return 1;
+        }
+        lines += n;
+        files++;
+    }
+
+    const long expected = static_cast<long>(RUN_NUM) * BURST_NUM * BURST_LOGS;
+    if (lines != expected) {
+        printf("FAILED: %ld lines in %d files, expected %ld\n", lines, files, expected);
+        return 1;
+    }
+
+    boost::filesystem::remove_all(TEST_LOG_PATH, ec);
+    printf("All the %ld rotated logs were kept, in %d files\n", lines, files);
+    return 0;
+}